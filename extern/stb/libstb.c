@@ -1,3 +1,5 @@
+// the failure reason is a global, the models decode their images on several threads
+#define STBI_NO_FAILURE_STRINGS
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "types.hpp"
+#include <glm/glm.hpp>
+#include <limits>
+
+namespace ay
+{
+    struct BoundingBox {
+        ///
+        /// @brief Constructor (empty box)
+        ///
+        BoundingBox()
+            : min(std::numeric_limits<f32>::max()),
+            max(-std::numeric_limits<f32>::max())
+        {
+        }
+
+        ///
+        /// @brief Constructor
+        /// @param min Minimum corner
+        /// @param max Maximum corner
+        ///
+        BoundingBox(const glm::vec3& min, const glm::vec3& max)
+            : min(min),
+            max(max)
+        {
+        }
+
+        ///
+        /// @brief Check if the box contains nothing
+        /// @return True if empty
+        ///
+        inline bool empty() const {
+            return min.x > max.x || min.y > max.y || min.z > max.z;
+        }
+
+        ///
+        /// @brief Get center
+        /// @return Center
+        ///
+        inline glm::vec3 center() const {
+            return (min + max) * .5f;
+        }
+
+        ///
+        /// @brief Get half size
+        /// @return Extent
+        ///
+        inline glm::vec3 extent() const {
+            return (max - min) * .5f;
+        }
+
+        ///
+        /// @brief Grow the box to contain a point
+        /// @param point Point
+        ///
+        inline void merge(const glm::vec3& point) {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+
+        ///
+        /// @brief Grow the box to contain another box
+        /// @param box Box
+        ///
+        inline void merge(const BoundingBox& box) {
+            min = glm::min(min, box.min);
+            max = glm::max(max, box.max);
+        }
+
+        ///
+        /// @brief Get the box containing this box transformed by a matrix
+        /// @param matrix Affine matrix
+        /// @return Transformed box
+        ///
+        inline BoundingBox transform(const glm::mat4& matrix) const {
+            if (empty()) {
+                return *this;
+            }
+
+            // new extent is |M| * extent (Arvo)
+            const glm::vec3 c = center();
+            const glm::vec3 e = extent();
+            const glm::vec3 newCenter = glm::vec3(matrix * glm::vec4(c, 1.f));
+            const glm::vec3 newExtent =
+                glm::abs(glm::vec3(matrix[0])) * e.x +
+                glm::abs(glm::vec3(matrix[1])) * e.y +
+                glm::abs(glm::vec3(matrix[2])) * e.z;
+            return BoundingBox(newCenter - newExtent, newCenter + newExtent);
+        }
+
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+}
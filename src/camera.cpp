@@ -5,26 +5,30 @@
 
 namespace ay
 {
+    void Camera::updateBlock() const {
+        CameraBlock block;
+        block.projectionMatrix = projection;
+        block.viewMatrix = view;
+        block.cameraPosition = glm::vec4(position, 1.f);
+        ctx->uniformBlockUpdate("Camera", 0, sizeof(block), &block);
+    }
+
     void PerspectiveCamera::update(f32 deltaTime) {
         (void)deltaTime;
         auto& window = ctx->getWindow();
         const f32 aspect = static_cast<f32>(window.getSize().first) / static_cast<f32>(window.getSize().second);
 
-        glm::mat4 projection = glm::perspective(glm::radians(fov), aspect, zNear, zFar);
-        glm::mat4 view = glm::lookAt(position, position + front, up);
-        ctx->shaderUniform("projectionMatrix", projection);
-        ctx->shaderUniform("viewMatrix", view);
-        ctx->shaderUniform("cameraPosition", position);
+        projection = glm::perspective(glm::radians(fov), aspect, zNear, zFar);
+        view = glm::lookAt(position, position + front, up);
+        updateBlock();
     }
 
     void OrthographicCamera::update(f32 deltaTime) {
         (void)deltaTime;
 
-        glm::mat4 projection = glm::ortho(left, right, bottom, top, zNear, zFar);
-        glm::mat4 view = glm::translate(glm::mat4(1.f), position);
-        ctx->shaderUniform("projectionMatrix", projection);
-        ctx->shaderUniform("viewMatrix", view);
-        ctx->shaderUniform("cameraPosition", position);
+        projection = glm::ortho(left, right, bottom, top, zNear, zFar);
+        view = glm::translate(glm::mat4(1.f), position);
+        updateBlock();
     }
 
     void FreeCamera::update(f32 deltaTime) {
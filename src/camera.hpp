@@ -8,6 +8,15 @@ namespace ay
 {
     class Context;
 
+    ///
+    /// @brief Camera uniform block (std140)
+    ///
+    struct CameraBlock {
+        glm::mat4 projectionMatrix;
+        glm::mat4 viewMatrix;
+        glm::vec4 cameraPosition;
+    };
+
     class Camera {
     public:
         /// 
@@ -21,6 +30,30 @@ namespace ay
         /// 
         virtual void update(f32 deltaTime) = 0;
 
+        ///
+        /// @brief Get the position
+        /// @return Position
+        ///
+        inline const glm::vec3& getPosition() const {
+            return position;
+        }
+
+        ///
+        /// @brief Get the projection matrix of the last update
+        /// @return Projection matrix
+        ///
+        inline const glm::mat4& getProjectionMatrix() const {
+            return projection;
+        }
+
+        ///
+        /// @brief Get the view matrix of the last update
+        /// @return View matrix
+        ///
+        inline const glm::mat4& getViewMatrix() const {
+            return view;
+        }
+
     protected:
         /// 
         /// @brief Constructor
@@ -34,10 +67,17 @@ namespace ay
             zFar(far),
             position(),
             front(0.f, 0.f, 1.f),
-            up(0.f, 1.f, 0.f)
+            up(0.f, 1.f, 0.f),
+            projection(1.f),
+            view(1.f)
         {
         }
 
+        ///
+        /// @brief Upload projection, view and position to the camera uniform block
+        ///
+        void updateBlock() const;
+
     protected:
         Context* ctx;
         f32 zNear;
@@ -45,6 +85,8 @@ namespace ay
         glm::vec3 position;
         glm::vec3 front;
         glm::vec3 up;
+        glm::mat4 projection;
+        glm::mat4 view;
     };
 
     class PerspectiveCamera : public Camera {
@@ -1,25 +1,108 @@
 #include "context.hpp"
+#include "camera.hpp"
+#include "light.hpp"
+#include "render_queue.hpp"
+#include "geometry_arena.hpp"
+#include "thread_pool.hpp"
+#include "mapped_file.hpp"
+#include "ktx2.hpp"
 #include "shaders/blinnphong.hpp"
 #include <fstream>
 #include <streambuf>
+#include <iomanip>
+#include <random>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
 #include <stb_image.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 
 namespace ay
 {
+    static const char PROGRAM_BINARY_MAGIC[4] = { 'A', 'Y', 'P', 'B' };
+
+    constexpr GLuint Context::INVALID_BINDING;
+    constexpr GLintptr Context::WHOLE_BUFFER;
+
     Context::Context(const Window& window)
         : window(window),
+        renderQueue(nullptr),
+        geometryArenas(),
+        threadPool(nullptr),
         shaders(),
         textures(),
         renderbuffers(),
         framebuffers(),
-        currentShader(0)
+        uniformBlockBindings(),
+        uniformBlocks(),
+        shaderTemplates(),
+        sceneFeatures(),
+        shaderCacheDirectory("shader_cache"),
+        pendingShaders(),
+        programBinarySupported(false),
+        parallelShaderCompile(false),
+        compressedFormats(),
+        maxUniformBlockSize(16384),
+        uniformBufferAlignment(256),
+        currentShader(0),
+        currentUniforms(nullptr),
+        programSortIds(),
+        vaoSortIds(),
+        uniformRangeSortIds(),
+        uniformRanges(),
+        boundProgram(0),
+        boundVao(0),
+        boundBuffers(),
+        boundUniformBuffers(),
+        boundUniformOffsets(),
+        activeTextureUnit(0),
+        boundTextures(),
+        boundFramebuffer(0),
+        stateStatistics()
     {
         if (!gladLoadGLES2Loader((GLADloadproc)glfwGetProcAddress)) {
             spdlog::critical("cannot initialize glad");
             std::exit(EXIT_FAILURE);
         }
 
+        GLint binaryFormats = 0;
+        glCheckError(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats));
+        programBinarySupported = binaryFormats > 0;
+
+        GLint formats = 0;
+        glCheckError(glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &formats));
+        compressedFormats.resize((size_t)std::max(formats, 0));
+        if (formats > 0) {
+            glCheckError(glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, compressedFormats.data()));
+        }
+
+        // the materials tables are ranges of one buffer per model
+        glCheckError(glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxUniformBlockSize));
+        glCheckError(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferAlignment));
+        uniformBufferAlignment = std::max(uniformBufferAlignment, 1);
+
+        GLint extensions = 0;
+        glCheckError(glGetIntegerv(GL_NUM_EXTENSIONS, &extensions));
+        for (GLint i = 0; i < extensions; i++) {
+            const GLubyte* extension;
+            glCheckError(extension = glGetStringi(GL_EXTENSIONS, (GLuint)i));
+            if (std::strcmp((const char*)extension, "GL_KHR_parallel_shader_compile") == 0) {
+                auto maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+                if (maxShaderCompilerThreads != nullptr) {
+                    glCheckError(maxShaderCompilerThreads(0xffffffff));
+                }
+                parallelShaderCompile = true;
+            }
+        }
+
         glCheckError(glEnable(GL_DEPTH_TEST));
+        stateInvalidate();
+        renderQueue = new RenderQueue(this);
+        threadPool = new ThreadPool();
 
         IMGUI_CHECKVERSION();
         ImGui::CreateContext();
@@ -27,11 +110,27 @@ namespace ay
         ImGui_ImplGlfw_InitForOpenGL(window.window, true);
         ImGui_ImplOpenGL3_Init("#version 300 es");
 
+        uniformBlockNew("Camera", (GLuint)UniformBlockBinding::CAMERA, sizeof(CameraBlock));
+        uniformBlockNew("Lights", (GLuint)UniformBlockBinding::LIGHTS, sizeof(LightsBlock));
+        uniformBlockBinding("Materials", (GLuint)UniformBlockBinding::MATERIALS);
         shaderFromMemory("default", BLINN_PHONG_VERTEX, BLINN_PHONG_FRAGMENT);
+        shaderTemplateFromMemory("default", BLINN_PHONG_VERTEX, BLINN_PHONG_FRAGMENT);
         shaderUse("default");
     }
 
     Context::~Context() {
+        delete renderQueue;
+        delete threadPool;
+
+        for (auto it = geometryArenas.begin(); it != geometryArenas.end(); it++) {
+            delete it->second;
+        }
+
+        for (auto it = pendingShaders.begin(); it != pendingShaders.end(); it++) {
+            glCheckError(glDeleteShader(it->second.vertex));
+            glCheckError(glDeleteShader(it->second.fragment));
+        }
+
         for (auto it = shaders.begin(); it != shaders.end(); it++) {
             glCheckError(glDeleteProgram(it->second));
         }
@@ -47,6 +146,10 @@ namespace ay
         for (auto it = framebuffers.begin(); it != framebuffers.end(); it++) {
             glCheckError(glDeleteFramebuffers(1, &it->second));
         }
+
+        for (auto it = uniformBlocks.begin(); it != uniformBlocks.end(); it++) {
+            glCheckError(glDeleteBuffers(1, &it->second));
+        }
     }
 
     const std::string getProgramLog(GLuint pid) {
@@ -65,49 +168,364 @@ namespace ay
         return std::string(log.begin(), log.end());
     }
 
+    ///
+    /// @brief FNV-1a hash
+    ///
+    static u64 hash(const std::string& str, u64 seed = 14695981039346656037ull) {
+        u64 h = seed;
+        for (unsigned char c : str) {
+            h ^= (u64)c;
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    ///
+    /// @brief Create a directory if it does not exist
+    ///
+    static bool makeDirectory(const std::string& path) {
+#ifdef _WIN32
+        return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+        return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+    }
+
+    GeometryArena* Context::getGeometryArena(const VertexLayout& layout) {
+        auto it = geometryArenas.find(layout.key());
+        if (it != geometryArenas.end()) {
+            return it->second;
+        }
+
+        GeometryArena* arena = new GeometryArena(this, layout);
+        geometryArenas[layout.key()] = arena;
+        return arena;
+    }
+
     void Context::shaderFromMemory(const std::string& name, const std::string& vertex, const std::string& fragment) {
-        GLuint id, vid, fid;
+        Shader id = shaderFromMemoryAsync(name, vertex, fragment);
+        if (id != 0) {
+            shaderFinalize(id);
+        }
+    }
+
+    Shader Context::shaderFromMemoryAsync(const std::string& name, const std::string& vertex, const std::string& fragment) {
+        auto it = shaders.find(name);
+        if (it != shaders.end()) {
+            return it->second;
+        }
+
+        const std::string key = shaderCacheKey(vertex, fragment);
+        Shader id = shaderLoadBinary(key);
+        if (id != 0) {
+            shaderReflect(id);
+            shaderBindBlocks(id);
+            programSortIds.add(id);
+            shaders.insert(std::make_pair(name, id));
+            return id;
+        }
+
+        // submit only, the status is queried when the shader is used or polled
+        PendingShader pending;
+        pending.key = key;
         glCheckError(id = glCreateProgram());
-        glCheckError(vid = glCreateShader(GL_VERTEX_SHADER));
-        glCheckError(fid = glCreateShader(GL_FRAGMENT_SHADER));
-        std::string log = "";
+        glCheckError(pending.vertex = glCreateShader(GL_VERTEX_SHADER));
+        glCheckError(pending.fragment = glCreateShader(GL_FRAGMENT_SHADER));
 
         const GLchar* vsrc = (const GLchar*)vertex.c_str();
-        glCheckError(glShaderSource(vid, 1, &vsrc, nullptr));
+        glCheckError(glShaderSource(pending.vertex, 1, &vsrc, nullptr));
 
         const GLchar* fsrc = (const GLchar*)fragment.c_str();
-        glCheckError(glShaderSource(fid, 1, &fsrc, nullptr));
+        glCheckError(glShaderSource(pending.fragment, 1, &fsrc, nullptr));
+
+        glCheckError(glCompileShader(pending.vertex));
+        glCheckError(glCompileShader(pending.fragment));
+        glCheckError(glAttachShader(id, pending.vertex));
+        glCheckError(glAttachShader(id, pending.fragment));
+        if (programBinarySupported) {
+            glCheckError(glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        }
+        glCheckError(glLinkProgram(id));
+
+        pendingShaders.insert(std::make_pair(id, pending));
+        programSortIds.add(id);
+        shaders.insert(std::make_pair(name, id));
+        return id;
+    }
+
+    bool Context::shaderReady(const std::string& name) {
+        auto it = shaders.find(name);
+        if (it == shaders.end()) {
+            return false;
+        }
+
+        if (pendingShaders.find(it->second) == pendingShaders.end()) {
+            return true;
+        }
+
+        if (parallelShaderCompile) {
+            GLint completed;
+            glCheckError(glGetProgramiv(it->second, GL_COMPLETION_STATUS_KHR, &completed));
+            if (completed != GL_TRUE) {
+                return false;
+            }
+        }
+        return shaderFinalize(it->second);
+    }
+
+    bool Context::shaderFinalize(Shader id) {
+        auto it = pendingShaders.find(id);
+        if (it == pendingShaders.end()) {
+            return true;
+        }
+
+        const PendingShader pending = it->second;
+        pendingShaders.erase(it);
+
+        GLint status;
+        glCheckError(glGetProgramiv(id, GL_LINK_STATUS, &status));
+        if (status != GL_TRUE) {
+            glCheckError(glGetShaderiv(pending.vertex, GL_COMPILE_STATUS, &status));
+            if (status != GL_TRUE) {
+                spdlog::error("Vertex shader: {}", getShaderLog(pending.vertex));
+            }
+
+            glCheckError(glGetShaderiv(pending.fragment, GL_COMPILE_STATUS, &status));
+            if (status != GL_TRUE) {
+                spdlog::error("Fragment shader: {}", getShaderLog(pending.fragment));
+            }
+
+            spdlog::error("Program: {}", getProgramLog(id));
+            glCheckError(glDeleteShader(pending.vertex));
+            glCheckError(glDeleteShader(pending.fragment));
+            glCheckError(glDeleteProgram(id));
+            programSortIds.remove(id);
+
+            // forget the program, failed variants are kept as 0 so they are not rebuilt every draw
+            for (auto shader = shaders.begin(); shader != shaders.end();) {
+                shader = shader->second == id ? shaders.erase(shader) : std::next(shader);
+            }
+            for (auto& shaderTemplate : shaderTemplates) {
+                for (auto& variant : shaderTemplate.second.variants) {
+                    variant.second = variant.second == id ? 0 : variant.second;
+                }
+            }
+            if (currentShader == id) {
+                currentShader = 0;
+                currentUniforms = nullptr;
+            }
+            return false;
+        }
+
+        glCheckError(glDetachShader(id, pending.vertex));
+        glCheckError(glDetachShader(id, pending.fragment));
+        glCheckError(glDeleteShader(pending.vertex));
+        glCheckError(glDeleteShader(pending.fragment));
+
+        shaderStoreBinary(pending.key, id);
+        shaderReflect(id);
+        shaderBindBlocks(id);
+        return true;
+    }
+
+    Shader Context::shaderVariant(const std::string& name, const ShaderFeatures& features) {
+        auto it = shaderTemplates.find(name);
+        if (it == shaderTemplates.end()) {
+            return 0;
+        }
 
-        glCheckError(glCompileShader(vid));
-        log = getShaderLog(vid);
-        if (log.size() > 0) {
-            spdlog::error("Vertex shader: {}", log);
+        const u32 key = features.key();
+        ShaderTemplate& shaderTemplate = it->second;
+        auto variant = shaderTemplate.variants.find(key);
+        if (variant != shaderTemplate.variants.end()) {
+            return variant->second;
+        }
+
+        // inject the defines right after the #version line
+        const std::string defines = features.defines();
+        auto inject = [&defines](const std::string& source) {
+            size_t line = source.find('\n');
+            if (source.compare(0, 8, "#version") != 0 || line == std::string::npos) {
+                return defines + source;
+            }
+            return source.substr(0, line + 1) + defines + source.substr(line + 1);
+        };
+
+        std::stringstream variantName;
+        variantName << name << "#" << std::hex << key;
+        Shader id = shaderFromMemoryAsync(variantName.str(), inject(shaderTemplate.vertex), inject(shaderTemplate.fragment));
+        shaderTemplate.variants.insert(std::make_pair(key, id));
+        return id;
+    }
+
+    const std::string Context::shaderCacheKey(const std::string& vertex, const std::string& fragment) const {
+        std::stringstream renderer;
+        renderer << glGetString(GL_RENDERER);
+
+        u64 h = hash(vertex);
+        h = hash(fragment, h ^ 0xff);
+        h = hash(getVendor(), h ^ 0xff);
+        h = hash(renderer.str(), h ^ 0xff);
+        h = hash(getVersion(), h ^ 0xff);
+
+        std::stringstream key;
+        key << std::hex << std::setw(16) << std::setfill('0') << h;
+        return key.str();
+    }
+
+    Shader Context::shaderLoadBinary(const std::string& key) const {
+        if (!programBinarySupported || shaderCacheDirectory.empty()) {
+            return 0;
+        }
+
+        const std::string filename = shaderCacheDirectory + "/" + key + ".bin";
+        std::ifstream file(filename, std::ifstream::binary);
+        if (!file.is_open()) {
+            return 0;
+        }
+
+        char magic[4];
+        GLenum format;
+        file.read(magic, sizeof(magic));
+        file.read(reinterpret_cast<char*>(&format), sizeof(format));
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file.eof() || std::memcmp(magic, PROGRAM_BINARY_MAGIC, sizeof(magic)) != 0 || binary.empty()) {
+            spdlog::warn("invalid shader cache entry: {}", filename);
+            file.close();
+            std::remove(filename.c_str());
+            return 0;
+        }
+
+        GLuint id;
+        GLint status;
+        glCheckError(id = glCreateProgram());
+        glCheckError(glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        glCheckError(glProgramBinary(id, format, binary.data(), (GLsizei)binary.size()));
+        glCheckError(glGetProgramiv(id, GL_LINK_STATUS, &status));
+        if (status != GL_TRUE) {
+            // driver update or rejected binary: rebuild it from source
+            spdlog::info("shader cache entry rejected by the driver: {}", filename);
+            glCheckError(glDeleteProgram(id));
+            file.close();
+            std::remove(filename.c_str());
+            return 0;
+        }
+
+        return id;
+    }
+
+    void Context::shaderStoreBinary(const std::string& key, Shader id) const {
+        if (!programBinarySupported || shaderCacheDirectory.empty()) {
             return;
         }
 
-        glCheckError(glCompileShader(fid));
-        log = getShaderLog(fid);
-        if (log.size() > 0) {
-            spdlog::error("Fragment shader: {}", log);
+        GLint length = 0;
+        glCheckError(glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length));
+        if (length <= 0) {
             return;
         }
 
-        glCheckError(glAttachShader(id, vid));
-        glCheckError(glAttachShader(id, fid));
-        glCheckError(glLinkProgram(id));
+        GLenum format;
+        std::vector<char> binary((size_t)length);
+        glCheckError(glGetProgramBinary(id, length, nullptr, &format, binary.data()));
 
-        log = getProgramLog(id);
-        if (log.size() > 0) {
-            spdlog::error("Program: {}", log);
+        if (!makeDirectory(shaderCacheDirectory)) {
+            spdlog::warn("cannot create shader cache directory: {}", shaderCacheDirectory);
             return;
         }
 
-        glCheckError(glDetachShader(id, vid));
-        glCheckError(glDetachShader(id, fid));
-        glCheckError(glDeleteShader(vid));
-        glCheckError(glDeleteShader(fid));
+        // write to a temporary file first, concurrent processes may share the cache
+        const std::string filename = shaderCacheDirectory + "/" + key + ".bin";
+        std::stringstream tmpname;
+        tmpname << filename << "." << std::hex << std::random_device()() << ".tmp";
+        std::ofstream file(tmpname.str(), std::ofstream::binary);
+        if (!file.is_open()) {
+            spdlog::warn("cannot write shader cache entry: {}", filename);
+            return;
+        }
 
-        shaders.insert(std::make_pair(name, id));
+        file.write(PROGRAM_BINARY_MAGIC, 4);
+        file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        file.write(binary.data(), (std::streamsize)binary.size());
+        file.close();
+
+#ifdef _WIN32
+        // rename does not replace an existing file on Windows
+        std::remove(filename.c_str());
+#endif
+        if (!file || std::rename(tmpname.str().c_str(), filename.c_str()) != 0) {
+            std::remove(tmpname.str().c_str());
+        }
+    }
+
+    void Context::shaderReflect(Shader id) {
+        GLint count, maxLength;
+        glCheckError(glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count));
+        glCheckError(glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength));
+
+        auto& table = uniforms[id];
+        table.clear();
+        std::vector<GLchar> buffer((size_t)maxLength + 1);
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length;
+            GLint size;
+            GLenum type;
+            glCheckError(glGetActiveUniform(id, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data()));
+            std::string name(buffer.data(), (size_t)length);
+
+            // uniforms inside a block have no location
+            Uniform loc;
+            glCheckError(loc = glGetUniformLocation(id, name.c_str()));
+            if (loc < 0) continue;
+            table[name] = loc;
+
+            // arrays are reported as "name[0]", register every element
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+                std::string base = name.substr(0, name.size() - 3);
+                table[base] = loc;
+                for (GLint j = 1; j < size; j++) {
+                    std::stringstream element;
+                    element << base << "[" << j << "]";
+                    glCheckError(loc = glGetUniformLocation(id, element.str().c_str()));
+                    table[element.str()] = loc;
+                }
+            }
+        }
+    }
+
+    void Context::shaderBindBlocks(Shader id) const {
+        for (auto it = uniformBlockBindings.begin(); it != uniformBlockBindings.end(); it++) {
+            GLuint index;
+            glCheckError(index = glGetUniformBlockIndex(id, it->first.c_str()));
+            if (index != GL_INVALID_INDEX) {
+                glCheckError(glUniformBlockBinding(id, index, it->second));
+            }
+        }
+    }
+
+    void Context::uniformBlockBinding(const std::string& name, GLuint binding) {
+        uniformBlockBindings[name] = binding;
+        for (auto it = shaders.begin(); it != shaders.end(); it++) {
+            if (pendingShaders.find(it->second) == pendingShaders.end()) {
+                shaderBindBlocks(it->second);
+            }
+        }
+    }
+
+    void Context::uniformBlockNew(const std::string& name, GLuint binding, GLsizeiptr size) {
+        if (uniformBlocks.find(name) != uniformBlocks.end()) {
+            spdlog::error("uniform block {} already exists", name);
+            return;
+        }
+
+        std::vector<u8> zeros((size_t)size, 0);
+        Buffer id = bufferNew();
+        bufferUse<BufferUsage::UNIFORM>(id);
+        bufferData<BufferUsage::UNIFORM, BufferTarget::DYNAMIC_DRAW>(size, zeros.data());
+        bufferUse<BufferUsage::UNIFORM>(0);
+        bufferBindBase<BufferUsage::UNIFORM>(binding, id);
+        uniformBlocks.insert(std::make_pair(name, id));
+        uniformBlockBinding(name, binding);
     }
 
     void Context::shaderFromFile(const std::string& name, const std::string& vertex, const std::string& fragment) {
@@ -127,9 +545,54 @@ namespace ay
         shaderFromMemory(name, vsrc, fsrc);
     }
 
+    Texture2D Context::texture2DCreateCompressed(const Texture2DParameters& params, const Ktx2Image& image, const u8* data) {
+        Texture2D id;
+        glCheckError(glGenTextures(1, &id));
+        texture2DBind(0, id);
+        for (size_t i = 0; i < image.levels.size(); i++) {
+            glCheckError(glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, image.format,
+                std::max(image.width >> i, 1), std::max(image.height >> i, 1), 0,
+                (GLsizei)image.levels[i].size, data + image.levels[i].offset));
+        }
+        // compressed levels cannot be generated, sample the ones stored
+        const bool mipmapped = image.levels.size() > 1;
+        const GLint min = mipmapped || params.min == GL_NEAREST || params.min == GL_LINEAR ? params.min :
+            (params.min == GL_NEAREST_MIPMAP_NEAREST || params.min == GL_NEAREST_MIPMAP_LINEAR ? GL_NEAREST : GL_LINEAR);
+        glCheckError(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1));
+        glCheckError(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min));
+        glCheckError(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, params.mag));
+        glCheckError(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, params.wrapT));
+        glCheckError(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, params.wrapS));
+        texture2DBind(0, 0);
+        return id;
+    }
+
     void Context::texture2DNew(const std::string& name, const std::string& filename, Texture2DParameters& params) {
-        stbi_set_flip_vertically_on_load(true);
+        if (filename.size() > 5 && filename.compare(filename.size() - 5, 5, ".ktx2") == 0) {
+            MappedFile file;
+            Ktx2Image image;
+            if (!file.open(filename) || !Ktx2Texture::read(file.getData(), file.getSize(), image)) {
+                spdlog::error("cannot load data from {}", filename);
+                return;
+            }
+            if (!texture2DCompressedSupported(image.format)) {
+                spdlog::error("{}: compressed format {:#x} is not supported", filename, image.format);
+                return;
+            }
+            if (!image.bottomUp) {
+                // the blocks cannot be flipped like the images below
+                spdlog::error("{}: the top row is stored first, cook it with aycook --bottom-up", filename);
+                return;
+            }
 
+            params.width = image.width;
+            params.height = image.height;
+            params.internalFormat = image.format;
+            textures.insert(std::make_pair(name, texture2DCreateCompressed(params, image, file.getData())));
+            return;
+        }
+
+        // flipped here rather than with the global stb flag, the models decode their images on the workers
         int channels;
         unsigned char* data = stbi_load(filename.c_str(), &params.width, &params.height, &channels, 0);
         if (!data) {
@@ -137,12 +600,22 @@ namespace ay
             return;
         }
 
+        const size_t rowSize = (size_t)params.width * (size_t)channels;
+        std::vector<unsigned char> row(rowSize);
+        for (int y = 0; y < params.height / 2; y++) {
+            unsigned char* top = data + (size_t)y * rowSize;
+            unsigned char* bottom = data + (size_t)(params.height - 1 - y) * rowSize;
+            std::memcpy(row.data(), top, rowSize);
+            std::memcpy(top, bottom, rowSize);
+            std::memcpy(bottom, row.data(), rowSize);
+        }
+
         params.internalFormat = channels == 4 ? GL_RGBA : GL_RGB;
         params.dataFormat = channels == 4 ? GL_RGBA : GL_RGB;
 
         GLuint id;
         glCheckError(glGenTextures(1, &id));
-        glCheckError(glBindTexture(GL_TEXTURE_2D, id));
+        texture2DBind(0, id);
         glCheckError(glTexImage2D(GL_TEXTURE_2D, params.lod,
             params.internalFormat, params.width, params.height, 0,
             params.dataFormat, params.dataType, data));
@@ -153,7 +626,7 @@ namespace ay
         if (params.mipmap) {
             glCheckError(glGenerateMipmap(GL_TEXTURE_2D));
         }
-        glCheckError(glBindTexture(GL_TEXTURE_2D, 0));
+        texture2DBind(0, 0);
         textures.insert(std::make_pair(name, id));
         stbi_image_free(data);
     }
@@ -161,7 +634,7 @@ namespace ay
     void Context::framebufferNew(const std::string& name, const std::array<GLuint, 32>& colorAttachments, GLuint depthStencilAttachment) {
         GLuint id;
         glCheckError(glGenFramebuffers(1, &id));
-        glCheckError(glBindFramebuffer(GL_FRAMEBUFFER, id));
+        framebufferBind(id);
         for (int i = 0; i < 32; i++) {
             glCheckError(glFramebufferTexture2D(GL_FRAMEBUFFER, (GLenum)(GL_COLOR_ATTACHMENT0 + i), GL_TEXTURE_2D, colorAttachments[i], 0));
         }
@@ -175,7 +648,7 @@ namespace ay
             return;
         }
 
-        glCheckError(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+        framebufferBind(0);
         framebuffers.insert(std::make_pair(name, id));
     }
 }
\ No newline at end of file
@@ -10,10 +10,18 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <map>
+#include <unordered_map>
 #include <array>
+#include <vector>
+#include <algorithm>
 #include <sstream>
 #include <glm/glm.hpp>
 
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+#endif
+
 namespace ay
 {
 #ifdef NDEBUG
@@ -53,11 +61,15 @@ namespace ay
     using VAO = GLuint;
     using Buffer = GLuint;
     using Attribute = GLuint;
+    using Uniform = GLint;
+    using Query = GLuint;
 
     enum class DrawMethod {
         ARRAY,
         ELEMENT,
-        INSTANCE
+        INSTANCE,
+        ELEMENT_BASE_VERTEX,
+        INSTANCE_BASE_VERTEX
     };
 
     class DrawParameters {
@@ -67,7 +79,8 @@ namespace ay
             first(first),
             count(count),
             offset(nullptr),
-            instanceCount(0)
+            instanceCount(0),
+            baseVertex(0)
         {
         }
 
@@ -77,11 +90,17 @@ namespace ay
         }
 
         DrawParameters(GLenum mode, GLenum elementType, GLsizei count, GLvoid* offset, GLsizei instanceCount)
+            : DrawParameters(mode, elementType, count, offset, instanceCount, 0)
+        {
+        }
+
+        DrawParameters(GLenum mode, GLenum elementType, GLsizei count, GLvoid* offset, GLsizei instanceCount, GLint baseVertex)
             : mode(mode),
             elementType(elementType),
             count(count),
             offset(offset),
-            instanceCount(instanceCount)
+            instanceCount(instanceCount),
+            baseVertex(baseVertex)
         {
         }
 
@@ -97,11 +116,15 @@ namespace ay
         GLsizei count;
         GLvoid* offset;
         GLsizei instanceCount;
+        GLint baseVertex;
     };
 
     enum class BufferUsage {
         ARRAY = GL_ARRAY_BUFFER,
-        ELEMENT = GL_ELEMENT_ARRAY_BUFFER
+        ELEMENT = GL_ELEMENT_ARRAY_BUFFER,
+        UNIFORM = GL_UNIFORM_BUFFER,
+        COPY_READ = GL_COPY_READ_BUFFER,
+        COPY_WRITE = GL_COPY_WRITE_BUFFER
     };
 
     enum class BufferTarget {
@@ -113,6 +136,123 @@ namespace ay
         DYNAMIC_READ = GL_DYNAMIC_READ,
     };
 
+    enum class UniformBlockBinding : GLuint {
+        CAMERA = 0,
+        LIGHTS = 1,
+        MATERIALS = 2
+    };
+
+    ///
+    /// @brief Small dense ids of GL objects for the sort keys of the draws (GL names are sparse)
+    ///
+    class SortIds {
+    public:
+        ///
+        /// @brief Constructor
+        ///
+        SortIds() : ids(), released(), next(1) {}
+
+        ///
+        /// @brief Give an object an id, the ids of removed objects are reused first
+        /// @param name Object
+        ///
+        inline void add(unsigned long long name) {
+            if (ids.find(name) != ids.end()) {
+                return;
+            }
+            u32 id = next;
+            if (released.empty()) {
+                next++;
+            }
+            else {
+                id = released.back();
+                released.pop_back();
+            }
+            ids.insert(std::make_pair(name, id));
+        }
+
+        ///
+        /// @brief Release the id of an object
+        /// @param name Object
+        ///
+        inline void remove(unsigned long long name) {
+            auto it = ids.find(name);
+            if (it != ids.end()) {
+                released.push_back(it->second);
+                ids.erase(it);
+            }
+        }
+
+        ///
+        /// @brief Get the id of an object
+        /// @param name Object
+        /// @return Id (0 if unknown)
+        ///
+        inline u32 get(unsigned long long name) const {
+            auto it = ids.find(name);
+            return it != ids.end() ? it->second : 0;
+        }
+
+    private:
+        std::unordered_map<unsigned long long, u32> ids;
+        std::vector<u32> released;
+        u32 next;
+    };
+
+    struct StateStatistics {
+        u64 issued = 0;
+        u64 skipped = 0;
+    };
+
+    struct ShaderFeatures {
+        u8 pointLights = 0;
+        u8 directionalLights = 0;
+        bool vertexColor = false;
+        bool texcoord = false;
+        bool baseColorTexture = false;
+        bool alphaMask = false;
+        bool doubleSided = false;
+        bool unlit = false;
+        bool instanced = false;
+        bool octNormals = false;
+
+        ///
+        /// @brief Get the variant key of the features
+        /// @return Key
+        ///
+        inline u32 key() const {
+            return (u32)pointLights |
+                ((u32)directionalLights << 5) |
+                ((u32)vertexColor << 9) |
+                ((u32)texcoord << 10) |
+                ((u32)baseColorTexture << 11) |
+                ((u32)alphaMask << 12) |
+                ((u32)doubleSided << 13) |
+                ((u32)unlit << 14) |
+                ((u32)instanced << 15) |
+                ((u32)octNormals << 16);
+        }
+
+        ///
+        /// @brief Get the preprocessor defines of the features
+        /// @return Defines (one per line)
+        ///
+        inline std::string defines() const {
+            std::stringstream ss;
+            ss << "#define POINT_LIGHTS_COUNT " << (u32)pointLights << "\n";
+            ss << "#define DIRECTIONAL_LIGHTS_COUNT " << (u32)directionalLights << "\n";
+            if (vertexColor) ss << "#define HAS_VERTEX_COLOR\n";
+            if (texcoord) ss << "#define HAS_TEXCOORD\n";
+            if (baseColorTexture) ss << "#define HAS_BASE_COLOR_TEXTURE\n";
+            if (alphaMask) ss << "#define ALPHA_MASK\n";
+            if (doubleSided) ss << "#define DOUBLE_SIDED\n";
+            if (unlit) ss << "#define UNLIT\n";
+            if (instanced) ss << "#define INSTANCED\n";
+            if (octNormals) ss << "#define OCT_NORMALS\n";
+            return ss.str();
+        }
+    };
+
     struct Texture2DParameters {
         GLint mag = GL_LINEAR;
         GLint min = GL_LINEAR;
@@ -128,6 +268,11 @@ namespace ay
     };
 
     class Window;
+    class RenderQueue;
+    class GeometryArena;
+    class VertexLayout;
+    class ThreadPool;
+    struct Ktx2Image;
 
     class Context {
     public:
@@ -149,6 +294,29 @@ namespace ay
             return window;
         }
 
+        ///
+        /// @brief Get the render queue
+        /// @return Render queue
+        ///
+        inline RenderQueue* getRenderQueue() const {
+            return renderQueue;
+        }
+
+        ///
+        /// @brief Get the worker threads
+        /// @return Thread pool
+        ///
+        inline ThreadPool* getThreadPool() const {
+            return threadPool;
+        }
+
+        ///
+        /// @brief Get the geometry arena of a vertex layout (created on first use)
+        /// @param layout Vertex layout
+        /// @return Geometry arena shared by every mesh using the layout
+        ///
+        GeometryArena* getGeometryArena(const VertexLayout& layout);
+
         ///
         /// @brief Get OpenGL Version
         /// @return Version
@@ -207,6 +375,7 @@ namespace ay
         inline void uiEnd() const {
             ImGui::Render();
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            stateInvalidate();
         }
 
         ///
@@ -255,6 +424,22 @@ namespace ay
         /// 
         void shaderFromMemory(const std::string& name, const std::string& vertex, const std::string& fragment);
 
+        ///
+        /// @brief Submit a shader from memory without waiting for its compilation
+        /// @param name shader name
+        /// @param vertex vertex shader
+        /// @param fragment fragment shader
+        /// @return Shader id (0 on failure)
+        ///
+        Shader shaderFromMemoryAsync(const std::string& name, const std::string& vertex, const std::string& fragment);
+
+        ///
+        /// @brief Poll a shader submitted with shaderFromMemoryAsync
+        /// @param name shader name
+        /// @return True if the shader is compiled and linked
+        ///
+        bool shaderReady(const std::string& name);
+
         ///
         /// @brief Create shader from file
         /// @param name shader name
@@ -263,6 +448,63 @@ namespace ay
         /// 
         void shaderFromFile(const std::string& name, const std::string& vertex, const std::string& fragment);
 
+        ///
+        /// @brief Register a shader whose variants are compiled on demand
+        /// @param name shader name
+        /// @param vertex vertex shader
+        /// @param fragment fragment shader
+        ///
+        inline void shaderTemplateFromMemory(const std::string& name, const std::string& vertex, const std::string& fragment) {
+            ShaderTemplate& shaderTemplate = shaderTemplates[name];
+            shaderTemplate.vertex = vertex;
+            shaderTemplate.fragment = fragment;
+            shaderTemplate.variants.clear();
+        }
+
+        ///
+        /// @brief Get a shader variant, compile it on first use
+        /// @param name shader template name
+        /// @param features Variant features
+        /// @return Shader id (0 if the variant cannot be built)
+        ///
+        Shader shaderVariant(const std::string& name, const ShaderFeatures& features);
+
+        ///
+        /// @brief Use a shader variant
+        /// @param name shader template name
+        /// @param features Variant features
+        ///
+        inline void shaderVariantUse(const std::string& name, const ShaderFeatures& features) {
+            Shader id = shaderVariant(name, features);
+            if (id != 0) {
+                shaderUse(id);
+            }
+        }
+
+        ///
+        /// @brief Set the features shared by every draw of the scene (lights)
+        /// @param features Scene features
+        ///
+        inline void shaderSetSceneFeatures(const ShaderFeatures& features) {
+            sceneFeatures = features;
+        }
+
+        ///
+        /// @brief Get the features shared by every draw of the scene (lights)
+        /// @return Scene features
+        ///
+        inline const ShaderFeatures& shaderGetSceneFeatures() const {
+            return sceneFeatures;
+        }
+
+        ///
+        /// @brief Set the directory of the program binary cache
+        /// @param directory Directory (empty to disable the cache)
+        ///
+        inline void shaderSetCacheDirectory(const std::string& directory) {
+            shaderCacheDirectory = directory;
+        }
+
         /// 
         /// @brief Destroy the shader
         /// @param name Shader name
@@ -270,7 +512,24 @@ namespace ay
         inline void shaderDispose(const std::string& name) {
             auto it = shaders.find(name);
             if (it != shaders.end()) {
+                if (currentShader == it->second) {
+                    currentUniforms = nullptr;
+                }
+                uniforms.erase(it->second);
+                auto pending = pendingShaders.find(it->second);
+                if (pending != pendingShaders.end()) {
+                    glCheckError(glDeleteShader(pending->second.vertex));
+                    glCheckError(glDeleteShader(pending->second.fragment));
+                    pendingShaders.erase(pending);
+                }
+                for (auto& shaderTemplate : shaderTemplates) {
+                    auto& variants = shaderTemplate.second.variants;
+                    for (auto variant = variants.begin(); variant != variants.end();) {
+                        variant = variant->second == it->second ? variants.erase(variant) : std::next(variant);
+                    }
+                }
                 glCheckError(glDeleteProgram(it->second));
+                programSortIds.remove(it->second);
                 shaders.erase(it);
             }
         }
@@ -281,10 +540,54 @@ namespace ay
         ///
         inline void shaderUse(const std::string& name) {
             auto shader = shaders.find(name);
-            if (shader != shaders.end()) {
-                currentShader = shader->second;
+            shaderUse(shader != shaders.end() ? shader->second : currentShader);
+        }
+
+        ///
+        /// @brief Use shader
+        /// @param id Shader id
+        ///
+        inline void shaderUse(Shader id) {
+            if (!pendingShaders.empty() && !shaderFinalize(id)) {
+                id = 0;
+            }
+            if (currentShader != id) {
+                currentShader = id;
+                auto table = uniforms.find(currentShader);
+                currentUniforms = table != uniforms.end() ? &table->second : nullptr;
             }
-            glCheckError(glUseProgram(currentShader));
+
+            if (boundProgram != id) {
+                glCheckError(glUseProgram(id));
+                boundProgram = id;
+                stateStatistics.issued++;
+            }
+            else {
+                stateStatistics.skipped++;
+            }
+        }
+
+        ///
+        /// @brief Get the shader in use
+        /// @return Shader id (0 if none)
+        ///
+        inline Shader shaderGetCurrent() const {
+            return currentShader;
+        }
+
+        ///
+        /// @brief Get the location of an uniform of the current shader
+        /// @param name uniform name
+        /// @return Uniform location (-1 if not active)
+        ///
+        inline Uniform shaderUniformLocation(const std::string& name) const {
+            if (currentUniforms != nullptr) {
+                auto it = currentUniforms->find(name);
+                if (it != currentUniforms->end()) {
+                    return it->second;
+                }
+            }
+            return -1;
         }
 
         ///
@@ -293,8 +596,15 @@ namespace ay
         /// @param value uniform value
         ///
         inline void shaderUniform(const std::string& name, float value) const {
-            GLint loc;
-            glCheckError(loc = glGetUniformLocation(currentShader, name.c_str()));
+            shaderUniform(shaderUniformLocation(name), value);
+        }
+
+        ///
+        /// @brief Shader uniform1f
+        /// @param loc uniform location
+        /// @param value uniform value
+        ///
+        inline void shaderUniform(Uniform loc, float value) const {
             glCheckError(glUniform1f(loc, value));
         }
 
@@ -304,8 +614,15 @@ namespace ay
         /// @param value uniform value
         ///
         inline void shaderUniform(const std::string& name, int value) const {
-            GLint loc;
-            glCheckError(loc = glGetUniformLocation(currentShader, name.c_str()));
+            shaderUniform(shaderUniformLocation(name), value);
+        }
+
+        ///
+        /// @brief Shader uniform1i
+        /// @param loc uniform location
+        /// @param value uniform value
+        ///
+        inline void shaderUniform(Uniform loc, int value) const {
             glCheckError(glUniform1i(loc, value));
         }
 
@@ -315,8 +632,15 @@ namespace ay
         /// @param value uniform value
         ///
         inline void shaderUniform(const std::string& name, const glm::vec3& value) const {
-            GLint loc;
-            glCheckError(loc = glGetUniformLocation(currentShader, name.c_str()));
+            shaderUniform(shaderUniformLocation(name), value);
+        }
+
+        ///
+        /// @brief Shader uniform3fv
+        /// @param loc uniform location
+        /// @param value uniform value
+        ///
+        inline void shaderUniform(Uniform loc, const glm::vec3& value) const {
             glCheckError(glUniform3fv(loc, 1, &value[0]));
         }
 
@@ -326,22 +650,85 @@ namespace ay
         /// @param value uniform value
         ///
         inline void shaderUniform(const std::string& name, const glm::vec4& value) const {
-            GLint loc;
-            glCheckError(loc = glGetUniformLocation(currentShader, name.c_str()));
+            shaderUniform(shaderUniformLocation(name), value);
+        }
+
+        ///
+        /// @brief Shader uniform4fv
+        /// @param loc uniform location
+        /// @param value uniform value
+        ///
+        inline void shaderUniform(Uniform loc, const glm::vec4& value) const {
             glCheckError(glUniform4fv(loc, 1, &value[0]));
         }
 
+        ///
+        /// @brief Shader uniformMatrix3fv
+        /// @param name uniform name
+        /// @param value uniform value
+        ///
+        inline void shaderUniform(const std::string& name, const glm::mat3& value) const {
+            shaderUniform(shaderUniformLocation(name), value);
+        }
+
+        ///
+        /// @brief Shader uniformMatrix3fv
+        /// @param loc uniform location
+        /// @param value uniform value
+        ///
+        inline void shaderUniform(Uniform loc, const glm::mat3& value) const {
+            glCheckError(glUniformMatrix3fv(loc, 1, GL_FALSE, &value[0][0]));
+        }
+
         ///
         /// @brief Shader uniformMatrix4fv
         /// @param name uniform name
         /// @param value uniform value
         ///
         inline void shaderUniform(const std::string& name, const glm::mat4& value) const {
-            GLint loc;
-            glCheckError(loc = glGetUniformLocation(currentShader, name.c_str()));
+            shaderUniform(shaderUniformLocation(name), value);
+        }
+
+        ///
+        /// @brief Shader uniformMatrix4fv
+        /// @param loc uniform location
+        /// @param value uniform value
+        ///
+        inline void shaderUniform(Uniform loc, const glm::mat4& value) const {
             glCheckError(glUniformMatrix4fv(loc, 1, GL_FALSE, &value[0][0]));
         }
 
+        ///
+        /// @brief Bind the uniform block of every shader to a binding point
+        /// @param name Uniform block name
+        /// @param binding Binding point
+        ///
+        void uniformBlockBinding(const std::string& name, GLuint binding);
+
+        ///
+        /// @brief Create a new uniform block shared by every shader
+        /// @param name Uniform block name
+        /// @param binding Binding point
+        /// @param size Size of the block (std140)
+        ///
+        void uniformBlockNew(const std::string& name, GLuint binding, GLsizeiptr size);
+
+        ///
+        /// @brief Update the content of a shared uniform block
+        /// @param name Uniform block name
+        /// @param offset Offset
+        /// @param size Size
+        /// @param data Data
+        ///
+        inline void uniformBlockUpdate(const std::string& name, GLintptr offset, GLsizeiptr size, const GLvoid* data) const {
+            auto it = uniformBlocks.find(name);
+            if (it != uniformBlocks.end()) {
+                bufferUse<BufferUsage::UNIFORM>(it->second);
+                bufferSubData<BufferUsage::UNIFORM>(offset, size, data);
+                bufferUse<BufferUsage::UNIFORM>(0);
+            }
+        }
+
         ///
         /// @brief Create a new vao
         /// @return VAO id
@@ -349,6 +736,7 @@ namespace ay
         inline VAO vaoNew() const {
             VAO id;
             glCheckError(glGenVertexArrays(1, &id));
+            vaoSortIds.add(id);
             return id;
         }
 
@@ -358,6 +746,11 @@ namespace ay
         ///
         inline void vaoDispose(VAO id) const {
             glCheckError(glDeleteVertexArrays(1, &id));
+            vaoSortIds.remove(id);
+            if (boundVao == id) {
+                boundVao = 0;
+                boundBuffers[bufferSlot<BufferUsage::ELEMENT>()] = INVALID_BINDING;
+            }
         }
 
         ///
@@ -365,7 +758,16 @@ namespace ay
         /// @param id VAO id
         ///
         inline void vaoUse(VAO id) const {
-            glCheckError(glBindVertexArray(id));
+            if (boundVao != id) {
+                glCheckError(glBindVertexArray(id));
+                boundVao = id;
+                // the element buffer binding is part of the vao
+                boundBuffers[bufferSlot<BufferUsage::ELEMENT>()] = INVALID_BINDING;
+                stateStatistics.issued++;
+            }
+            else {
+                stateStatistics.skipped++;
+            }
         }
 
         ///
@@ -387,10 +789,98 @@ namespace ay
                 glCheckError(glDrawElementsInstanced(params.mode, params.count, params.elementType, params.offset, params.instanceCount));
                 break;
 
+            case DrawMethod::ELEMENT_BASE_VERTEX:
+                glCheckError(glDrawElementsBaseVertex(params.mode, params.count, params.elementType, params.offset, params.baseVertex));
+                break;
+
+            case DrawMethod::INSTANCE_BASE_VERTEX:
+                glCheckError(glDrawElementsInstancedBaseVertex(params.mode, params.count, params.elementType, params.offset, params.instanceCount, params.baseVertex));
+                break;
+
             default: break;
             }
         }
 
+        ///
+        /// @brief Create a new occlusion query
+        /// @return Query id
+        ///
+        inline Query queryNew() const {
+            Query id;
+            glCheckError(glGenQueries(1, &id));
+            return id;
+        }
+
+        ///
+        /// @brief Destroy the query
+        /// @param id Query id
+        ///
+        inline void queryDispose(Query id) const {
+            glCheckError(glDeleteQueries(1, &id));
+        }
+
+        ///
+        /// @brief Start counting the samples passing the depth test (conservative, any sample)
+        /// @param id Query id
+        ///
+        inline void queryBegin(Query id) const {
+            glCheckError(glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, id));
+        }
+
+        ///
+        /// @brief Stop the active query
+        ///
+        inline void queryEnd() const {
+            glCheckError(glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE));
+        }
+
+        ///
+        /// @brief Check if the result of a query is available (never waits)
+        /// @param id Query id
+        /// @return True if available
+        ///
+        inline bool queryAvailable(Query id) const {
+            GLuint available = GL_FALSE;
+            glCheckError(glGetQueryObjectuiv(id, GL_QUERY_RESULT_AVAILABLE, &available));
+            return available != GL_FALSE;
+        }
+
+        ///
+        /// @brief Get the result of a query (waits if not available)
+        /// @param id Query id
+        /// @return True if any sample passed
+        ///
+        inline bool queryResult(Query id) const {
+            GLuint result = GL_FALSE;
+            glCheckError(glGetQueryObjectuiv(id, GL_QUERY_RESULT, &result));
+            return result != GL_FALSE;
+        }
+
+        ///
+        /// @brief Enable or disable the color and depth writes
+        /// @param color Write color
+        /// @param depth Write depth
+        ///
+        inline void writeMask(bool color, bool depth) const {
+            const GLboolean c = color ? GL_TRUE : GL_FALSE;
+            glCheckError(glColorMask(c, c, c, c));
+            glCheckError(glDepthMask(depth ? GL_TRUE : GL_FALSE));
+        }
+
+        ///
+        /// @brief Enable or disable alpha blending (source over destination)
+        /// @param enabled Enable
+        ///
+        inline void blend(bool enabled) const {
+            if (enabled) {
+                glCheckError(glEnable(GL_BLEND));
+                glCheckError(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+            }
+            else {
+                glCheckError(glDisable(GL_BLEND));
+            }
+        }
+
         ///
         /// @brief Create a new buffer
         /// @return Buffer id
@@ -407,6 +897,60 @@ namespace ay
         ///
         inline void bufferDispose(Buffer id) const {
             glCheckError(glDeleteBuffers(1, &id));
+            for (auto& buffer : boundBuffers) {
+                buffer = buffer == id ? 0 : buffer;
+            }
+            for (auto& buffer : boundUniformBuffers) {
+                buffer = buffer == id ? 0 : buffer;
+            }
+            auto ranges = uniformRanges.find(id);
+            if (ranges != uniformRanges.end()) {
+                for (auto offset : ranges->second) {
+                    uniformRangeSortIds.remove(uniformRangeName(id, offset));
+                }
+                uniformRanges.erase(ranges);
+            }
+        }
+
+        ///
+        /// @brief Declare a range of a uniform buffer bound per draw (a table), it gets a sort id until the buffer is disposed
+        /// @param id Buffer id
+        /// @param offset Offset of the range
+        ///
+        inline void uniformRangeAdd(Buffer id, GLintptr offset) const {
+            std::vector<GLintptr>& offsets = uniformRanges[id];
+            if (std::find(offsets.begin(), offsets.end(), offset) == offsets.end()) {
+                offsets.push_back(offset);
+                uniformRangeSortIds.add(uniformRangeName(id, offset));
+            }
+        }
+
+        ///
+        /// @brief Get the sort id of a program, for the draw keys
+        /// @param id Program id
+        /// @return Dense id (0 if unknown)
+        ///
+        inline u32 shaderSortId(Shader id) const {
+            return programSortIds.get(id);
+        }
+
+        ///
+        /// @brief Get the sort id of a vao, for the draw keys
+        /// @param id VAO id
+        /// @return Dense id (0 if unknown)
+        ///
+        inline u32 vaoSortId(VAO id) const {
+            return vaoSortIds.get(id);
+        }
+
+        ///
+        /// @brief Get the sort id of a uniform buffer range declared with uniformRangeAdd, for the draw keys
+        /// @param id Buffer id
+        /// @param offset Offset of the range
+        /// @return Dense id (0 if unknown)
+        ///
+        inline u32 uniformRangeSortId(Buffer id, GLintptr offset) const {
+            return uniformRangeSortIds.get(uniformRangeName(id, offset));
         }
 
         ///
@@ -415,7 +959,40 @@ namespace ay
         ///
         template<BufferUsage T>
         inline void bufferUse(Buffer id) const {
-            glCheckError(glBindBuffer((GLenum)T, id));
+            Buffer& bound = boundBuffers[bufferSlot<T>()];
+            if (bound != id) {
+                glCheckError(glBindBuffer((GLenum)T, id));
+                bound = id;
+                stateStatistics.issued++;
+            }
+            else {
+                stateStatistics.skipped++;
+            }
+        }
+
+        ///
+        /// @brief Bind a range of the buffer to an indexed binding point
+        /// @param index Binding point
+        /// @param id Buffer id
+        /// @param offset Offset of the range (multiple of the uniform buffer alignment)
+        /// @param size Size of the range
+        ///
+        template<BufferUsage T>
+        inline void bufferBindRange(GLuint index, Buffer id, GLintptr offset, GLsizeiptr size) const {
+            static_assert(T == BufferUsage::UNIFORM, "only uniform buffers have indexed binding points");
+            if (index >= boundUniformBuffers.size() || boundUniformBuffers[index] != id || boundUniformOffsets[index] != offset) {
+                glCheckError(glBindBufferRange((GLenum)T, index, id, offset, size));
+                if (index < boundUniformBuffers.size()) {
+                    boundUniformBuffers[index] = id;
+                    boundUniformOffsets[index] = offset;
+                }
+                // also binds the generic binding point
+                boundBuffers[bufferSlot<T>()] = id;
+                stateStatistics.issued++;
+            }
+            else {
+                stateStatistics.skipped++;
+            }
         }
 
         ///
@@ -428,6 +1005,54 @@ namespace ay
             glCheckError(glBufferData((GLenum)T, size, data, (GLenum)T2));
         }
 
+        ///
+        /// @brief Buffer update data
+        /// @param offset Offset
+        /// @param size Size
+        /// @param data Data
+        ///
+        template<BufferUsage T>
+        inline void bufferSubData(GLintptr offset, GLsizeiptr size, const GLvoid* data) const {
+            glCheckError(glBufferSubData((GLenum)T, offset, size, data));
+        }
+
+        ///
+        /// @brief Copy data between two buffers on the GPU
+        /// @param source Source buffer
+        /// @param destination Destination buffer
+        /// @param readOffset Offset in the source
+        /// @param writeOffset Offset in the destination
+        /// @param size Size
+        ///
+        inline void bufferCopy(Buffer source, Buffer destination, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size) const {
+            bufferUse<BufferUsage::COPY_READ>(source);
+            bufferUse<BufferUsage::COPY_WRITE>(destination);
+            glCheckError(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, readOffset, writeOffset, size));
+        }
+
+        ///
+        /// @brief Bind the buffer to an indexed binding point
+        /// @param index Binding point
+        /// @param id Buffer id
+        ///
+        template<BufferUsage T>
+        inline void bufferBindBase(GLuint index, Buffer id) const {
+            static_assert(T == BufferUsage::UNIFORM, "only uniform buffers have indexed binding points");
+            if (index >= boundUniformBuffers.size() || boundUniformBuffers[index] != id || boundUniformOffsets[index] != WHOLE_BUFFER) {
+                glCheckError(glBindBufferBase((GLenum)T, index, id));
+                if (index < boundUniformBuffers.size()) {
+                    boundUniformBuffers[index] = id;
+                    boundUniformOffsets[index] = WHOLE_BUFFER;
+                }
+                // also binds the generic binding point
+                boundBuffers[bufferSlot<T>()] = id;
+                stateStatistics.issued++;
+            }
+            else {
+                stateStatistics.skipped++;
+            }
+        }
+
         ///
         /// @brief Buffer set data
         /// @param offset Offset
@@ -471,8 +1096,30 @@ namespace ay
         /// @param offset Specifies a offset of the first component of the first generic vertex attribute
         ///
         inline void bufferAttribute(Attribute index, GLenum type, GLint size, GLsizei stride, GLvoid* offset) const {
+            bufferAttribute(index, type, size, GL_FALSE, stride, offset);
+        }
+
+        ///
+        /// @brief Buffer attribute
+        /// @param index Attribute index
+        /// @param type Attribute type
+        /// @param size Specifies the number of components per generic vertex attribute
+        /// @param normalized Integer values are mapped to [0, 1] (unsigned) or [-1, 1] (signed)
+        /// @param stride Specifies the byte offset between consecutive generic vertex attributes
+        /// @param offset Specifies a offset of the first component of the first generic vertex attribute
+        ///
+        inline void bufferAttribute(Attribute index, GLenum type, GLint size, GLboolean normalized, GLsizei stride, GLvoid* offset) const {
             glCheckError(glEnableVertexAttribArray(index));
-            glCheckError(glVertexAttribPointer(index, size, type, GL_FALSE, stride, offset));
+            glCheckError(glVertexAttribPointer(index, size, type, normalized, stride, offset));
+        }
+
+        ///
+        /// @brief Set the rate at which an attribute advances during instanced draws
+        /// @param index Attribute index
+        /// @param divisor 0 per vertex, N every N instances
+        ///
+        inline void bufferAttributeDivisor(Attribute index, GLuint divisor) const {
+            glCheckError(glVertexAttribDivisor(index, divisor));
         }
 
         /// 
@@ -483,7 +1130,7 @@ namespace ay
         inline void texture2DNew(const std::string& name, Texture2DParameters params) {
             Texture2D id;
             glCheckError(glGenTextures(1, &id));
-            glCheckError(glBindTexture(GL_TEXTURE_2D, id));
+            texture2DBind(0, id);
             glCheckError(glTexImage2D(GL_TEXTURE_2D, params.lod,
                 params.internalFormat, params.width, params.height, 0,
                 params.dataFormat, params.dataType, nullptr));
@@ -494,7 +1141,7 @@ namespace ay
             if (params.mipmap) {
                 glCheckError(glGenerateMipmap(GL_TEXTURE_2D));
             }
-            glCheckError(glBindTexture(GL_TEXTURE_2D, 0));
+            texture2DBind(0, 0);
             textures.insert(std::make_pair(name, id));
         }
 
@@ -506,6 +1153,88 @@ namespace ay
         /// 
         void texture2DNew(const std::string& name, const std::string& filename, Texture2DParameters& params);
 
+        ///
+        /// @brief Create an unnamed texture from pixels, owned by the caller
+        /// @param params TextureParameters (size, formats, sampling, mipmaps)
+        /// @param data Pixels of the first level
+        /// @return Texture id
+        ///
+        inline Texture2D texture2DCreate(const Texture2DParameters& params, const void* data) {
+            Texture2D id;
+            glCheckError(glGenTextures(1, &id));
+            texture2DBind(0, id);
+            glCheckError(glTexImage2D(GL_TEXTURE_2D, params.lod,
+                params.internalFormat, params.width, params.height, 0,
+                params.dataFormat, params.dataType, data));
+            glCheckError(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, params.min));
+            glCheckError(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, params.mag));
+            glCheckError(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, params.wrapT));
+            glCheckError(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, params.wrapS));
+            if (params.mipmap) {
+                glCheckError(glGenerateMipmap(GL_TEXTURE_2D));
+            }
+            texture2DBind(0, 0);
+            return id;
+        }
+
+        ///
+        /// @brief Get the maximum size of a uniform block
+        /// @return Size in bytes (at least 16 KB)
+        ///
+        inline GLint getMaxUniformBlockSize() const {
+            return maxUniformBlockSize;
+        }
+
+        ///
+        /// @brief Get the alignment of the offsets of the uniform buffer ranges
+        /// @return Alignment in bytes
+        ///
+        inline GLint getUniformBufferAlignment() const {
+            return uniformBufferAlignment;
+        }
+
+        ///
+        /// @brief Check if a compressed texture format can be uploaded
+        /// @param format Compressed internal format (ETC2, EAC, ASTC, ...)
+        /// @return True if the driver lists the format
+        ///
+        inline bool texture2DCompressedSupported(GLenum format) const {
+            return std::find(compressedFormats.begin(), compressedFormats.end(), (GLint)format) != compressedFormats.end();
+        }
+
+        ///
+        /// @brief Create an unnamed texture from the compressed levels of a KTX2, owned by the caller
+        /// @param params TextureParameters (sampling, the size and format come from the image)
+        /// @param image Format and levels
+        /// @param data KTX2 file
+        /// @return Texture id
+        ///
+        Texture2D texture2DCreateCompressed(const Texture2DParameters& params, const Ktx2Image& image, const u8* data);
+
+        ///
+        /// @brief Destroy a texture created by texture2DCreate
+        /// @param id Texture id
+        ///
+        inline void texture2DDelete(Texture2D id) {
+            glCheckError(glDeleteTextures(1, &id));
+            for (auto& texture : boundTextures) {
+                texture = texture == id ? 0 : texture;
+            }
+        }
+
+        ///
+        /// @brief Replace the pixels of a texture
+        /// @param name Texture name
+        /// @param params TextureParameters (size and data format)
+        /// @param data Pixels
+        ///
+        inline void texture2DUpdate(const std::string& name, const Texture2DParameters& params, const void* data) {
+            texture2DBind(0, texture2DGet(name));
+            glCheckError(glTexSubImage2D(GL_TEXTURE_2D, params.lod, 0, 0, params.width, params.height,
+                params.dataFormat, params.dataType, data));
+            texture2DBind(0, 0);
+        }
+
         ///
         /// @brief Destroy the texture
         /// @param name Texture name
@@ -514,6 +1243,9 @@ namespace ay
             auto it = textures.find(name);
             if (it != textures.end()) {
                 glCheckError(glDeleteTextures(1, &it->second));
+                for (auto& texture : boundTextures) {
+                    texture = texture == it->second ? 0 : texture;
+                }
                 textures.erase(it);
             }
         }
@@ -524,9 +1256,16 @@ namespace ay
         /// 
         template<GLuint S = 0>
         inline void texture2DUse(const std::string& name) const {
-            Texture2D id = texture2DGet(name);
-            glCheckError(glActiveTexture(GL_TEXTURE0 + S));
-            glCheckError(glBindTexture(GL_TEXTURE_2D, id));
+            texture2DBind(S, texture2DGet(name));
+        }
+
+        ///
+        /// @brief Use texture
+        /// @param id Texture id
+        ///
+        template<GLuint S = 0>
+        inline void texture2DUse(Texture2D id) const {
+            texture2DBind(S, id);
         }
 
         /// 
@@ -598,6 +1337,7 @@ namespace ay
             auto it = framebuffers.find(name);
             if (it != framebuffers.end()) {
                 glCheckError(glDeleteFramebuffers(1, &it->second));
+                boundFramebuffer = boundFramebuffer == it->second ? 0 : boundFramebuffer;
                 framebuffers.erase(it);
             }
         }
@@ -607,8 +1347,7 @@ namespace ay
         /// @param name Framebuffer name
         /// 
         inline void framebufferUse(const std::string& name) const {
-            Framebuffer id = framebufferGet(name);
-            glCheckError(glBindFramebuffer(GL_FRAMEBUFFER, id));
+            framebufferBind(framebufferGet(name));
         }
 
         /// 
@@ -624,12 +1363,193 @@ namespace ay
             return 0;
         }
 
+        ///
+        /// @brief Get the number of state changes issued and skipped
+        /// @return Statistics
+        ///
+        inline const StateStatistics& getStateStatistics() const {
+            return stateStatistics;
+        }
+
+        ///
+        /// @brief Reset the state changes statistics
+        ///
+        inline void resetStateStatistics() {
+            stateStatistics = StateStatistics();
+        }
+
+        ///
+        /// @brief Forget the shadowed state, next binds are always issued
+        /// (call it after modifying the OpenGL state outside the context)
+        ///
+        inline void stateInvalidate() const {
+            boundProgram = INVALID_BINDING;
+            boundVao = INVALID_BINDING;
+            boundBuffers.fill(INVALID_BINDING);
+            boundUniformBuffers.fill(INVALID_BINDING);
+            boundUniformOffsets.fill(WHOLE_BUFFER);
+            activeTextureUnit = INVALID_BINDING;
+            boundTextures.fill(INVALID_BINDING);
+            boundFramebuffer = INVALID_BINDING;
+        }
+
+    private:
+        ///
+        /// @brief Name of a uniform buffer range for its sort id
+        /// @param id Buffer id
+        /// @param offset Offset of the range
+        /// @return Name
+        ///
+        static inline unsigned long long uniformRangeName(Buffer id, GLintptr offset) {
+            return ((unsigned long long)id << 32) | ((unsigned long long)offset & 0xffffffff);
+        }
+
+        ///
+        /// @brief Get the shadow slot of a buffer target
+        /// @return Slot
+        ///
+        template<BufferUsage T>
+        static constexpr size_t bufferSlot() {
+            return T == BufferUsage::ARRAY ? 0 :
+                T == BufferUsage::ELEMENT ? 1 :
+                T == BufferUsage::UNIFORM ? 2 :
+                T == BufferUsage::COPY_READ ? 3 : 4;
+        }
+
+        ///
+        /// @brief Bind a texture to a texture unit
+        /// @param unit Texture unit
+        /// @param id Texture id
+        ///
+        inline void texture2DBind(GLuint unit, Texture2D id) const {
+            if (activeTextureUnit != unit) {
+                glCheckError(glActiveTexture(GL_TEXTURE0 + unit));
+                activeTextureUnit = unit;
+                stateStatistics.issued++;
+            }
+            else {
+                stateStatistics.skipped++;
+            }
+
+            if (unit >= boundTextures.size() || boundTextures[unit] != id) {
+                glCheckError(glBindTexture(GL_TEXTURE_2D, id));
+                if (unit < boundTextures.size()) {
+                    boundTextures[unit] = id;
+                }
+                stateStatistics.issued++;
+            }
+            else {
+                stateStatistics.skipped++;
+            }
+        }
+
+        ///
+        /// @brief Bind a framebuffer
+        /// @param id Framebuffer id
+        ///
+        inline void framebufferBind(Framebuffer id) const {
+            if (boundFramebuffer != id) {
+                glCheckError(glBindFramebuffer(GL_FRAMEBUFFER, id));
+                boundFramebuffer = id;
+                stateStatistics.issued++;
+            }
+            else {
+                stateStatistics.skipped++;
+            }
+        }
+
+        ///
+        /// @brief Wait for a submitted shader and check its status
+        /// @param id Shader id
+        /// @return True if the shader is linked, false if it failed
+        ///
+        bool shaderFinalize(Shader id);
+
+        ///
+        /// @brief Get the program binary cache key of a shader
+        /// @param vertex vertex shader
+        /// @param fragment fragment shader
+        /// @return Hash of the sources and of the driver
+        ///
+        const std::string shaderCacheKey(const std::string& vertex, const std::string& fragment) const;
+
+        ///
+        /// @brief Load a shader from the program binary cache
+        /// @param key Cache key
+        /// @return Shader id (0 on miss or if the driver rejects the binary)
+        ///
+        Shader shaderLoadBinary(const std::string& key) const;
+
+        ///
+        /// @brief Store a linked shader in the program binary cache
+        /// @param key Cache key
+        /// @param id Shader id
+        ///
+        void shaderStoreBinary(const std::string& key, Shader id) const;
+
+        ///
+        /// @brief Build the uniform location table of a linked shader
+        /// @param id Shader id
+        ///
+        void shaderReflect(Shader id);
+
+        ///
+        /// @brief Bind the uniform blocks of a linked shader
+        /// @param id Shader id
+        ///
+        void shaderBindBlocks(Shader id) const;
+
     private:
         const Window& window;
+        RenderQueue* renderQueue;
+        std::map<u32, GeometryArena*> geometryArenas; // layout key -> arena
+        ThreadPool* threadPool;
         std::map<std::string, Shader> shaders;
+        std::unordered_map<Shader, std::unordered_map<std::string, Uniform>> uniforms;
         std::map<std::string, Texture2D> textures;
         std::map<std::string, Renderbuffer> renderbuffers;
         std::map<std::string, Framebuffer> framebuffers;
+        std::map<std::string, GLuint> uniformBlockBindings;
+        std::map<std::string, Buffer> uniformBlocks;
+        struct ShaderTemplate {
+            std::string vertex;
+            std::string fragment;
+            std::unordered_map<u32, Shader> variants;
+        };
+        std::map<std::string, ShaderTemplate> shaderTemplates;
+        ShaderFeatures sceneFeatures;
+        std::string shaderCacheDirectory;
+        struct PendingShader {
+            std::string key;
+            GLuint vertex;
+            GLuint fragment;
+        };
+        std::unordered_map<Shader, PendingShader> pendingShaders;
+        bool programBinarySupported;
+        bool parallelShaderCompile;
+        std::vector<GLint> compressedFormats;
+        GLint maxUniformBlockSize;
+        GLint uniformBufferAlignment;
         Shader currentShader;
+        const std::unordered_map<std::string, Uniform>* currentUniforms;
+
+        // dense ids of the objects in the draw keys
+        mutable SortIds programSortIds;
+        mutable SortIds vaoSortIds;
+        mutable SortIds uniformRangeSortIds;
+        mutable std::unordered_map<Buffer, std::vector<GLintptr>> uniformRanges; // declared ranges of each buffer
+
+        // shadow of the bound OpenGL state
+        static constexpr GLuint INVALID_BINDING = 0xffffffff;
+        static constexpr GLintptr WHOLE_BUFFER = -1;
+        mutable Shader boundProgram;
+        mutable VAO boundVao;
+        mutable std::array<Buffer, 5> boundBuffers;
+        mutable std::array<Buffer, 16> boundUniformBuffers;
+        mutable std::array<GLintptr, 16> boundUniformOffsets; // WHOLE_BUFFER if bound with bufferBindBase
+        mutable GLuint activeTextureUnit;
+        mutable std::array<Texture2D, 16> boundTextures;
+        mutable Framebuffer boundFramebuffer;
+        mutable StateStatistics stateStatistics;
     };
 }
\ No newline at end of file
@@ -0,0 +1,539 @@
+#include "cooked_model.hpp"
+#include "model_node.hpp"
+#include "mesh.hpp"
+#include "material.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+namespace ay
+{
+    static const char COOKED_MODEL_MAGIC[4] = { 'A', 'Y', 'M', 'S' };
+
+    // every field is 4 bytes, the structs have the same layout on every compiler
+
+    struct CookedHeader {
+        char magic[4];
+        u32 version;
+        u32 size; // file size
+        u32 nodeCount; // breadth-first, the first one is the root
+        u32 meshCount; // grouped by node
+        u32 materialCount;
+        u32 lodCount;
+        u32 nodesOffset;
+        u32 meshesOffset;
+        u32 materialsOffset;
+        u32 lodsOffset;
+        u32 imageCount;
+        u32 sourceCount;
+        u32 imagesOffset;
+        u32 sourcesOffset;
+    };
+
+    struct CookedNode {
+        f32 origin[3];
+        f32 position[3];
+        f32 scale[3];
+        f32 rotation[4]; // x, y, z, w
+        i32 parent; // -1 for the root
+        u32 firstMesh;
+        u32 meshCount;
+    };
+
+    struct CookedMesh {
+        u32 layout; // vertex layout key
+        u32 drawMode;
+        i32 material; // glTF material index (-1 for the default material)
+        u32 vertexCount;
+        u32 indexCount; // every level of detail
+        u32 normalsCount;
+        u32 texcoordsCount;
+        u32 colorsCount;
+        u32 firstLod;
+        u32 lodCount; // 0 if the mesh has no levels of detail
+        u32 occluderVertexCount;
+        u32 occluderIndexCount;
+        u32 verticesOffset; // vertexCount * stride bytes
+        u32 indicesOffset; // u32
+        u32 occluderVerticesOffset; // f32 x 3
+        u32 occluderIndicesOffset; // u32
+        f32 boundsMin[3];
+        f32 boundsMax[3];
+    };
+
+    struct CookedMaterial {
+        i32 index; // glTF material index
+        f32 baseColor[4];
+        f32 emissive[4];
+        f32 metallic;
+        f32 roughness;
+        f32 alphaCutoff;
+        u32 alphaMode;
+        u32 doubleSided;
+        i32 textures[5]; // image of the base color, metallic roughness, normal, occlusion and emissive textures (-1 for none)
+        char name[64];
+    };
+
+    struct CookedImage {
+        i32 minFilter;
+        i32 magFilter;
+        i32 wrapS;
+        i32 wrapT;
+        u32 firstSource; // by preference, the first one decoded is kept
+        u32 sourceCount;
+    };
+
+    struct CookedImageSource {
+        u32 encodedOffset; // png, jpeg, ktx2, ... embedded in the file
+        u32 encodedSize; // 0 to read the uri
+        u32 uriOffset; // external file (relative to the cooked file) or data uri
+        u32 uriSize;
+    };
+
+    ///
+    /// @brief Texture slots of a material, in the order of CookedMaterial::textures
+    /// @param material Material
+    /// @param slots Output, slots
+    ///
+    static void textureSlots(Material& material, Texture2D* slots[5]) {
+        slots[0] = &material.baseColorTexture;
+        slots[1] = &material.metallicRoughnessTexture;
+        slots[2] = &material.normalTexture;
+        slots[3] = &material.occlusionTexture;
+        slots[4] = &material.emissiveTexture;
+    }
+
+    ///
+    /// @brief Append bytes to the file, aligned to 16 bytes
+    /// @param file File content
+    /// @param data Bytes
+    /// @param size Size in bytes
+    /// @return Offset of the bytes
+    ///
+    static u32 append(std::vector<u8>& file, const void* data, size_t size) {
+        file.resize((file.size() + 15) & ~(size_t)15);
+        const u32 offset = (u32)file.size();
+        if (size > 0) {
+            file.insert(file.end(), (const u8*)data, (const u8*)data + size);
+        }
+        return offset;
+    }
+
+    ///
+    /// @brief Directory of a file
+    /// @param filename Filename
+    /// @return Directory, with its trailing separator (empty for the working directory)
+    ///
+    static std::string directoryOf(const std::string& filename) {
+        const size_t separator = filename.find_last_of("/\\");
+        return separator == std::string::npos ? std::string() : filename.substr(0, separator + 1);
+    }
+
+    ///
+    /// @brief Check that an array lies inside the file
+    /// @param offset Array offset
+    /// @param count Number of elements
+    /// @param elementSize Size of an element
+    /// @param size File size
+    /// @return True if inside
+    ///
+    static bool inside(u32 offset, u32 count, size_t elementSize, size_t size) {
+        return (unsigned long long)offset + (unsigned long long)count * elementSize <= (unsigned long long)size &&
+            offset % 4 == 0;
+    }
+
+    bool CookedModel::write(const std::string& source, const std::string& destination, const ModelImportOptions& options) {
+        ThreadPool threadPool;
+        Model model(nullptr);
+        model.options = options;
+        model.threadPool = &threadPool;
+        model.import(source);
+        if (model.pendingMeshes.empty()) {
+            spdlog::error("{} has no mesh to cook", source);
+            return false;
+        }
+
+        std::map<const Mesh*, const Model::PendingMesh*> pendingMeshes;
+        for (auto& pending : model.pendingMeshes) {
+            pendingMeshes[pending.mesh] = &pending;
+        }
+
+        // same order as the transform store
+        std::vector<std::pair<const ModelNode*, i32>> nodes(1, std::make_pair(model.root, -1));
+        for (size_t i = 0; i < nodes.size(); i++) {
+            for (auto child : nodes[i].first->children) {
+                nodes.push_back(std::make_pair(child, (i32)i));
+            }
+        }
+
+        std::vector<CookedNode> cookedNodes;
+        std::vector<CookedMesh> cookedMeshes;
+        std::vector<MeshLod> lods;
+        std::vector<u8> file(sizeof(CookedHeader), 0);
+        std::vector<u8> vertices;
+        for (auto& entry : nodes) {
+            const ModelNode* node = entry.first;
+            const Transform& transform = node->transform;
+            CookedNode cookedNode;
+            std::memset(&cookedNode, 0, sizeof(cookedNode));
+            for (i32 i = 0; i < 3; i++) {
+                cookedNode.origin[i] = transform.origin[i];
+                cookedNode.position[i] = transform.position[i];
+                cookedNode.scale[i] = transform.scale[i];
+            }
+            cookedNode.rotation[0] = transform.rotation.x;
+            cookedNode.rotation[1] = transform.rotation.y;
+            cookedNode.rotation[2] = transform.rotation.z;
+            cookedNode.rotation[3] = transform.rotation.w;
+            cookedNode.parent = entry.second;
+            cookedNode.firstMesh = (u32)cookedMeshes.size();
+            cookedNode.meshCount = (u32)node->meshes.size();
+            cookedNodes.push_back(cookedNode);
+
+            for (size_t i = 0; i < node->meshes.size(); i++) {
+                const Mesh* mesh = node->meshes[i];
+                auto it = pendingMeshes.find(mesh);
+                if (it == pendingMeshes.end()) {
+                    spdlog::error("{}: mesh without geometry", source);
+                    return false;
+                }
+
+                const Model::PendingMesh& pending = *it->second;
+                const MeshData& data = pending.data;
+                CookedMesh cookedMesh;
+                std::memset(&cookedMesh, 0, sizeof(cookedMesh));
+                cookedMesh.layout = pending.layout.key();
+                cookedMesh.drawMode = (u32)mesh->drawMode;
+                cookedMesh.material = node->materials[i];
+                // a cooked source is copied as it is, its geometry stays in the mapping
+                cookedMesh.vertexCount = pending.cookedVertices ? mesh->verticesCount : (u32)data.vertices.size();
+                cookedMesh.indexCount = pending.cookedIndices ? mesh->indicesCount : (u32)data.indices.size();
+                cookedMesh.normalsCount = mesh->normalsCount;
+                cookedMesh.texcoordsCount = mesh->texcoordsCount;
+                cookedMesh.colorsCount = mesh->colorsCount;
+                cookedMesh.firstLod = (u32)lods.size();
+                cookedMesh.lodCount = (u32)pending.lods.size();
+                cookedMesh.occluderVertexCount = (u32)mesh->occluder.positions.size();
+                cookedMesh.occluderIndexCount = (u32)mesh->occluder.indices.size();
+                for (i32 j = 0; j < 3; j++) {
+                    cookedMesh.boundsMin[j] = mesh->bounds.min[j];
+                    cookedMesh.boundsMax[j] = mesh->bounds.max[j];
+                }
+
+                const u8* encoded = pending.cookedVertices;
+                if (!encoded) {
+                    vertices.resize(data.vertices.size() * pending.layout.getStride());
+                    pending.layout.encode(data.vertices.data(), data.vertices.size(), vertices.data());
+                    encoded = vertices.data();
+                }
+                const u32* indices = pending.cookedIndices ? pending.cookedIndices : data.indices.data();
+                cookedMesh.verticesOffset = append(file, encoded, (size_t)cookedMesh.vertexCount * pending.layout.getStride());
+                cookedMesh.indicesOffset = append(file, indices, (size_t)cookedMesh.indexCount * sizeof(u32));
+                cookedMesh.occluderVerticesOffset = append(file, mesh->occluder.positions.data(),
+                    mesh->occluder.positions.size() * sizeof(glm::vec3));
+                cookedMesh.occluderIndicesOffset = append(file, mesh->occluder.indices.data(),
+                    mesh->occluder.indices.size() * sizeof(u32));
+                lods.insert(lods.end(), pending.lods.begin(), pending.lods.end());
+                cookedMeshes.push_back(cookedMesh);
+            }
+        }
+
+        std::vector<CookedMaterial> cookedMaterials;
+        for (auto material : model.materials) {
+            const Material* mat = material.second;
+            CookedMaterial cookedMaterial;
+            std::memset(&cookedMaterial, 0, sizeof(cookedMaterial));
+            cookedMaterial.index = material.first;
+            std::memcpy(cookedMaterial.baseColor, mat->baseColor.toPtr(), sizeof(cookedMaterial.baseColor));
+            std::memcpy(cookedMaterial.emissive, mat->emissiveFactor.toPtr(), sizeof(cookedMaterial.emissive));
+            cookedMaterial.metallic = mat->metallicFactor;
+            cookedMaterial.roughness = mat->roughnessFactor;
+            cookedMaterial.alphaCutoff = mat->alphaCutoff;
+            cookedMaterial.alphaMode = (u32)mat->alphaMode;
+            cookedMaterial.doubleSided = mat->doubleSided ? 1 : 0;
+            Texture2D* slots[5];
+            textureSlots(*material.second, slots);
+            for (size_t i = 0; i < 5; i++) {
+                cookedMaterial.textures[i] = -1;
+                for (auto& binding : model.textureBindings) {
+                    if (binding.slot == slots[i]) {
+                        cookedMaterial.textures[i] = (i32)binding.image;
+                    }
+                }
+            }
+            std::memcpy(cookedMaterial.name, mat->name.data(), std::min(mat->name.size(), sizeof(cookedMaterial.name) - 1));
+            cookedMaterials.push_back(cookedMaterial);
+        }
+
+        // the images are stored encoded, they are decoded when the cooked model is loaded
+        std::vector<CookedImage> cookedImages;
+        std::vector<CookedImageSource> cookedSources;
+        bool externalImages = false;
+        for (auto& image : model.pendingImages) {
+            CookedImage cookedImage;
+            cookedImage.minFilter = image.params.min;
+            cookedImage.magFilter = image.params.mag;
+            cookedImage.wrapS = image.params.wrapS;
+            cookedImage.wrapT = image.params.wrapT;
+            cookedImage.firstSource = (u32)cookedSources.size();
+            cookedImage.sourceCount = (u32)image.sources.size();
+            cookedImages.push_back(cookedImage);
+
+            for (auto& source : image.sources) {
+                CookedImageSource cookedSource;
+                std::memset(&cookedSource, 0, sizeof(cookedSource));
+                cookedSource.encodedSize = (u32)source.kept.size();
+                cookedSource.encodedOffset = append(file, source.kept.data(), source.kept.size());
+                if (source.kept.empty()) {
+                    cookedSource.uriSize = (u32)source.uri.size();
+                    cookedSource.uriOffset = append(file, source.uri.data(), source.uri.size());
+                    externalImages = externalImages || (!source.uri.empty() && source.uri.compare(0, 5, "data:") != 0);
+                }
+                cookedSources.push_back(cookedSource);
+            }
+        }
+
+        if (externalImages && directoryOf(source) != directoryOf(destination)) {
+            spdlog::warn("{} refers to external images, they are looked up next to {}", source, destination);
+        }
+
+        CookedHeader header;
+        std::memcpy(header.magic, COOKED_MODEL_MAGIC, sizeof(header.magic));
+        header.version = COOKED_MODEL_VERSION;
+        header.nodeCount = (u32)cookedNodes.size();
+        header.meshCount = (u32)cookedMeshes.size();
+        header.materialCount = (u32)cookedMaterials.size();
+        header.lodCount = (u32)lods.size();
+        header.nodesOffset = append(file, cookedNodes.data(), cookedNodes.size() * sizeof(CookedNode));
+        header.meshesOffset = append(file, cookedMeshes.data(), cookedMeshes.size() * sizeof(CookedMesh));
+        header.materialsOffset = append(file, cookedMaterials.data(), cookedMaterials.size() * sizeof(CookedMaterial));
+        header.lodsOffset = append(file, lods.data(), lods.size() * sizeof(MeshLod));
+        header.imageCount = (u32)cookedImages.size();
+        header.sourceCount = (u32)cookedSources.size();
+        header.imagesOffset = append(file, cookedImages.data(), cookedImages.size() * sizeof(CookedImage));
+        header.sourcesOffset = append(file, cookedSources.data(), cookedSources.size() * sizeof(CookedImageSource));
+        header.size = (u32)file.size();
+        if ((unsigned long long)file.size() != (unsigned long long)header.size) {
+            spdlog::error("{} is too large to cook", source);
+            return false;
+        }
+        std::memcpy(file.data(), &header, sizeof(header));
+
+        std::ofstream out(destination, std::ofstream::binary);
+        if (!out.is_open()) {
+            spdlog::error("Failed to open {}", destination);
+            return false;
+        }
+
+        out.write(reinterpret_cast<const char*>(file.data()), (std::streamsize)file.size());
+        out.close();
+        if (!out) {
+            spdlog::error("Failed to write {}", destination);
+            return false;
+        }
+
+        spdlog::info("Cooked {} into {} ({} nodes, {} meshes, {} images, {} KB)", source, destination,
+            cookedNodes.size(), cookedMeshes.size(), cookedImages.size(), file.size() / 1024);
+        return true;
+    }
+
+    bool CookedModel::read(Model& model, const std::string& filename) {
+        MappedFile* file = new MappedFile();
+        if (!file->open(filename)) {
+            delete file;
+            return false;
+        }
+
+        const u8* data = file->getData();
+        const size_t size = file->getSize();
+        CookedHeader header;
+        if (size < sizeof(header)) {
+            spdlog::error("{} is not a cooked model", filename);
+            delete file;
+            return false;
+        }
+        std::memcpy(&header, data, sizeof(header));
+
+        if (std::memcmp(header.magic, COOKED_MODEL_MAGIC, sizeof(header.magic)) != 0 || header.size != size) {
+            spdlog::error("{} is not a cooked model", filename);
+            delete file;
+            return false;
+        }
+
+        if (header.version != COOKED_MODEL_VERSION) {
+            spdlog::error("{} was cooked in version {} (expected {}), cook it again", filename, header.version, COOKED_MODEL_VERSION);
+            delete file;
+            return false;
+        }
+
+        // validate the tables before building anything, the model is left empty on error
+        bool valid = header.nodeCount > 0 &&
+            inside(header.nodesOffset, header.nodeCount, sizeof(CookedNode), size) &&
+            inside(header.meshesOffset, header.meshCount, sizeof(CookedMesh), size) &&
+            inside(header.materialsOffset, header.materialCount, sizeof(CookedMaterial), size) &&
+            inside(header.lodsOffset, header.lodCount, sizeof(MeshLod), size) &&
+            inside(header.imagesOffset, header.imageCount, sizeof(CookedImage), size) &&
+            inside(header.sourcesOffset, header.sourceCount, sizeof(CookedImageSource), size);
+
+        const CookedNode* nodes = reinterpret_cast<const CookedNode*>(data + header.nodesOffset);
+        const CookedMesh* meshes = reinterpret_cast<const CookedMesh*>(data + header.meshesOffset);
+        const CookedMaterial* materials = reinterpret_cast<const CookedMaterial*>(data + header.materialsOffset);
+        const MeshLod* lods = reinterpret_cast<const MeshLod*>(data + header.lodsOffset);
+        const CookedImage* images = reinterpret_cast<const CookedImage*>(data + header.imagesOffset);
+        const CookedImageSource* sources = reinterpret_cast<const CookedImageSource*>(data + header.sourcesOffset);
+        // sized once the mesh table is known to lie in the file, a corrupted count cannot exhaust the memory
+        std::vector<VertexLayout> layouts;
+        if (valid) {
+            layouts.resize(header.meshCount, VertexLayout::standard());
+        }
+        for (u32 i = 0; valid && i < header.nodeCount; i++) {
+            const CookedNode& node = nodes[i];
+            valid = (i == 0 ? node.parent == -1 : (node.parent >= 0 && (u32)node.parent < i)) &&
+                (unsigned long long)node.firstMesh + node.meshCount <= header.meshCount;
+        }
+
+        for (u32 i = 0; valid && i < header.meshCount; i++) {
+            const CookedMesh& mesh = meshes[i];
+            valid = VertexLayout::fromKey(mesh.layout, layouts[i]) &&
+                inside(mesh.verticesOffset, mesh.vertexCount, layouts[i].getStride(), size) &&
+                inside(mesh.indicesOffset, mesh.indexCount, sizeof(u32), size) &&
+                inside(mesh.occluderVerticesOffset, mesh.occluderVertexCount, sizeof(glm::vec3), size) &&
+                inside(mesh.occluderIndicesOffset, mesh.occluderIndexCount, sizeof(u32), size) &&
+                (unsigned long long)mesh.firstLod + mesh.lodCount <= header.lodCount;
+            for (u32 j = 0; valid && j < mesh.lodCount; j++) {
+                const MeshLod& lod = lods[mesh.firstLod + j];
+                valid = (unsigned long long)lod.firstIndex + lod.indexCount <= mesh.indexCount;
+            }
+
+            // the rasterizer reads the occluder on the CPU, the GPU geometry is uploaded unchecked
+            const u32* occluderIndices = reinterpret_cast<const u32*>(data + mesh.occluderIndicesOffset);
+            for (u32 j = 0; valid && j < mesh.occluderIndexCount; j++) {
+                valid = occluderIndices[j] < mesh.occluderVertexCount;
+            }
+        }
+
+        for (u32 i = 0; valid && i < header.materialCount; i++) {
+            for (u32 j = 0; valid && j < 5; j++) {
+                const i32 image = materials[i].textures[j];
+                valid = image >= -1 && (image < 0 || (u32)image < header.imageCount);
+            }
+        }
+
+        for (u32 i = 0; valid && i < header.imageCount; i++) {
+            valid = (unsigned long long)images[i].firstSource + images[i].sourceCount <= header.sourceCount;
+        }
+
+        for (u32 i = 0; valid && i < header.sourceCount; i++) {
+            valid = inside(sources[i].encodedOffset, sources[i].encodedSize, 1, size) &&
+                inside(sources[i].uriOffset, sources[i].uriSize, 1, size);
+        }
+
+        if (!valid) {
+            spdlog::error("{} is corrupted", filename);
+            delete file;
+            return false;
+        }
+
+        for (u32 i = 0; i < header.materialCount; i++) {
+            const CookedMaterial& material = materials[i];
+            if (model.materials.count(material.index) != 0) {
+                continue;
+            }
+
+            Material* mat = new Material();
+            mat->name = std::string(material.name, strnlen(material.name, sizeof(material.name)));
+            mat->baseColor = Color(material.baseColor[0], material.baseColor[1], material.baseColor[2], material.baseColor[3]);
+            mat->emissiveFactor = Color(material.emissive[0], material.emissive[1], material.emissive[2], material.emissive[3]);
+            mat->metallicFactor = material.metallic;
+            mat->roughnessFactor = material.roughness;
+            mat->alphaCutoff = material.alphaCutoff;
+            mat->alphaMode = material.alphaMode == (u32)Material::AlphaMode::MASK_MODE ? Material::AlphaMode::MASK_MODE :
+                (material.alphaMode == (u32)Material::AlphaMode::BLEND_MODE ? Material::AlphaMode::BLEND_MODE : Material::AlphaMode::OPAQUE_MODE);
+            mat->doubleSided = material.doubleSided != 0;
+            model.materials[material.index] = mat;
+
+            // set once the images are decoded and uploaded
+            Texture2D* slots[5];
+            textureSlots(*mat, slots);
+            for (size_t j = 0; j < 5; j++) {
+                if (material.textures[j] >= 0) {
+                    model.textureBindings.push_back(Model::TextureBinding{ slots[j], (size_t)material.textures[j] });
+                }
+            }
+        }
+
+        // the encoded images stay in the mapping until they are decoded
+        model.pendingImages.resize(header.imageCount);
+        for (u32 i = 0; i < header.imageCount; i++) {
+            const CookedImage& image = images[i];
+            Model::PendingImage& pending = model.pendingImages[i];
+            pending.params.min = image.minFilter;
+            pending.params.mag = image.magFilter;
+            pending.params.wrapS = image.wrapS;
+            pending.params.wrapT = image.wrapT;
+            pending.params.mipmap = true;
+            for (u32 j = image.firstSource; j < image.firstSource + image.sourceCount; j++) {
+                Model::ImageSource source;
+                if (sources[j].encodedSize > 0) {
+                    source.encoded = data + sources[j].encodedOffset;
+                    source.encodedSize = sources[j].encodedSize;
+                }
+                source.uri = std::string(reinterpret_cast<const char*>(data + sources[j].uriOffset), sources[j].uriSize);
+                pending.sources.push_back(source);
+            }
+        }
+
+        std::vector<ModelNode*> modelNodes(header.nodeCount, nullptr);
+        for (u32 i = 0; i < header.nodeCount; i++) {
+            const CookedNode& node = nodes[i];
+            ModelNode* modelNode = i == 0 ? model.root : new ModelNode(model);
+            if (i > 0) {
+                modelNodes[(size_t)node.parent]->addChild(modelNode);
+            }
+            modelNodes[i] = modelNode;
+
+            modelNode->transform.origin = glm::vec3(node.origin[0], node.origin[1], node.origin[2]);
+            modelNode->transform.position = glm::vec3(node.position[0], node.position[1], node.position[2]);
+            modelNode->transform.scale = glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
+            modelNode->transform.rotation = glm::quat(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
+
+            for (u32 j = node.firstMesh; j < node.firstMesh + node.meshCount; j++) {
+                const CookedMesh& cookedMesh = meshes[j];
+                // a material missing from the table falls back to the default one
+                const i32 materialIndex = model.materials.count(cookedMesh.material) != 0 ? cookedMesh.material : -1;
+
+                Mesh* mesh = new Mesh(model.ctx);
+                mesh->verticesCount = cookedMesh.vertexCount;
+                mesh->indicesCount = cookedMesh.indexCount;
+                mesh->normalsCount = cookedMesh.normalsCount;
+                mesh->texcoordsCount = cookedMesh.texcoordsCount;
+                mesh->colorsCount = cookedMesh.colorsCount;
+                mesh->drawMode = (GLenum)cookedMesh.drawMode;
+                mesh->bounds = BoundingBox(
+                    glm::vec3(cookedMesh.boundsMin[0], cookedMesh.boundsMin[1], cookedMesh.boundsMin[2]),
+                    glm::vec3(cookedMesh.boundsMax[0], cookedMesh.boundsMax[1], cookedMesh.boundsMax[2]));
+
+                const glm::vec3* occluderVertices = reinterpret_cast<const glm::vec3*>(data + cookedMesh.occluderVerticesOffset);
+                const u32* occluderIndices = reinterpret_cast<const u32*>(data + cookedMesh.occluderIndicesOffset);
+                mesh->occluder.positions.assign(occluderVertices, occluderVertices + cookedMesh.occluderVertexCount);
+                mesh->occluder.indices.assign(occluderIndices, occluderIndices + cookedMesh.occluderIndexCount);
+
+                // uploaded from the mapping as is
+                model.pendingMeshes.push_back({ mesh, MeshData(), layouts[j],
+                    std::vector<MeshLod>(lods + cookedMesh.firstLod, lods + cookedMesh.firstLod + cookedMesh.lodCount),
+                    data + cookedMesh.verticesOffset, reinterpret_cast<const u32*>(data + cookedMesh.indicesOffset) });
+                modelNode->addMesh(mesh, materialIndex, layouts[j].hasOctNormals());
+            }
+        }
+
+        model.totalMeshes = header.meshCount;
+        model.preparedMeshes = header.meshCount;
+        delete model.cookedFile;
+        model.cookedFile = file;
+        return true;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "types.hpp"
+#include "model.hpp"
+#include <string>
+
+namespace ay
+{
+    ///
+    /// @brief Version of the .aymesh format, files of another version have to be cooked again
+    ///
+    constexpr u32 COOKED_MODEL_VERSION = 2;
+
+    ///
+    /// @brief Model cooked offline (.aymesh, little-endian): the nodes, materials and meshes of an imported model
+    /// with the vertices already in their final layout, the indices with their levels of detail, the bounds and
+    /// the occluders. The loader maps the file and uploads the geometry straight from the mapping. The images of
+    /// the materials are kept encoded (embedded, or the uri of an external file) and decoded at load time.
+    ///
+    class CookedModel {
+    public:
+        ///
+        /// @brief Import a model and write it cooked (no GL context needed)
+        /// @param source Source filename (glTF, or .aymesh copied as it is)
+        /// @param destination Cooked filename
+        /// @param options Import options (layouts, optimization, levels of detail)
+        /// @return False if the import or the write failed
+        ///
+        static bool write(const std::string& source, const std::string& destination, const ModelImportOptions& options);
+
+        ///
+        /// @brief Map a cooked file into the nodes of a model, its meshes are ready to upload
+        /// @param model Model (empty)
+        /// @param filename Cooked filename
+        /// @return False if the file is not a valid cooked model (the model is left empty)
+        ///
+        static bool read(Model& model, const std::string& filename);
+    };
+}
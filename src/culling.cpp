@@ -0,0 +1,272 @@
+#include "culling.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define AY_CULLING_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace ay
+{
+    static const u32 BVH_LEAF_SIZE = 4;
+    static const u32 BVH_MAX_DEPTH = 64;
+    static const u32 BVH_NO_PARENT = 0xffffffff;
+
+    Frustum::Frustum() {
+        for (u32 i = 0; i < 8; i++) {
+            planeX[i] = 0.f;
+            planeY[i] = 0.f;
+            planeZ[i] = 0.f;
+            planeW[i] = 1.f;
+        }
+    }
+
+    Frustum::Frustum(const glm::mat4& m) {
+        // Gribb-Hartmann: planes are sums of the rows of the matrix
+        const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        const glm::vec4 planes[8] = {
+            row3 + row0, // left
+            row3 - row0, // right
+            row3 + row1, // bottom
+            row3 - row1, // top
+            row3 + row2, // near
+            row3 - row2, // far
+            row3 - row2,
+            row3 - row2
+        };
+
+        for (u32 i = 0; i < 8; i++) {
+            planeX[i] = planes[i].x;
+            planeY[i] = planes[i].y;
+            planeZ[i] = planes[i].z;
+            planeW[i] = planes[i].w;
+        }
+    }
+
+    Containment Frustum::test(const BoundingBox& box) const {
+        const glm::vec3 c = box.center();
+        const glm::vec3 e = box.extent();
+        int outside = 0, intersect = 0;
+
+        // distance of the center to the plane against the projected radius of the box
+#ifdef AY_CULLING_SSE
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 sign = _mm_set1_ps(-0.f);
+        const __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+        const __m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+        for (u32 i = 0; i < 8; i += 4) {
+            const __m128 px = _mm_load_ps(planeX + i);
+            const __m128 py = _mm_load_ps(planeY + i);
+            const __m128 pz = _mm_load_ps(planeZ + i);
+            const __m128 pw = _mm_load_ps(planeW + i);
+            const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)), _mm_add_ps(_mm_mul_ps(pz, cz), pw));
+            const __m128 r = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(_mm_andnot_ps(sign, px), ex),
+                _mm_mul_ps(_mm_andnot_ps(sign, py), ey)),
+                _mm_mul_ps(_mm_andnot_ps(sign, pz), ez));
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(d, r), zero));
+            intersect |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(d, r), zero));
+        }
+#else
+        for (u32 i = 0; i < 6; i++) {
+            const f32 d = planeX[i] * c.x + planeY[i] * c.y + planeZ[i] * c.z + planeW[i];
+            const f32 r = std::abs(planeX[i]) * e.x + std::abs(planeY[i]) * e.y + std::abs(planeZ[i]) * e.z;
+            outside |= d + r < 0.f;
+            intersect |= d - r < 0.f;
+        }
+#endif
+
+        return outside ? Containment::OUTSIDE : (intersect ? Containment::INTERSECT : Containment::INSIDE);
+    }
+
+    u32 Frustum::outside(const BoundingBox* const* boxes, u32 count) const {
+        // one box per lane, the missing lanes repeat the first box
+        alignas(16) f32 c[3][4];
+        alignas(16) f32 e[3][4];
+        for (u32 i = 0; i < 4; i++) {
+            const BoundingBox& box = *boxes[i < count ? i : 0];
+            const glm::vec3 center = box.center();
+            const glm::vec3 extent = box.extent();
+            for (u32 axis = 0; axis < 3; axis++) {
+                c[axis][i] = center[axis];
+                e[axis][i] = extent[axis];
+            }
+        }
+
+        u32 mask = 0;
+#ifdef AY_CULLING_SSE
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 cx = _mm_load_ps(c[0]), cy = _mm_load_ps(c[1]), cz = _mm_load_ps(c[2]);
+        const __m128 ex = _mm_load_ps(e[0]), ey = _mm_load_ps(e[1]), ez = _mm_load_ps(e[2]);
+        __m128 out = _mm_setzero_ps();
+        for (u32 i = 0; i < 6; i++) {
+            const __m128 px = _mm_set1_ps(planeX[i]), py = _mm_set1_ps(planeY[i]), pz = _mm_set1_ps(planeZ[i]);
+            const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)), _mm_add_ps(_mm_mul_ps(pz, cz), _mm_set1_ps(planeW[i])));
+            const __m128 r = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(_mm_set1_ps(std::abs(planeX[i])), ex),
+                _mm_mul_ps(_mm_set1_ps(std::abs(planeY[i])), ey)),
+                _mm_mul_ps(_mm_set1_ps(std::abs(planeZ[i])), ez));
+            out = _mm_or_ps(out, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+        }
+        mask = (u32)_mm_movemask_ps(out);
+#else
+        for (u32 i = 0; i < 6; i++) {
+            for (u32 j = 0; j < 4; j++) {
+                const f32 d = planeX[i] * c[0][j] + planeY[i] * c[1][j] + planeZ[i] * c[2][j] + planeW[i];
+                const f32 r = std::abs(planeX[i]) * e[0][j] + std::abs(planeY[i]) * e[1][j] + std::abs(planeZ[i]) * e[2][j];
+                mask |= d + r < 0.f ? 1u << j : 0u;
+            }
+        }
+#endif
+
+        return mask & ((1u << count) - 1);
+    }
+
+    BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+        : boxes(nullptr),
+        nodes(),
+        items(),
+        centers(),
+        leaves(),
+        refitted(),
+        refitNodes()
+    {
+    }
+
+    void BoundingVolumeHierarchy::build(const std::vector<BoundingBox>& _boxes) {
+        boxes = &_boxes;
+        nodes.clear();
+        items.resize(_boxes.size());
+        centers.resize(_boxes.size());
+        leaves.resize(_boxes.size());
+        for (size_t i = 0; i < _boxes.size(); i++) {
+            items[i] = (u32)i;
+            centers[i] = _boxes[i].center();
+        }
+
+        if (!items.empty()) {
+            nodes.reserve(2 * items.size() / BVH_LEAF_SIZE + 1);
+            buildNode(BVH_NO_PARENT, 0, (u32)items.size());
+        }
+        refitted.assign(nodes.size(), 0);
+    }
+
+    void BoundingVolumeHierarchy::refit(const std::vector<u32>& moved) {
+        // queue the leaves of the moved boxes and their ancestors, once each
+        refitNodes.clear();
+        for (u32 item : moved) {
+            for (u32 node = leaves[item]; node != BVH_NO_PARENT && !refitted[node]; node = nodes[node].parent) {
+                refitted[node] = 1;
+                refitNodes.push_back(node);
+            }
+        }
+
+        // children are stored after their parent, refitting by decreasing index goes bottom-up
+        std::sort(refitNodes.begin(), refitNodes.end(), [](u32 a, u32 b) { return a > b; });
+        for (u32 index : refitNodes) {
+            Node& node = nodes[index];
+            BoundingBox bounds;
+            if (node.count > 0) {
+                for (u32 i = node.first; i < node.first + node.count; i++) {
+                    bounds.merge((*boxes)[items[i]]);
+                }
+            }
+            else {
+                bounds.merge(nodes[index + 1].bounds);
+                bounds.merge(nodes[node.first].bounds);
+            }
+            node.bounds = bounds;
+            refitted[index] = 0;
+        }
+    }
+
+    u32 BoundingVolumeHierarchy::buildNode(u32 parent, u32 first, u32 count) {
+        const u32 index = (u32)nodes.size();
+        nodes.push_back(Node());
+        nodes[index].parent = parent;
+
+        BoundingBox bounds, centerBounds;
+        for (u32 i = first; i < first + count; i++) {
+            bounds.merge((*boxes)[items[i]]);
+            centerBounds.merge(centers[items[i]]);
+        }
+        nodes[index].bounds = bounds;
+
+        if (count <= BVH_LEAF_SIZE) {
+            nodes[index].first = first;
+            nodes[index].count = count;
+            for (u32 i = first; i < first + count; i++) {
+                leaves[items[i]] = index;
+            }
+            return index;
+        }
+
+        const glm::vec3 size = centerBounds.max - centerBounds.min;
+        const int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+        const u32 half = count / 2;
+        std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+            [&](u32 a, u32 b) { return centers[a][axis] < centers[b][axis]; });
+
+        buildNode(index, first, half);
+        const u32 right = buildNode(index, first + half, count - half);
+        nodes[index].first = right;
+        nodes[index].count = 0;
+        return index;
+    }
+
+    u32 BoundingVolumeHierarchy::cull(const Frustum& frustum, std::vector<u8>& visible) const {
+        visible.assign(boxes != nullptr ? boxes->size() : 0, 0);
+        if (nodes.empty()) {
+            return 0;
+        }
+
+        // the median split keeps the depth logarithmic
+        struct Entry {
+            u32 node;
+            bool inside;
+        } stack[BVH_MAX_DEPTH];
+        u32 top = 0;
+        u32 tests = 0;
+        stack[top++] = { 0, false };
+
+        while (top > 0) {
+            Entry entry = stack[--top];
+            const Node& node = nodes[entry.node];
+
+            if (!entry.inside) {
+                tests++;
+                Containment containment = frustum.test(node.bounds);
+                if (containment == Containment::OUTSIDE) {
+                    continue;
+                }
+                entry.inside = containment == Containment::INSIDE;
+            }
+
+            if (node.count > 0) {
+                // the boxes of a partly visible leaf are tested four at a time
+                u32 outside = 0;
+                if (!entry.inside && node.count > 1) {
+                    const BoundingBox* leafBoxes[BVH_LEAF_SIZE];
+                    for (u32 i = 0; i < node.count; i++) {
+                        leafBoxes[i] = &(*boxes)[items[node.first + i]];
+                    }
+                    tests++;
+                    outside = frustum.outside(leafBoxes, node.count);
+                }
+                for (u32 i = 0; i < node.count; i++) {
+                    visible[items[node.first + i]] = (outside >> i) & 1 ? 0 : 1;
+                }
+            }
+            else {
+                stack[top++] = { node.first, entry.inside };
+                stack[top++] = { entry.node + 1, entry.inside };
+            }
+        }
+
+        return tests;
+    }
+}
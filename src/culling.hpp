@@ -0,0 +1,121 @@
+#pragma once
+
+#include "types.hpp"
+#include "bounds.hpp"
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace ay
+{
+    enum class Containment {
+        OUTSIDE,
+        INTERSECT,
+        INSIDE
+    };
+
+    class Frustum {
+    public:
+        ///
+        /// @brief Constructor (everything is inside)
+        ///
+        Frustum();
+
+        ///
+        /// @brief Constructor
+        /// @param viewProjection Projection * view matrix
+        ///
+        Frustum(const glm::mat4& viewProjection);
+
+        ///
+        /// @brief Test a box against the six planes
+        /// @param box World box
+        /// @return Containment of the box
+        ///
+        Containment test(const BoundingBox& box) const;
+
+        ///
+        /// @brief Test up to four boxes at once against the six planes
+        /// @param boxes World boxes
+        /// @param count Boxes count (4 at most)
+        /// @return Bit i set if the box i is outside
+        ///
+        u32 outside(const BoundingBox* const* boxes, u32 count) const;
+
+    private:
+        // planes in SoA, padded to 8 by repeating the far plane
+        alignas(16) f32 planeX[8];
+        alignas(16) f32 planeY[8];
+        alignas(16) f32 planeZ[8];
+        alignas(16) f32 planeW[8];
+    };
+
+    class BoundingVolumeHierarchy {
+    public:
+        ///
+        /// @brief Constructor
+        ///
+        BoundingVolumeHierarchy();
+
+        ///
+        /// @brief Build the hierarchy
+        /// @param boxes World boxes (must stay alive while the hierarchy is used)
+        ///
+        void build(const std::vector<BoundingBox>& boxes);
+
+        ///
+        /// @brief Refit the nodes above moved boxes, the tree is kept
+        /// @param moved Indices of the boxes that changed since the build or the last refit
+        ///
+        void refit(const std::vector<u32>& moved);
+
+        ///
+        /// @brief Find the boxes intersecting a frustum
+        /// @param frustum Frustum
+        /// @param visible Output, one flag per box
+        /// @return Number of frustum tests done
+        ///
+        u32 cull(const Frustum& frustum, std::vector<u8>& visible) const;
+
+        ///
+        /// @brief Get the number of boxes the hierarchy was built with
+        /// @return Boxes count
+        ///
+        inline size_t size() const {
+            return items.size();
+        }
+
+        ///
+        /// @brief Get the bounds of every box
+        /// @return Bounds of the root node
+        ///
+        inline BoundingBox getBounds() const {
+            return nodes.empty() ? BoundingBox() : nodes[0].bounds;
+        }
+
+    private:
+        struct Node {
+            BoundingBox bounds;
+            u32 first; // leaf: first item, inner: right child (left child is the next node)
+            u32 count; // 0 for inner nodes
+            u32 parent;
+        };
+
+        ///
+        /// @brief Build a subtree (median split on the longest axis of the centers)
+        /// @param parent Parent node
+        /// @param first First item
+        /// @param count Items count
+        /// @return Node index
+        ///
+        u32 buildNode(u32 parent, u32 first, u32 count);
+
+    private:
+        const std::vector<BoundingBox>* boxes;
+        std::vector<Node> nodes;
+        std::vector<u32> items;
+        std::vector<glm::vec3> centers;
+        std::vector<u32> leaves; // leaf of each box
+        std::vector<u8> refitted; // nodes queued by the current refit
+        std::vector<u32> refitNodes;
+    };
+}
@@ -0,0 +1,275 @@
+#include "depth_rasterizer.hpp"
+#include "thread_pool.hpp"
+#include "mesh.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AY_DEPTH_SSE
+#include <emmintrin.h>
+#endif
+
+namespace ay
+{
+    static const u32 DEFAULT_TRIANGLE_BUDGET = 20000;
+
+    ///
+    /// @brief Edge function of the segment pq, positive on its left
+    /// @param p First point
+    /// @param q Second point
+    /// @param edge Output, a b c of a * x + b * y + c
+    ///
+    static void edgeFunction(const glm::vec3& p, const glm::vec3& q, f32* edge) {
+        edge[0] = p.y - q.y;
+        edge[1] = q.x - p.x;
+        edge[2] = p.x * q.y - p.y * q.x;
+    }
+
+    DepthRasterizer::DepthRasterizer(ThreadPool* pool, u32 _width, u32 _height)
+        : pool(pool),
+        width((_width + TILE_WIDTH - 1) / TILE_WIDTH * TILE_WIDTH),
+        height((_height + TILE_HEIGHT - 1) / TILE_HEIGHT * TILE_HEIGHT),
+        triangleBudget(DEFAULT_TRIANGLE_BUDGET),
+        viewProjection(1.f),
+        depth(),
+        tileDepth(),
+        occluders(),
+        triangles(),
+        statistics()
+    {
+        depth.assign((size_t)width * height, 1.f);
+        tileDepth.assign((size_t)(width / TILE_WIDTH) * (height / TILE_HEIGHT), 1.f);
+        resetStatistics();
+    }
+
+    void DepthRasterizer::begin(const glm::mat4& _viewProjection) {
+        viewProjection = _viewProjection;
+        occluders.clear();
+        std::fill(depth.begin(), depth.end(), 1.f);
+        std::fill(tileDepth.begin(), tileDepth.end(), 1.f);
+    }
+
+    void DepthRasterizer::rasterize() {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        // the biggest occluders on screen first, the others wait for a frame with less of them
+        std::sort(occluders.begin(), occluders.end(), [](const Occluder& a, const Occluder& b) {
+            return a.priority > b.priority;
+        });
+        u32 budget = triangleBudget;
+        size_t count = 0;
+        while (count < occluders.size()) {
+            const u32 cost = (u32)(occluders[count].mesh->indices.size() / 3);
+            if (cost > budget) {
+                break;
+            }
+            budget -= cost;
+            count++;
+        }
+        statistics.skipped += (u32)(occluders.size() - count);
+        statistics.occluders += (u32)count;
+
+        triangles.resize(std::max(triangles.size(), count));
+        pool->parallelFor(count, [this](size_t i) {
+            setup(occluders[i], triangles[i]);
+        });
+        for (size_t i = 0; i < count; i++) {
+            statistics.triangles += (u32)triangles[i].size();
+        }
+
+        triangles.resize(count);
+        pool->parallelFor(height / TILE_HEIGHT, [this](size_t band) {
+            rasterizeBand((u32)band);
+        });
+
+        const std::chrono::duration<f32, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        statistics.milliseconds += elapsed.count();
+    }
+
+    void DepthRasterizer::setup(const Occluder& occluder, std::vector<Triangle>& output) const {
+        const OccluderMesh& mesh = *occluder.mesh;
+        const glm::mat4 matrix = viewProjection * occluder.modelMatrix;
+        const glm::vec2 size((f32)width, (f32)height);
+
+        output.clear();
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            glm::vec3 screen[3];
+            bool clipped = false;
+            for (u32 k = 0; k < 3 && !clipped; k++) {
+                const glm::vec4 clip = matrix * glm::vec4(mesh.positions[mesh.indices[i + k]], 1.f);
+                // skipping a triangle behind the near plane only makes the culling less aggressive
+                clipped = clip.z < -clip.w || clip.w <= 0.f;
+                const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+                screen[k] = glm::vec3((ndc.x * .5f + .5f) * size.x, (ndc.y * .5f + .5f) * size.y, ndc.z * .5f + .5f);
+            }
+            if (clipped) {
+                continue;
+            }
+
+            // pixels whose center is inside the bounds
+            Triangle triangle;
+            triangle.minX = std::max((i32)std::ceil(std::min(screen[0].x, std::min(screen[1].x, screen[2].x)) - .5f), 0);
+            triangle.minY = std::max((i32)std::ceil(std::min(screen[0].y, std::min(screen[1].y, screen[2].y)) - .5f), 0);
+            triangle.maxX = std::min((i32)std::floor(std::max(screen[0].x, std::max(screen[1].x, screen[2].x)) - .5f), (i32)width - 1);
+            triangle.maxY = std::min((i32)std::floor(std::max(screen[0].y, std::max(screen[1].y, screen[2].y)) - .5f), (i32)height - 1);
+            if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+                continue;
+            }
+
+            // both sides are rasterized, the occluders are not always closed
+            f32 area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+            if (area == 0.f) {
+                continue;
+            }
+            if (area < 0.f) {
+                std::swap(screen[1], screen[2]);
+                area = -area;
+            }
+
+            edgeFunction(screen[1], screen[2], triangle.edges[0]);
+            edgeFunction(screen[2], screen[0], triangle.edges[1]);
+            edgeFunction(screen[0], screen[1], triangle.edges[2]);
+
+            // the normalized edge functions are the barycentric coordinates, the depth is linear in screen space
+            for (u32 c = 0; c < 3; c++) {
+                triangle.depth[c] = (triangle.edges[0][c] * screen[0].z + triangle.edges[1][c] * screen[1].z + triangle.edges[2][c] * screen[2].z) / area;
+            }
+            output.push_back(triangle);
+        }
+    }
+
+    void DepthRasterizer::rasterizeBand(u32 band) {
+        const i32 bandMin = (i32)(band * TILE_HEIGHT);
+        const i32 bandMax = bandMin + (i32)TILE_HEIGHT - 1;
+
+        for (auto& occluder : triangles) {
+            for (auto& triangle : occluder) {
+                if (triangle.maxY < bandMin || triangle.minY > bandMax) {
+                    continue;
+                }
+
+                const f32* e0 = triangle.edges[0];
+                const f32* e1 = triangle.edges[1];
+                const f32* e2 = triangle.edges[2];
+                const f32* z = triangle.depth;
+                const i32 minX = triangle.minX & ~3; // the rows are a multiple of 4 pixels
+                const i32 minY = std::max(triangle.minY, bandMin);
+                const i32 maxY = std::min(triangle.maxY, bandMax);
+
+                for (i32 y = minY; y <= maxY; y++) {
+                    const f32 py = (f32)y + .5f;
+                    const f32 row0 = e0[1] * py + e0[2];
+                    const f32 row1 = e1[1] * py + e1[2];
+                    const f32 row2 = e2[1] * py + e2[2];
+                    const f32 rowZ = z[1] * py + z[2];
+                    f32* pixels = depth.data() + (size_t)y * width;
+
+#ifdef AY_DEPTH_SSE
+                    const __m128 zero = _mm_setzero_ps();
+                    const __m128 offsets = _mm_setr_ps(.5f, 1.5f, 2.5f, 3.5f);
+                    for (i32 x = minX; x <= triangle.maxX; x += 4) {
+                        const __m128 px = _mm_add_ps(_mm_set1_ps((f32)x), offsets);
+                        const __m128 w0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e0[0]), px), _mm_set1_ps(row0));
+                        const __m128 w1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e1[0]), px), _mm_set1_ps(row1));
+                        const __m128 w2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e2[0]), px), _mm_set1_ps(row2));
+                        const __m128 pz = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(z[0]), px), _mm_set1_ps(rowZ));
+                        const __m128 old = _mm_loadu_ps(pixels + x);
+
+                        __m128 mask = _mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero));
+                        mask = _mm_and_ps(mask, _mm_cmpge_ps(w2, zero));
+                        mask = _mm_and_ps(mask, _mm_cmplt_ps(pz, old));
+                        _mm_storeu_ps(pixels + x, _mm_or_ps(_mm_and_ps(mask, pz), _mm_andnot_ps(mask, old)));
+                    }
+#else
+                    for (i32 x = minX; x <= triangle.maxX; x++) {
+                        const f32 px = (f32)x + .5f;
+                        const f32 pz = z[0] * px + rowZ;
+                        if (e0[0] * px + row0 >= 0.f && e1[0] * px + row1 >= 0.f && e2[0] * px + row2 >= 0.f && pz < pixels[x]) {
+                            pixels[x] = pz;
+                        }
+                    }
+#endif
+                }
+            }
+        }
+
+        // farthest depth of each tile, a box behind it is hidden without testing the pixels
+        const u32 tiles = width / TILE_WIDTH;
+        for (u32 tile = 0; tile < tiles; tile++) {
+            f32 farthest = 0.f;
+            for (u32 y = 0; y < TILE_HEIGHT; y++) {
+                const f32* pixels = depth.data() + (size_t)(bandMin + (i32)y) * width + tile * TILE_WIDTH;
+                for (u32 x = 0; x < TILE_WIDTH; x++) {
+                    farthest = std::max(farthest, pixels[x]);
+                }
+            }
+            tileDepth[band * tiles + tile] = farthest;
+        }
+    }
+
+    bool DepthRasterizer::testBox(const BoundingBox& bounds) {
+        statistics.tests++;
+
+        glm::vec2 minScreen(1e30f), maxScreen(-1e30f);
+        f32 nearest = 1.f;
+        for (int i = 0; i < 8; i++) {
+            const glm::vec3 corner((i & 1) ? bounds.max.x : bounds.min.x, (i & 2) ? bounds.max.y : bounds.min.y, (i & 4) ? bounds.max.z : bounds.min.z);
+            const glm::vec4 clip = viewProjection * glm::vec4(corner, 1.f);
+            if (clip.z < -clip.w || clip.w <= 0.f) {
+                // crosses the near plane
+                return true;
+            }
+            const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            const glm::vec2 screen((ndc.x * .5f + .5f) * (f32)width, (ndc.y * .5f + .5f) * (f32)height);
+            minScreen = glm::vec2(std::min(minScreen.x, screen.x), std::min(minScreen.y, screen.y));
+            maxScreen = glm::vec2(std::max(maxScreen.x, screen.x), std::max(maxScreen.y, screen.y));
+            nearest = std::min(nearest, ndc.z * .5f + .5f);
+        }
+
+        // every pixel touched by the box
+        const i32 minX = std::max((i32)std::floor(minScreen.x), 0);
+        const i32 minY = std::max((i32)std::floor(minScreen.y), 0);
+        const i32 maxX = std::min((i32)std::ceil(maxScreen.x), (i32)width) - 1;
+        const i32 maxY = std::min((i32)std::ceil(maxScreen.y), (i32)height) - 1;
+        if (minX > maxX || minY > maxY) {
+            return true;
+        }
+
+        const u32 tiles = width / TILE_WIDTH;
+        for (i32 ty = minY / (i32)TILE_HEIGHT; ty <= maxY / (i32)TILE_HEIGHT; ty++) {
+            for (i32 tx = minX / (i32)TILE_WIDTH; tx <= maxX / (i32)TILE_WIDTH; tx++) {
+                if (tileDepth[(size_t)ty * tiles + (size_t)tx] < nearest) {
+                    continue;
+                }
+
+                const i32 x0 = std::max(minX, tx * (i32)TILE_WIDTH), x1 = std::min(maxX, (tx + 1) * (i32)TILE_WIDTH - 1);
+                const i32 y0 = std::max(minY, ty * (i32)TILE_HEIGHT), y1 = std::min(maxY, (ty + 1) * (i32)TILE_HEIGHT - 1);
+                for (i32 y = y0; y <= y1; y++) {
+                    const f32* pixels = depth.data() + (size_t)y * width;
+                    for (i32 x = x0; x <= x1; x++) {
+                        if (pixels[x] >= nearest) {
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+
+        statistics.occluded++;
+        return false;
+    }
+
+    void DepthRasterizer::debugImage(std::vector<u8>& pixels) const {
+        pixels.resize(depth.size() * 4);
+        for (size_t i = 0; i < depth.size(); i++) {
+            // the depth is far from linear, the square root spreads the far values
+            const f32 d = 1.f - depth[i];
+            const u8 value = (u8)(std::sqrt(std::min(std::max(d, 0.f), 1.f)) * 255.f);
+            pixels[i * 4] = value;
+            pixels[i * 4 + 1] = value;
+            pixels[i * 4 + 2] = value;
+            pixels[i * 4 + 3] = 255;
+        }
+    }
+}
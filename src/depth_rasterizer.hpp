@@ -0,0 +1,160 @@
+#pragma once
+
+#include "types.hpp"
+#include "bounds.hpp"
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace ay
+{
+    class ThreadPool;
+    struct OccluderMesh;
+
+    struct DepthRasterizerStatistics {
+        u32 occluders; // occluders rasterized
+        u32 triangles; // triangles rasterized
+        u32 skipped; // occluders over the triangle budget
+        u32 tests; // bounding boxes tested
+        u32 occluded; // bounding boxes hidden
+        f32 milliseconds; // time spent rasterizing
+    };
+
+    class DepthRasterizer {
+    public:
+        static const u32 TILE_WIDTH = 16;
+        static const u32 TILE_HEIGHT = 8; // rows of tiles are rasterized in parallel
+
+        ///
+        /// @brief Constructor
+        /// @param pool Thread pool
+        /// @param width Depth buffer width (rounded up to a multiple of the tile width)
+        /// @param height Depth buffer height (rounded up to a multiple of the tile height)
+        ///
+        DepthRasterizer(ThreadPool* pool, u32 width = 256, u32 height = 128);
+
+        ///
+        /// @brief Clear the depth buffer and the occluders
+        /// @param viewProjection View projection matrix
+        ///
+        void begin(const glm::mat4& viewProjection);
+
+        ///
+        /// @brief Add an occluder to the frame
+        /// @param mesh Occluder geometry (alive until rasterize)
+        /// @param modelMatrix Model matrix
+        /// @param priority The occluders with the highest priority are kept when the budget is exceeded
+        ///
+        inline void addOccluder(const OccluderMesh* mesh, const glm::mat4& modelMatrix, f32 priority) {
+            occluders.push_back({ mesh, modelMatrix, priority });
+        }
+
+        ///
+        /// @brief Rasterize the occluders in the depth buffer (the triangle budget is applied)
+        ///
+        void rasterize();
+
+        ///
+        /// @brief Test a bounding box against the depth buffer
+        /// @param bounds World bounds
+        /// @return True if the box may be visible
+        ///
+        bool testBox(const BoundingBox& bounds);
+
+        ///
+        /// @brief Set the maximum number of triangles rasterized each frame
+        /// @param triangles Budget
+        ///
+        inline void setTriangleBudget(u32 triangles) {
+            triangleBudget = triangles;
+        }
+
+        ///
+        /// @brief Get the maximum number of triangles rasterized each frame
+        /// @return Budget
+        ///
+        inline u32 getTriangleBudget() const {
+            return triangleBudget;
+        }
+
+        ///
+        /// @brief Get the depth buffer width
+        /// @return Width
+        ///
+        inline u32 getWidth() const {
+            return width;
+        }
+
+        ///
+        /// @brief Get the depth buffer height
+        /// @return Height
+        ///
+        inline u32 getHeight() const {
+            return height;
+        }
+
+        ///
+        /// @brief Convert the depth buffer to an image for debugging (near is white, bottom row first)
+        /// @param pixels Output, RGBA pixels
+        ///
+        void debugImage(std::vector<u8>& pixels) const;
+
+        ///
+        /// @brief Get statistics since the last reset
+        /// @return Statistics
+        ///
+        inline const DepthRasterizerStatistics& getStatistics() const {
+            return statistics;
+        }
+
+        ///
+        /// @brief Reset statistics
+        ///
+        inline void resetStatistics() {
+            statistics.occluders = 0;
+            statistics.triangles = 0;
+            statistics.skipped = 0;
+            statistics.tests = 0;
+            statistics.occluded = 0;
+            statistics.milliseconds = 0.f;
+        }
+
+    private:
+        struct Occluder {
+            const OccluderMesh* mesh;
+            glm::mat4 modelMatrix;
+            f32 priority;
+        };
+
+        struct Triangle {
+            f32 edges[3][3]; // inside if a * x + b * y + c >= 0 for the three edges
+            f32 depth[3]; // depth plane
+            i32 minX, minY, maxX, maxY; // covered pixels (inclusive)
+        };
+
+    private:
+        ///
+        /// @brief Transform the triangles of an occluder to the screen
+        /// @param occluder Occluder
+        /// @param triangles Output, triangles in front of the near plane and covering a pixel
+        ///
+        void setup(const Occluder& occluder, std::vector<Triangle>& triangles) const;
+
+        ///
+        /// @brief Rasterize the triangles overlapping a row of tiles and update its tile depths
+        /// @param band Row of tiles
+        ///
+        void rasterizeBand(u32 band);
+
+    private:
+        ThreadPool* pool;
+        u32 width;
+        u32 height;
+        u32 triangleBudget;
+        glm::mat4 viewProjection;
+        std::vector<f32> depth; // [0, 1], row-major, bottom row first
+        std::vector<f32> tileDepth; // farthest depth of each tile
+        std::vector<Occluder> occluders;
+        std::vector<std::vector<Triangle>> triangles; // per rasterized occluder
+        DepthRasterizerStatistics statistics;
+    };
+}
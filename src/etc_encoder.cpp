@@ -0,0 +1,279 @@
+#include "etc_encoder.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace ay
+{
+    // intensity modifiers of the color tables, for the codes 0 (+a), 1 (+b), 2 (-a), 3 (-b)
+    static const i32 ETC_MODIFIERS[8][4] = {
+        { 2, 8, -2, -8 },
+        { 5, 17, -5, -17 },
+        { 9, 29, -9, -29 },
+        { 13, 42, -13, -42 },
+        { 18, 60, -18, -60 },
+        { 24, 80, -24, -80 },
+        { 33, 106, -33, -106 },
+        { 47, 183, -47, -183 }
+    };
+
+    static const i32 EAC_MODIFIERS[16][8] = {
+        { -3, -6, -9, -15, 2, 5, 8, 14 },
+        { -3, -7, -10, -13, 2, 6, 9, 12 },
+        { -2, -5, -8, -13, 1, 4, 7, 12 },
+        { -2, -4, -6, -13, 1, 3, 5, 12 },
+        { -3, -6, -8, -12, 2, 5, 7, 11 },
+        { -3, -7, -9, -11, 2, 6, 8, 10 },
+        { -4, -7, -8, -11, 3, 6, 7, 10 },
+        { -3, -5, -8, -11, 2, 4, 7, 10 },
+        { -2, -6, -8, -10, 1, 5, 7, 9 },
+        { -2, -5, -8, -10, 1, 4, 7, 9 },
+        { -2, -4, -8, -10, 1, 3, 7, 9 },
+        { -2, -5, -7, -10, 1, 4, 6, 9 },
+        { -3, -4, -7, -10, 2, 3, 6, 9 },
+        { -1, -2, -3, -10, 0, 1, 2, 9 },
+        { -4, -6, -8, -9, 3, 5, 7, 8 },
+        { -3, -5, -7, -9, 2, 4, 6, 8 }
+    };
+
+    ///
+    /// @brief Clamp to a byte
+    ///
+    static inline i32 clampByte(i32 value) {
+        return value < 0 ? 0 : (value > 255 ? 255 : value);
+    }
+
+    ///
+    /// @brief Pick the best table and codes for the 8 pixels of a sub-block
+    /// @param block Pixels of the block (RGBA8, row-major)
+    /// @param pixels Indices of the 8 pixels in the block
+    /// @param base Base color
+    /// @param table Output, table
+    /// @param codes Output, code of each pixel
+    /// @return Squared error
+    ///
+    static u32 fitSubBlock(const u8* block, const u32 pixels[8], const i32 base[3], u32& table, u32 codes[8]) {
+        u32 bestError = 0xffffffff;
+        for (u32 t = 0; t < 8; t++) {
+            u32 error = 0;
+            u32 tableCodes[8];
+            for (u32 i = 0; i < 8 && error < bestError; i++) {
+                const u8* pixel = block + pixels[i] * 4;
+                u32 pixelError = 0xffffffff;
+                for (u32 code = 0; code < 4; code++) {
+                    const i32 modifier = ETC_MODIFIERS[t][code];
+                    const i32 r = clampByte(base[0] + modifier) - pixel[0];
+                    const i32 g = clampByte(base[1] + modifier) - pixel[1];
+                    const i32 b = clampByte(base[2] + modifier) - pixel[2];
+                    const u32 codeError = (u32)(r * r + g * g + b * b);
+                    if (codeError < pixelError) {
+                        pixelError = codeError;
+                        tableCodes[i] = code;
+                    }
+                }
+                error += pixelError;
+            }
+
+            if (error < bestError) {
+                bestError = error;
+                table = t;
+                std::copy(tableCodes, tableCodes + 8, codes);
+            }
+        }
+        return bestError;
+    }
+
+    size_t EtcEncoder::compressedSize(u32 width, u32 height, bool alpha) {
+        return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * (alpha ? 16 : 8);
+    }
+
+    void EtcEncoder::compress(const u8* rgba, u32 width, u32 height, bool alpha, u8* out, ThreadPool* threadPool) {
+        const u32 blocksX = (width + 3) / 4;
+        const u32 blocksY = (height + 3) / 4;
+        const size_t blockSize = alpha ? 16 : 8;
+        auto compressRow = [=](size_t by) {
+            u8 block[64];
+            for (u32 bx = 0; bx < blocksX; bx++) {
+                // the blocks over the edge repeat the last row and column
+                for (u32 y = 0; y < 4; y++) {
+                    const u32 sy = std::min((u32)by * 4 + y, height - 1);
+                    for (u32 x = 0; x < 4; x++) {
+                        const u32 sx = std::min(bx * 4 + x, width - 1);
+                        std::copy(rgba + ((size_t)sy * width + sx) * 4, rgba + ((size_t)sy * width + sx) * 4 + 4, block + (y * 4 + x) * 4);
+                    }
+                }
+
+                u8* destination = out + (by * blocksX + bx) * blockSize;
+                if (alpha) {
+                    encodeAlphaBlock(block, destination);
+                    destination += 8;
+                }
+                encodeColorBlock(block, destination);
+            }
+        };
+
+        if (threadPool) {
+            threadPool->parallelFor(blocksY, compressRow);
+        }
+        else {
+            for (size_t by = 0; by < blocksY; by++) {
+                compressRow(by);
+            }
+        }
+    }
+
+    void EtcEncoder::encodeColorBlock(const u8* block, u8* out) {
+        u32 bestError = 0xffffffff;
+        u32 bestFlip = 0, bestDifferential = 0;
+        u32 bestTables[2] = { 0, 0 };
+        u32 bestCodes[2][8] = {};
+        i32 bestQuantized[2][3] = {};
+
+        for (u32 flip = 0; flip < 2; flip++) {
+            // flip 0: two 2x4 sub-blocks side by side, flip 1: two 4x2 sub-blocks on top of each other
+            u32 pixels[2][8];
+            f32 average[2][3] = {};
+            for (u32 s = 0; s < 2; s++) {
+                for (u32 i = 0; i < 8; i++) {
+                    const u32 x = flip ? i % 4 : s * 2 + i % 2;
+                    const u32 y = flip ? s * 2 + i / 4 : i / 2;
+                    pixels[s][i] = y * 4 + x;
+                    for (u32 c = 0; c < 3; c++) {
+                        average[s][c] += (f32)block[pixels[s][i] * 4 + c] / 8.f;
+                    }
+                }
+            }
+
+            for (u32 differential = 0; differential < 2; differential++) {
+                // individual: two 4-bit colors, differential: a 5-bit color and a 3-bit signed offset
+                i32 quantized[2][3];
+                i32 base[2][3];
+                for (u32 c = 0; c < 3; c++) {
+                    if (differential) {
+                        quantized[0][c] = (i32)std::lround(average[0][c] * 31.f / 255.f);
+                        const i32 second = (i32)std::lround(average[1][c] * 31.f / 255.f);
+                        // in range by construction, an overflow would select the T, H or planar modes of ETC2
+                        quantized[1][c] = quantized[0][c] + std::min(std::max(second - quantized[0][c], -4), 3);
+                        base[0][c] = (quantized[0][c] << 3) | (quantized[0][c] >> 2);
+                        base[1][c] = (quantized[1][c] << 3) | (quantized[1][c] >> 2);
+                    }
+                    else {
+                        for (u32 s = 0; s < 2; s++) {
+                            quantized[s][c] = (i32)std::lround(average[s][c] * 15.f / 255.f);
+                            base[s][c] = quantized[s][c] * 17;
+                        }
+                    }
+                }
+
+                u32 tables[2];
+                u32 codes[2][8];
+                const u32 error = fitSubBlock(block, pixels[0], base[0], tables[0], codes[0]) +
+                    fitSubBlock(block, pixels[1], base[1], tables[1], codes[1]);
+                if (error < bestError) {
+                    bestError = error;
+                    bestFlip = flip;
+                    bestDifferential = differential;
+                    std::copy(tables, tables + 2, bestTables);
+                    for (u32 s = 0; s < 2; s++) {
+                        std::copy(codes[s], codes[s] + 8, bestCodes[s]);
+                        std::copy(quantized[s], quantized[s] + 3, bestQuantized[s]);
+                    }
+                }
+            }
+        }
+
+        for (u32 c = 0; c < 3; c++) {
+            out[c] = bestDifferential ?
+                (u8)((bestQuantized[0][c] << 3) | ((bestQuantized[1][c] - bestQuantized[0][c]) & 7)) :
+                (u8)((bestQuantized[0][c] << 4) | bestQuantized[1][c]);
+        }
+        out[3] = (u8)((bestTables[0] << 5) | (bestTables[1] << 2) | (bestDifferential << 1) | bestFlip);
+
+        // the codes are stored column by column, most significant bits first
+        u32 msb = 0, lsb = 0;
+        for (u32 s = 0; s < 2; s++) {
+            for (u32 i = 0; i < 8; i++) {
+                const u32 x = bestFlip ? i % 4 : s * 2 + i % 2;
+                const u32 y = bestFlip ? s * 2 + i / 4 : i / 2;
+                const u32 bit = x * 4 + y;
+                msb |= (bestCodes[s][i] >> 1) << bit;
+                lsb |= (bestCodes[s][i] & 1) << bit;
+            }
+        }
+        out[4] = (u8)(msb >> 8);
+        out[5] = (u8)msb;
+        out[6] = (u8)(lsb >> 8);
+        out[7] = (u8)lsb;
+    }
+
+    void EtcEncoder::encodeAlphaBlock(const u8* block, u8* out) {
+        i32 minAlpha = 255, maxAlpha = 0;
+        for (u32 i = 0; i < 16; i++) {
+            minAlpha = std::min(minAlpha, (i32)block[i * 4 + 3]);
+            maxAlpha = std::max(maxAlpha, (i32)block[i * 4 + 3]);
+        }
+
+        auto fit = [block](i32 base, u32 multiplier, u32 table, u32 indices[16]) {
+            u32 error = 0;
+            for (u32 i = 0; i < 16; i++) {
+                u32 pixelError = 0xffffffff;
+                for (u32 index = 0; index < 8; index++) {
+                    const i32 delta = clampByte(base + EAC_MODIFIERS[table][index] * (i32)multiplier) - (i32)block[i * 4 + 3];
+                    if ((u32)(delta * delta) < pixelError) {
+                        pixelError = (u32)(delta * delta);
+                        indices[i] = index;
+                    }
+                }
+                error += pixelError;
+            }
+            return error;
+        };
+
+        // a constant block is exact with the zero modifier of the table 13
+        i32 bestBase = minAlpha;
+        u32 bestMultiplier = 1, bestTable = 13;
+        u32 bestIndices[16];
+        u32 bestError = fit(bestBase, bestMultiplier, bestTable, bestIndices);
+        if (minAlpha != maxAlpha) {
+            const f32 middle = (f32)(minAlpha + maxAlpha) * .5f;
+            u32 indices[16];
+            for (u32 table = 0; table < 16; table++) {
+                const f32 tableMiddle = (f32)(EAC_MODIFIERS[table][3] + EAC_MODIFIERS[table][7]) * .5f;
+                for (u32 multiplier = 1; multiplier < 16; multiplier++) {
+                    const i32 base = clampByte((i32)std::lround(middle - tableMiddle * (f32)multiplier));
+                    const u32 error = fit(base, multiplier, table, indices);
+                    if (error < bestError) {
+                        bestError = error;
+                        bestBase = base;
+                        bestMultiplier = multiplier;
+                        bestTable = table;
+                        std::copy(indices, indices + 16, bestIndices);
+                    }
+                }
+            }
+
+            for (i32 offset = -3; offset <= 3; offset++) {
+                const i32 base = clampByte(bestBase + offset);
+                const u32 error = fit(base, bestMultiplier, bestTable, indices);
+                if (error < bestError) {
+                    bestError = error;
+                    bestBase = base;
+                    std::copy(indices, indices + 16, bestIndices);
+                }
+            }
+        }
+
+        out[0] = (u8)bestBase;
+        out[1] = (u8)((bestMultiplier << 4) | bestTable);
+        // 16 indices of 3 bits column by column, most significant bits first
+        unsigned long long bits = 0;
+        for (u32 x = 0; x < 4; x++) {
+            for (u32 y = 0; y < 4; y++) {
+                bits = (bits << 3) | bestIndices[y * 4 + x];
+            }
+        }
+        for (u32 i = 0; i < 6; i++) {
+            out[2 + i] = (u8)(bits >> (40 - i * 8));
+        }
+    }
+}
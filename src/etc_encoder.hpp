@@ -0,0 +1,47 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstddef>
+
+namespace ay
+{
+    class ThreadPool;
+
+    class EtcEncoder {
+    public:
+        ///
+        /// @brief Get the size of an image compressed in ETC2
+        /// @param width Width
+        /// @param height Height
+        /// @param alpha True for RGBA8 (EAC alpha), false for RGB8
+        /// @return Size in bytes
+        ///
+        static size_t compressedSize(u32 width, u32 height, bool alpha);
+
+        ///
+        /// @brief Compress an image in ETC2 RGB8 (ETC1 compatible blocks) or RGBA8 (EAC alpha)
+        /// @param rgba Pixels (RGBA8, rows top to bottom)
+        /// @param width Width
+        /// @param height Height
+        /// @param alpha True to keep the alpha channel
+        /// @param out Destination (compressedSize bytes)
+        /// @param threadPool Compress the rows of blocks in parallel (nullptr for serial)
+        ///
+        static void compress(const u8* rgba, u32 width, u32 height, bool alpha, u8* out, ThreadPool* threadPool);
+
+    private:
+        ///
+        /// @brief Compress the color of a 4x4 block (exhaustive over flip, mode and tables)
+        /// @param block Pixels (RGBA8, row-major)
+        /// @param out Destination (8 bytes)
+        ///
+        static void encodeColorBlock(const u8* block, u8* out);
+
+        ///
+        /// @brief Compress the alpha of a 4x4 block in EAC
+        /// @param block Pixels (RGBA8, row-major)
+        /// @param out Destination (8 bytes)
+        ///
+        static void encodeAlphaBlock(const u8* block, u8* out);
+    };
+}
@@ -0,0 +1,178 @@
+#include "geometry_arena.hpp"
+#include <algorithm>
+#include <iterator>
+
+namespace ay
+{
+    static const u32 INITIAL_VERTICES = 1 << 16;
+    static const u32 INITIAL_INDICES = 1 << 18;
+
+    constexpr u32 RangeAllocator::INVALID;
+
+    RangeAllocator::RangeAllocator(u32 capacity)
+        : freeRanges(),
+        capacity(0)
+    {
+        grow(capacity);
+    }
+
+    u32 RangeAllocator::allocate(u32 count) {
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+            if (it->second >= count) {
+                const u32 offset = it->first;
+                const u32 remaining = it->second - count;
+                freeRanges.erase(it);
+                if (remaining > 0) {
+                    freeRanges[offset + count] = remaining;
+                }
+                return offset;
+            }
+        }
+        return INVALID;
+    }
+
+    void RangeAllocator::free(u32 offset, u32 count) {
+        if (count == 0) {
+            return;
+        }
+
+        auto next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.end() && offset + count == next->first) {
+            count += next->second;
+            next = freeRanges.erase(next);
+        }
+
+        if (next != freeRanges.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                previous->second += count;
+                return;
+            }
+        }
+
+        freeRanges[offset] = count;
+    }
+
+    void RangeAllocator::grow(u32 _capacity) {
+        if (_capacity <= capacity) {
+            return;
+        }
+
+        const u32 oldCapacity = capacity;
+        capacity = _capacity;
+        free(oldCapacity, _capacity - oldCapacity);
+    }
+
+    GeometryArena::GeometryArena(Context* ctx, const VertexLayout& layout)
+        : ctx(ctx),
+        layout(layout),
+        vao(0),
+        vertexBuffer(0),
+        indexBuffer(0),
+        vertices(0),
+        indices(0)
+    {
+        vao = ctx->vaoNew();
+        reserve(INITIAL_VERTICES, INITIAL_INDICES);
+    }
+
+    GeometryArena::~GeometryArena() {
+        ctx->vaoDispose(vao);
+        ctx->bufferDispose(vertexBuffer);
+        ctx->bufferDispose(indexBuffer);
+    }
+
+    GeometryRange GeometryArena::allocate(const MeshData& data) {
+        if (data.vertices.empty() || data.indices.empty()) {
+            return GeometryRange();
+        }
+
+        std::vector<u8> encoded(data.vertices.size() * layout.getStride());
+        layout.encode(data.vertices.data(), data.vertices.size(), encoded.data());
+        return allocate(encoded.data(), (u32)data.vertices.size(), data.indices.data(), (u32)data.indices.size());
+    }
+
+    GeometryRange GeometryArena::allocate(const u8* encodedVertices, u32 vertexCount, const u32* indexData, u32 indexCount) {
+        GeometryRange range;
+        if (vertexCount == 0 || indexCount == 0) {
+            return range;
+        }
+
+        u32 baseVertex = vertices.allocate(vertexCount);
+        u32 firstIndex = indices.allocate(indexCount);
+        if (baseVertex == RangeAllocator::INVALID || firstIndex == RangeAllocator::INVALID) {
+            reserve(
+                baseVertex == RangeAllocator::INVALID ? vertices.getCapacity() + vertexCount : 0,
+                firstIndex == RangeAllocator::INVALID ? indices.getCapacity() + indexCount : 0);
+            baseVertex = baseVertex == RangeAllocator::INVALID ? vertices.allocate(vertexCount) : baseVertex;
+            firstIndex = firstIndex == RangeAllocator::INVALID ? indices.allocate(indexCount) : firstIndex;
+        }
+
+        range.baseVertex = baseVertex;
+        range.vertexCount = vertexCount;
+        range.firstIndex = firstIndex;
+        range.indexCount = indexCount;
+
+        const size_t stride = layout.getStride();
+        ctx->bufferUse<BufferUsage::ARRAY>(vertexBuffer);
+        ctx->bufferSubData<BufferUsage::ARRAY>((GLintptr)(baseVertex * stride), (GLsizeiptr)(vertexCount * stride), encodedVertices);
+
+        // not through the element target, that would modify the bound vao
+        ctx->bufferUse<BufferUsage::COPY_WRITE>(indexBuffer);
+        ctx->bufferSubData<BufferUsage::COPY_WRITE>((GLintptr)firstIndex * sizeof(u32), (GLsizeiptr)indexCount * sizeof(u32), indexData);
+        return range;
+    }
+
+    void GeometryArena::free(const GeometryRange& range) {
+        vertices.free(range.baseVertex, range.vertexCount);
+        indices.free(range.firstIndex, range.indexCount);
+    }
+
+    void GeometryArena::reserve(u32 vertexCount, u32 indexCount) {
+        const u32 oldVertices = vertices.getCapacity();
+        const u32 oldIndices = indices.getCapacity();
+        u32 newVertices = std::max(oldVertices, INITIAL_VERTICES);
+        u32 newIndices = std::max(oldIndices, INITIAL_INDICES);
+        while (newVertices < vertexCount) {
+            newVertices *= 2;
+        }
+        while (newIndices < indexCount) {
+            newIndices *= 2;
+        }
+
+        const GLsizeiptr stride = (GLsizeiptr)layout.getStride();
+        if (newVertices != oldVertices) {
+            Buffer buffer = ctx->bufferNew();
+            ctx->bufferUse<BufferUsage::COPY_WRITE>(buffer);
+            ctx->bufferData<BufferUsage::COPY_WRITE, BufferTarget::STATIC_DRAW>((GLsizeiptr)newVertices * stride, nullptr);
+            if (oldVertices > 0) {
+                ctx->bufferCopy(vertexBuffer, buffer, 0, 0, (GLsizeiptr)oldVertices * stride);
+                ctx->bufferDispose(vertexBuffer);
+            }
+            vertexBuffer = buffer;
+            vertices.grow(newVertices);
+        }
+
+        if (newIndices != oldIndices) {
+            Buffer buffer = ctx->bufferNew();
+            ctx->bufferUse<BufferUsage::COPY_WRITE>(buffer);
+            ctx->bufferData<BufferUsage::COPY_WRITE, BufferTarget::STATIC_DRAW>((GLsizeiptr)newIndices * sizeof(u32), nullptr);
+            if (oldIndices > 0) {
+                ctx->bufferCopy(indexBuffer, buffer, 0, 0, (GLsizeiptr)oldIndices * sizeof(u32));
+                ctx->bufferDispose(indexBuffer);
+            }
+            indexBuffer = buffer;
+            indices.grow(newIndices);
+        }
+
+        setupVao();
+    }
+
+    void GeometryArena::setupVao() {
+        ctx->vaoUse(vao);
+        ctx->bufferUse<BufferUsage::ARRAY>(vertexBuffer);
+        layout.setup(ctx);
+        ctx->bufferUse<BufferUsage::ELEMENT>(indexBuffer);
+        ctx->vaoUse(0);
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "types.hpp"
+#include "context.hpp"
+#include "vertex_layout.hpp"
+#include <map>
+
+namespace ay
+{
+    struct GeometryRange {
+        u32 baseVertex = 0;
+        u32 vertexCount = 0;
+        u32 firstIndex = 0;
+        u32 indexCount = 0;
+    };
+
+    class RangeAllocator {
+    public:
+        static constexpr u32 INVALID = 0xffffffff;
+
+        ///
+        /// @brief Constructor
+        /// @param capacity Number of elements
+        ///
+        RangeAllocator(u32 capacity);
+
+        ///
+        /// @brief Allocate a range (first fit)
+        /// @param count Number of elements
+        /// @return Offset of the range or INVALID if there is no space
+        ///
+        u32 allocate(u32 count);
+
+        ///
+        /// @brief Free a range (merged with its free neighbours)
+        /// @param offset Offset of the range
+        /// @param count Number of elements
+        ///
+        void free(u32 offset, u32 count);
+
+        ///
+        /// @brief Grow the capacity, the new elements are free
+        /// @param capacity New number of elements
+        ///
+        void grow(u32 capacity);
+
+        ///
+        /// @brief Get capacity
+        /// @return Number of elements
+        ///
+        inline u32 getCapacity() const {
+            return capacity;
+        }
+
+    private:
+        std::map<u32, u32> freeRanges; // offset -> count
+        u32 capacity;
+    };
+
+    class GeometryArena {
+    public:
+        ///
+        /// @brief Constructor
+        /// @param ctx Context
+        /// @param layout Vertex layout shared by every mesh of the arena
+        ///
+        GeometryArena(Context* ctx, const VertexLayout& layout);
+
+        ///
+        /// @brief Destructor
+        ///
+        ~GeometryArena();
+
+        ///
+        /// @brief Allocate the geometry of a mesh and upload it
+        /// @param data Vertices and indices (indices relative to the first vertex)
+        /// @return Allocated range
+        ///
+        GeometryRange allocate(const MeshData& data);
+
+        ///
+        /// @brief Allocate the geometry of a mesh already in the layout of the arena and upload it as is
+        /// @param encodedVertices Vertices (vertexCount * stride bytes)
+        /// @param vertexCount Number of vertices
+        /// @param indexData Indices (relative to the first vertex)
+        /// @param indexCount Number of indices
+        /// @return Allocated range
+        ///
+        GeometryRange allocate(const u8* encodedVertices, u32 vertexCount, const u32* indexData, u32 indexCount);
+
+        ///
+        /// @brief Free the geometry of a mesh
+        /// @param range Range returned by allocate
+        ///
+        void free(const GeometryRange& range);
+
+        ///
+        /// @brief Get the vao shared by every mesh
+        /// @return VAO
+        ///
+        inline VAO getVao() const {
+            return vao;
+        }
+
+        ///
+        /// @brief Get the vertex layout
+        /// @return Layout
+        ///
+        inline const VertexLayout& getLayout() const {
+            return layout;
+        }
+
+    private:
+        ///
+        /// @brief Grow the buffers (the content is copied on the GPU)
+        /// @param vertices Minimum number of vertices
+        /// @param indices Minimum number of indices
+        ///
+        void reserve(u32 vertices, u32 indices);
+
+        ///
+        /// @brief Describe the vertex format in the vao
+        ///
+        void setupVao();
+
+    private:
+        Context* ctx;
+        VertexLayout layout;
+        VAO vao;
+        Buffer vertexBuffer;
+        Buffer indexBuffer;
+        RangeAllocator vertices;
+        RangeAllocator indices;
+    };
+}
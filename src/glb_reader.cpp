@@ -0,0 +1,174 @@
+#include "glb_reader.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstring>
+
+namespace ay
+{
+    static const u32 GLB_MAGIC = 0x46546C67; // glTF
+    static const u32 GLB_CHUNK_JSON = 0x4E4F534A;
+    static const u32 GLB_CHUNK_BIN = 0x004E4942;
+
+    ///
+    /// @brief Read a little-endian u32
+    ///
+    static u32 readU32(const u8* data) {
+        u32 value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    ///
+    /// @brief Number of components of an accessor type (0 if unknown)
+    ///
+    static u32 componentCount(const std::string& type) {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        if (type == "MAT2") return 4;
+        if (type == "MAT3") return 9;
+        if (type == "MAT4") return 16;
+        return 0;
+    }
+
+    ///
+    /// @brief Size of a component type in bytes (0 if unknown)
+    ///
+    static u32 componentSize(u32 componentType) {
+        switch (componentType) {
+        case 5120: case 5121: return 1; // byte, unsigned byte
+        case 5122: case 5123: return 2; // short, unsigned short
+        case 5125: case 5126: return 4; // unsigned int, float
+        default: return 0;
+        }
+    }
+
+    bool GlbReader::open(const std::string& filename) {
+        bin = nullptr;
+        binSize = 0;
+        if (!file.open(filename)) {
+            return false;
+        }
+
+        const u8* data = file.getData();
+        const size_t size = file.getSize();
+        if (size < 20 || readU32(data) != GLB_MAGIC || readU32(data + 4) != 2) {
+            spdlog::error("{} is not a binary glTF 2.0", filename);
+            file.close();
+            return false;
+        }
+
+        const size_t length = std::min((size_t)readU32(data + 8), size);
+        const u8* jsonChunk = nullptr;
+        size_t jsonSize = 0;
+        for (size_t offset = 12; offset + 8 <= length;) {
+            const size_t chunkSize = readU32(data + offset);
+            const u32 chunkType = readU32(data + offset + 4);
+            if (chunkSize > length - offset - 8) {
+                break;
+            }
+
+            if (chunkType == GLB_CHUNK_JSON && jsonChunk == nullptr) {
+                jsonChunk = data + offset + 8;
+                jsonSize = chunkSize;
+            }
+            else if (chunkType == GLB_CHUNK_BIN && bin == nullptr) {
+                bin = data + offset + 8;
+                binSize = chunkSize;
+            }
+            offset += 8 + ((chunkSize + 3) & ~(size_t)3);
+        }
+
+        if (jsonChunk == nullptr) {
+            spdlog::error("{} has no JSON chunk", filename);
+            file.close();
+            return false;
+        }
+
+        json = nlohmann::json::parse(jsonChunk, jsonChunk + jsonSize, nullptr, false);
+        if (json.is_discarded() || !json.is_object()) {
+            spdlog::error("Failed to parse the JSON chunk of {}", filename);
+            file.close();
+            return false;
+        }
+
+        // the other buffers would have to be loaded, the generic loader handles them
+        const nlohmann::json& buffers = getArray("buffers");
+        for (size_t i = 0; i < buffers.size(); i++) {
+            if (i > 0 || buffers[i].count("uri") != 0) {
+                spdlog::info("{} references external buffers", filename);
+                file.close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const nlohmann::json& GlbReader::getArray(const std::string& name) const {
+        static const nlohmann::json empty = nlohmann::json::array();
+        auto it = json.find(name);
+        return it != json.end() && it->is_array() ? *it : empty;
+    }
+
+    bool GlbReader::getBufferView(i32 index, const u8*& data, size_t& size) const {
+        const nlohmann::json& bufferViews = getArray("bufferViews");
+        if (index < 0 || (size_t)index >= bufferViews.size() || bin == nullptr) {
+            return false;
+        }
+
+        const nlohmann::json& bufferView = bufferViews[(size_t)index];
+        const size_t offset = bufferView.value("byteOffset", (size_t)0);
+        const size_t length = bufferView.value("byteLength", (size_t)0);
+        if (offset > binSize || length > binSize - offset) {
+            spdlog::error("Buffer view {} out of the BIN chunk", index);
+            return false;
+        }
+
+        data = bin + offset;
+        size = length;
+        return true;
+    }
+
+    bool GlbReader::getAccessor(i32 index, AccessorView& view) const {
+        const nlohmann::json& accessors = getArray("accessors");
+        if (index < 0 || (size_t)index >= accessors.size()) {
+            return false;
+        }
+
+        const nlohmann::json& accessor = accessors[(size_t)index];
+        const i32 bufferView = accessor.value("bufferView", -1);
+        const nlohmann::json& bufferViews = getArray("bufferViews");
+        if (bufferView < 0 || (size_t)bufferView >= bufferViews.size() || bin == nullptr) {
+            return false;
+        }
+
+        const nlohmann::json& bufferViewJson = bufferViews[(size_t)bufferView];
+        view.componentType = accessor.value("componentType", 0u);
+        view.components = componentCount(accessor.value("type", std::string()));
+        view.normalized = accessor.value("normalized", false);
+        view.count = accessor.value("count", (size_t)0);
+        view.minValues = accessor.value("min", std::vector<f64>());
+        view.maxValues = accessor.value("max", std::vector<f64>());
+
+        const size_t elementSize = (size_t)componentSize(view.componentType) * view.components;
+        const size_t viewOffset = bufferViewJson.value("byteOffset", (size_t)0);
+        const size_t viewLength = bufferViewJson.value("byteLength", (size_t)0);
+        const size_t offset = accessor.value("byteOffset", (size_t)0);
+        view.stride = bufferViewJson.value("byteStride", elementSize);
+
+        // every element inside the buffer view and the BIN chunk, without overflowing on huge values
+        if (elementSize == 0 || view.stride < elementSize) {
+            spdlog::error("Accessor {} has an invalid type or stride", index);
+            return false;
+        }
+        if (viewOffset > binSize || viewLength > binSize - viewOffset || offset > viewLength || elementSize > viewLength - offset ||
+            (view.count > 0 && view.count - 1 > (viewLength - offset - elementSize) / view.stride)) {
+            spdlog::error("Accessor {} out of the BIN chunk", index);
+            return false;
+        }
+
+        view.data = bin + viewOffset + offset;
+        return true;
+    }
+}
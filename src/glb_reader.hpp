@@ -0,0 +1,80 @@
+#pragma once
+
+#include "types.hpp"
+#include "mapped_file.hpp"
+#include "json.hpp"
+#include <string>
+#include <vector>
+
+namespace ay
+{
+    struct AccessorView {
+        const u8* data; // first element
+        size_t count;
+        size_t stride; // bytes between two elements
+        u32 componentType; // GL type
+        u32 components;
+        bool normalized;
+        std::vector<f64> minValues;
+        std::vector<f64> maxValues;
+    };
+
+    class GlbReader {
+    public:
+        ///
+        /// @brief Constructor
+        ///
+        GlbReader()
+            : file(),
+            json(),
+            bin(nullptr),
+            binSize(0)
+        {
+        }
+
+        ///
+        /// @brief Map a binary glTF and parse its JSON chunk, the BIN chunk is read in place
+        /// @param filename Filename
+        /// @return False if the file is not a GLB with every buffer in its BIN chunk
+        ///
+        bool open(const std::string& filename);
+
+        ///
+        /// @brief Get the glTF document
+        /// @return JSON
+        ///
+        inline const nlohmann::json& getJson() const {
+            return json;
+        }
+
+        ///
+        /// @brief Get an array of the document (empty if missing)
+        /// @param name Array name (nodes, meshes, ...)
+        /// @return Array
+        ///
+        const nlohmann::json& getArray(const std::string& name) const;
+
+        ///
+        /// @brief Point to the elements of an accessor in the mapped file
+        /// @param index Accessor index
+        /// @param view Output, view
+        /// @return False if the accessor is invalid or has no buffer view
+        ///
+        bool getAccessor(i32 index, AccessorView& view) const;
+
+        ///
+        /// @brief Point to the bytes of a buffer view in the mapped file (embedded images)
+        /// @param index Buffer view index
+        /// @param data Output, first byte
+        /// @param size Output, size in bytes
+        /// @return False if the buffer view is invalid
+        ///
+        bool getBufferView(i32 index, const u8*& data, size_t& size) const;
+
+    private:
+        MappedFile file;
+        nlohmann::json json;
+        const u8* bin; // BIN chunk in the mapped file
+        size_t binSize;
+    };
+}
@@ -0,0 +1,333 @@
+#include "ktx2.hpp"
+#include "etc_encoder.hpp"
+#include "thread_pool.hpp"
+#include <spdlog/spdlog.h>
+#include <stb_image.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace ay
+{
+    static const u8 KTX2_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+    // identifier, 9 header fields, then the index (dfd and kvd 32-bit, sgd 64-bit)
+    static constexpr size_t KTX2_HEADER_SIZE = 80;
+    static constexpr size_t KTX2_LEVEL_SIZE = 24;
+
+    // key of the orientation metadata, with its null terminator, its value is "rd" (top row first) or "ru"
+    static const char KTX2_ORIENTATION[15] = "KTXorientation";
+
+    static constexpr u32 VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK = 147;
+    static constexpr u32 VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK = 151;
+    static constexpr u32 VK_FORMAT_ASTC_4x4_UNORM_BLOCK = 157;
+    static constexpr u32 VK_FORMAT_ASTC_12x12_SRGB_BLOCK = 184;
+
+    // block dimensions of the ASTC formats, in the order of their Vulkan and OpenGL enums
+    static const u32 ASTC_BLOCKS[14][2] = {
+        { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+        { 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 }
+    };
+
+    ///
+    /// @brief Get the OpenGL format of a Vulkan format with its block size
+    /// @param vkFormat Vulkan format
+    /// @param blockWidth Output, block width in texels
+    /// @param blockHeight Output, block height in texels
+    /// @param blockSize Output, block size in bytes
+    /// @return OpenGL compressed format (0 if not supported)
+    ///
+    static GLenum glFormat(u32 vkFormat, u32& blockWidth, u32& blockHeight, u32& blockSize) {
+        static const GLenum ETC_FORMATS[10] = {
+            GL_COMPRESSED_RGB8_ETC2, GL_COMPRESSED_SRGB8_ETC2,
+            GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2, GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2,
+            GL_COMPRESSED_RGBA8_ETC2_EAC, GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC,
+            GL_COMPRESSED_R11_EAC, GL_COMPRESSED_SIGNED_R11_EAC,
+            GL_COMPRESSED_RG11_EAC, GL_COMPRESSED_SIGNED_RG11_EAC
+        };
+        static const u32 ETC_BLOCK_SIZES[10] = { 8, 8, 8, 8, 16, 16, 8, 8, 16, 16 };
+
+        if (vkFormat >= VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK && vkFormat < VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK + 10) {
+            blockWidth = 4;
+            blockHeight = 4;
+            blockSize = ETC_BLOCK_SIZES[vkFormat - VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK];
+            return ETC_FORMATS[vkFormat - VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK];
+        }
+        if (vkFormat >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && vkFormat <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+            // unorm and srgb alternate
+            const u32 block = (vkFormat - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2;
+            const bool srgb = (vkFormat - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) % 2 == 1;
+            blockWidth = ASTC_BLOCKS[block][0];
+            blockHeight = ASTC_BLOCKS[block][1];
+            blockSize = 16;
+            return (GLenum)((srgb ? GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4 : GL_COMPRESSED_RGBA_ASTC_4x4) + block);
+        }
+        return 0;
+    }
+
+    ///
+    /// @brief Read a little-endian 32-bit field
+    ///
+    static inline u32 readU32(const u8* data) {
+        u32 value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    ///
+    /// @brief Read a little-endian 64-bit field
+    ///
+    static inline unsigned long long readU64(const u8* data) {
+        unsigned long long value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    ///
+    /// @brief Append a little-endian 32-bit field
+    ///
+    static inline void writeU32(std::vector<u8>& file, u32 value) {
+        const u8* bytes = reinterpret_cast<const u8*>(&value);
+        file.insert(file.end(), bytes, bytes + sizeof(value));
+    }
+
+    ///
+    /// @brief Append a little-endian 64-bit field
+    ///
+    static inline void writeU64(std::vector<u8>& file, unsigned long long value) {
+        const u8* bytes = reinterpret_cast<const u8*>(&value);
+        file.insert(file.end(), bytes, bytes + sizeof(value));
+    }
+
+    bool Ktx2Texture::isKtx2(const u8* data, size_t size) {
+        return size >= sizeof(KTX2_IDENTIFIER) && std::memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0;
+    }
+
+    bool Ktx2Texture::read(const u8* data, size_t size, Ktx2Image& image) {
+        if (!isKtx2(data, size) || size < KTX2_HEADER_SIZE) {
+            return false;
+        }
+
+        const u32 vkFormat = readU32(data + 12);
+        const u32 width = readU32(data + 20);
+        const u32 height = readU32(data + 24);
+        const u32 depth = readU32(data + 28);
+        const u32 layers = readU32(data + 32);
+        const u32 faces = readU32(data + 36);
+        const u32 levelCount = std::max(readU32(data + 40), 1u);
+        const u32 supercompression = readU32(data + 44);
+        if (supercompression != 0 || vkFormat == 0) {
+            // Basis Universal (or zstd) data needs a transcoder
+            spdlog::warn("KTX2 supercompression {} (format {}) is not supported", supercompression, vkFormat);
+            return false;
+        }
+
+        u32 blockWidth, blockHeight, blockSize;
+        const GLenum format = glFormat(vkFormat, blockWidth, blockHeight, blockSize);
+        if (format == 0 || width == 0 || height == 0 || depth > 1 || layers > 1 || faces != 1 || levelCount > 32) {
+            spdlog::warn("KTX2 format {} ({}x{}x{}, {} layers, {} faces) is not supported", vkFormat, width, height, depth, layers, faces);
+            return false;
+        }
+        if (size < KTX2_HEADER_SIZE + levelCount * KTX2_LEVEL_SIZE) {
+            return false;
+        }
+
+        // key/value entries, each one a length then the key and the value (both null terminated) padded to 4 bytes
+        const u32 kvdOffset = readU32(data + 56);
+        const u32 kvdSize = readU32(data + 60);
+        if (kvdOffset > size || kvdSize > size - kvdOffset) {
+            spdlog::warn("KTX2 key/value data is corrupted");
+            return false;
+        }
+        bool bottomUp = false;
+        for (u32 entry = 0; entry + 4 <= kvdSize;) {
+            const u8* key = data + kvdOffset + entry + 4;
+            const u32 length = std::min(readU32(data + kvdOffset + entry), kvdSize - entry - 4);
+            if (length >= sizeof(KTX2_ORIENTATION) + 2 && std::memcmp(key, KTX2_ORIENTATION, sizeof(KTX2_ORIENTATION)) == 0) {
+                bottomUp = key[sizeof(KTX2_ORIENTATION) + 1] == 'u';
+            }
+            entry += 4 + ((length + 3) & ~3u);
+        }
+
+        image.format = format;
+        image.width = (i32)width;
+        image.height = (i32)height;
+        image.bottomUp = bottomUp;
+        image.levels.resize(levelCount);
+        for (u32 i = 0; i < levelCount; i++) {
+            const u8* level = data + KTX2_HEADER_SIZE + i * KTX2_LEVEL_SIZE;
+            const unsigned long long offset = readU64(level);
+            const unsigned long long length = readU64(level + 8);
+            const u32 levelWidth = std::max(width >> i, 1u);
+            const u32 levelHeight = std::max(height >> i, 1u);
+            const unsigned long long expected = (unsigned long long)((levelWidth + blockWidth - 1) / blockWidth) *
+                ((levelHeight + blockHeight - 1) / blockHeight) * blockSize;
+            if (length != expected || offset > size || length > size - offset) {
+                spdlog::warn("KTX2 level {} is corrupted", i);
+                image.format = 0;
+                image.levels.clear();
+                return false;
+            }
+            image.levels[i].offset = (size_t)offset;
+            image.levels[i].size = (size_t)length;
+        }
+        return true;
+    }
+
+    bool Ktx2Texture::write(const std::string& filename, const Ktx2Image& image, const u8* data) {
+        const bool alpha = image.format == GL_COMPRESSED_RGBA8_ETC2_EAC;
+        if (image.format != GL_COMPRESSED_RGB8_ETC2 && !alpha) {
+            spdlog::error("Only ETC2 RGB8 and RGBA8 textures can be written to {}", filename);
+            return false;
+        }
+
+        const u32 levelCount = (u32)image.levels.size();
+        const u32 samples = alpha ? 2 : 1;
+        const u32 dfdSize = 4 + 24 + 16 * samples;
+        const u32 dfdOffset = (u32)(KTX2_HEADER_SIZE + levelCount * KTX2_LEVEL_SIZE);
+        const u32 kvdSize = 4 + (((u32)sizeof(KTX2_ORIENTATION) + 3 + 3) & ~3u);
+
+        std::vector<u8> file(KTX2_IDENTIFIER, KTX2_IDENTIFIER + sizeof(KTX2_IDENTIFIER));
+        writeU32(file, alpha ? VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK : VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK);
+        writeU32(file, 1); // type size
+        writeU32(file, (u32)image.width);
+        writeU32(file, (u32)image.height);
+        writeU32(file, 0); // depth
+        writeU32(file, 0); // layers
+        writeU32(file, 1); // faces
+        writeU32(file, levelCount);
+        writeU32(file, 0); // supercompression
+        writeU32(file, dfdOffset);
+        writeU32(file, dfdSize);
+        writeU32(file, dfdOffset + dfdSize); // key/value data
+        writeU32(file, kvdSize);
+        writeU64(file, 0); // supercompression global data
+        writeU64(file, 0);
+
+        // level index, patched once the levels are placed
+        const size_t levelIndex = file.size();
+        file.resize(file.size() + levelCount * KTX2_LEVEL_SIZE);
+
+        // basic data format descriptor: ETC2 model, BT.709 primaries, linear, 4x4 blocks
+        writeU32(file, dfdSize);
+        writeU32(file, 0); // vendor and descriptor type
+        writeU32(file, 2 | ((24 + 16 * samples) << 16)); // version and block size
+        writeU32(file, 161 | (1 << 8) | (1 << 16)); // model, primaries, transfer, flags
+        writeU32(file, 3 | (3 << 8)); // block dimensions minus one
+        writeU32(file, alpha ? 16 : 8); // bytes per plane
+        writeU32(file, 0);
+        if (alpha) {
+            writeU32(file, 0 | (63 << 16) | (15u << 24)); // alpha in the first 64 bits
+            writeU32(file, 0);
+            writeU32(file, 0);
+            writeU32(file, 0xffffffff);
+        }
+        writeU32(file, (alpha ? 64 : 0) | (63 << 16) | (2u << 24)); // color
+        writeU32(file, 0);
+        writeU32(file, 0);
+        writeU32(file, 0xffffffff);
+
+        // orientation, the rows of every level go down or up
+        writeU32(file, (u32)sizeof(KTX2_ORIENTATION) + 3);
+        file.insert(file.end(), KTX2_ORIENTATION, KTX2_ORIENTATION + sizeof(KTX2_ORIENTATION));
+        file.push_back('r');
+        file.push_back(image.bottomUp ? 'u' : 'd');
+        file.push_back(0);
+        file.resize(dfdOffset + dfdSize + kvdSize);
+
+        // the smallest level first, each one aligned on the block size
+        for (u32 i = levelCount; i-- > 0;) {
+            file.resize((file.size() + 15) & ~(size_t)15);
+            const Ktx2Level& level = image.levels[i];
+            u8* entry = file.data() + levelIndex + i * KTX2_LEVEL_SIZE;
+            const unsigned long long offset = file.size();
+            const unsigned long long length = level.size;
+            std::memcpy(entry, &offset, sizeof(offset));
+            std::memcpy(entry + 8, &length, sizeof(length));
+            std::memcpy(entry + 16, &length, sizeof(length));
+            file.insert(file.end(), data + level.offset, data + level.offset + level.size);
+        }
+
+        std::ofstream out(filename, std::ofstream::binary);
+        if (!out.is_open()) {
+            spdlog::error("Failed to open {}", filename);
+            return false;
+        }
+
+        out.write(reinterpret_cast<const char*>(file.data()), (std::streamsize)file.size());
+        out.close();
+        if (!out) {
+            spdlog::error("Failed to write {}", filename);
+            return false;
+        }
+        return true;
+    }
+
+    bool Ktx2Texture::cook(const std::string& source, const std::string& destination, bool bottomUp, ThreadPool* threadPool) {
+        // stb gives the rows top to bottom, as the glTF texture coordinates expect
+        int width, height, channels;
+        stbi_uc* pixels = stbi_load(source.c_str(), &width, &height, &channels, 4);
+        if (!pixels) {
+            spdlog::error("cannot load data from {}", source);
+            return false;
+        }
+
+        const size_t rowSize = (size_t)width * 4;
+        std::vector<u8> level((size_t)height * rowSize);
+        for (int y = 0; y < height; y++) {
+            const int row = bottomUp ? height - 1 - y : y;
+            std::memcpy(level.data() + (size_t)y * rowSize, pixels + (size_t)row * rowSize, rowSize);
+        }
+        stbi_image_free(pixels);
+
+        bool alpha = false;
+        for (size_t i = 3; i < level.size() && !alpha; i += 4) {
+            alpha = level[i] != 255;
+        }
+
+        Ktx2Image image;
+        image.format = alpha ? GL_COMPRESSED_RGBA8_ETC2_EAC : GL_COMPRESSED_RGB8_ETC2;
+        image.width = width;
+        image.height = height;
+        image.bottomUp = bottomUp;
+        std::vector<u8> data;
+        u32 levelWidth = (u32)width, levelHeight = (u32)height;
+        while (true) {
+            const size_t size = EtcEncoder::compressedSize(levelWidth, levelHeight, alpha);
+            image.levels.push_back({ data.size(), size });
+            data.resize(data.size() + size);
+            EtcEncoder::compress(level.data(), levelWidth, levelHeight, alpha, data.data() + image.levels.back().offset, threadPool);
+            if (levelWidth == 1 && levelHeight == 1) {
+                break;
+            }
+
+            // box filter, the odd edge is clamped
+            const u32 nextWidth = std::max(levelWidth / 2, 1u);
+            const u32 nextHeight = std::max(levelHeight / 2, 1u);
+            std::vector<u8> next((size_t)nextWidth * nextHeight * 4);
+            for (u32 y = 0; y < nextHeight; y++) {
+                const u32 y0 = std::min(y * 2, levelHeight - 1);
+                const u32 y1 = std::min(y * 2 + 1, levelHeight - 1);
+                for (u32 x = 0; x < nextWidth; x++) {
+                    const u32 x0 = std::min(x * 2, levelWidth - 1);
+                    const u32 x1 = std::min(x * 2 + 1, levelWidth - 1);
+                    for (u32 c = 0; c < 4; c++) {
+                        const u32 sum = (u32)level[((size_t)y0 * levelWidth + x0) * 4 + c] + level[((size_t)y0 * levelWidth + x1) * 4 + c] +
+                            level[((size_t)y1 * levelWidth + x0) * 4 + c] + level[((size_t)y1 * levelWidth + x1) * 4 + c];
+                        next[((size_t)y * nextWidth + x) * 4 + c] = (u8)((sum + 2) / 4);
+                    }
+                }
+            }
+            level.swap(next);
+            levelWidth = nextWidth;
+            levelHeight = nextHeight;
+        }
+
+        if (!write(destination, image, data.data())) {
+            return false;
+        }
+        spdlog::info("Cooked {} into {} ({}x{}, {} levels, {} KB)", source, destination,
+            width, height, image.levels.size(), data.size() / 1024);
+        return true;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "types.hpp"
+#include <glad.h>
+#include <string>
+#include <vector>
+
+namespace ay
+{
+    class ThreadPool;
+
+    struct Ktx2Level {
+        size_t offset; // in the file
+        size_t size;
+    };
+
+    struct Ktx2Image {
+        GLenum format = 0; // compressed GL internal format, 0 if none
+        i32 width = 0;
+        i32 height = 0;
+        bool bottomUp = false; // KTXorientation "ru", the first row is the bottom one (top one by default)
+        std::vector<Ktx2Level> levels; // mip chain, the largest first
+    };
+
+    class Ktx2Texture {
+    public:
+        ///
+        /// @brief Check the file identifier
+        /// @param data File
+        /// @param size File size
+        /// @return True if the file is a KTX2
+        ///
+        static bool isKtx2(const u8* data, size_t size);
+
+        ///
+        /// @brief Read a KTX2 holding an ETC2, EAC or ASTC 2D texture, its levels are uploaded as they are stored
+        /// @param data File
+        /// @param size File size
+        /// @param image Output, format, orientation and levels
+        /// @return False if the file is invalid, supercompressed (Basis Universal) or of another format
+        ///
+        static bool read(const u8* data, size_t size, Ktx2Image& image);
+
+        ///
+        /// @brief Write an ETC2 RGB8 or RGBA8 texture
+        /// @param filename Filename
+        /// @param image Format, orientation and levels
+        /// @param data Levels, at the offsets of the image
+        /// @return False if the format is not ETC2 or the write failed
+        ///
+        static bool write(const std::string& filename, const Ktx2Image& image, const u8* data);
+
+        ///
+        /// @brief Compress an image (png, jpeg, ...) in ETC2 with its mip chain (RGBA8 if it has alpha, else RGB8)
+        /// @param source Image filename
+        /// @param destination KTX2 filename
+        /// @param bottomUp Store the bottom row first (Context::texture2DNew), else the top one (glTF models)
+        /// @param threadPool Compress in parallel (nullptr for serial)
+        /// @return False if the image cannot be read or the write failed
+        ///
+        static bool cook(const std::string& source, const std::string& destination, bool bottomUp, ThreadPool* threadPool);
+    };
+}
@@ -6,6 +6,25 @@
 
 namespace ay
 {
+    ///
+    /// @brief Light as stored in the lights uniform block (std140)
+    ///
+    struct LightData {
+        glm::vec4 position; // w: intensity
+        glm::vec4 color;
+    };
+
+    ///
+    /// @brief Lights uniform block (std140)
+    ///
+    struct LightsBlock {
+        i32 pointLightsCount;
+        i32 directionalLightsCount;
+        i32 padding[2];
+        LightData pointLights[16];
+        LightData directionalLights[8];
+    };
+
     class Light {
     public:
         ///
@@ -14,13 +33,80 @@ namespace ay
         Light()
             : position(0.f, 0.f, 0.f),
             color(0xffffffff),
-            intensity(1.f)
+            intensity(1.f),
+            dirty(true)
         {
         }
 
-    public:
+        ///
+        /// @brief Get position
+        /// @return Position
+        ///
+        inline const glm::vec3& getPosition() const {
+            return position;
+        }
+
+        ///
+        /// @brief Set position
+        /// @param position Position
+        ///
+        inline void setPosition(const glm::vec3& position) {
+            this->position = position;
+            dirty = true;
+        }
+
+        ///
+        /// @brief Get color
+        /// @return Color
+        ///
+        inline const Color& getColor() const {
+            return color;
+        }
+
+        ///
+        /// @brief Set color
+        /// @param color Color
+        ///
+        inline void setColor(const Color& color) {
+            this->color = color;
+            dirty = true;
+        }
+
+        ///
+        /// @brief Get intensity
+        /// @return Intensity
+        ///
+        inline f32 getIntensity() const {
+            return intensity;
+        }
+
+        ///
+        /// @brief Set intensity
+        /// @param intensity Intensity
+        ///
+        inline void setIntensity(f32 intensity) {
+            this->intensity = intensity;
+            dirty = true;
+        }
+
+        ///
+        /// @brief Pack the light for the lights uniform block
+        /// @return Packed light
+        ///
+        inline LightData toData() const {
+            LightData data;
+            data.position = glm::vec4(position, intensity);
+            data.color = color.toVec();
+            return data;
+        }
+
+    private:
+        friend class Scene;
+
+    private:
         glm::vec3 position;
         Color color;
         f32 intensity;
+        bool dirty;
     };
-}
\ No newline at end of file
+}
@@ -5,26 +5,112 @@
 using namespace ay;
 
 void renderScene(Scene* scene, f32 deltaTime) {
-    auto ctx = scene->getContext();
     static f32 angle;
-    
+
+    angle += deltaTime * 100.f;
+    auto model = scene->getModel("Duck");
+    model->transform.rotation = glm::quat(glm::vec3(0.f, glm::radians(angle), 0.f));
+    model->render(deltaTime);
+
+    scene->getInstances("Ducks")->render(deltaTime);
+}
+
+void renderUI(Scene* scene, f32 deltaTime) {
+    static std::vector<u8> depthPixels;
+    auto ctx = scene->getContext();
+
     ctx->uiBegin();
     enum ImGuiWindowFlags_ flags = static_cast<enum ImGuiWindowFlags_>(ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoBringToFrontOnFocus | ImGuiWindowFlags_NoTitleBar);
+    auto stateStatistics = ctx->getStateStatistics();
+    ctx->resetStateStatistics();
+    auto cullingStatistics = ctx->getRenderQueue()->getCullingStatistics();
+    ctx->getRenderQueue()->resetCullingStatistics();
+    OcclusionCuller* occlusion = ctx->getRenderQueue()->getOcclusionCuller();
+    OcclusionStatistics occlusionStatistics = {};
+    if (occlusion) {
+        occlusionStatistics = occlusion->getStatistics();
+        occlusion->resetStatistics();
+    }
+
+    // the software depth buffer of the last frame, shown in the window
+    DepthRasterizer* rasterizer = ctx->getRenderQueue()->getDepthRasterizer();
+    DepthRasterizerStatistics rasterizerStatistics = {};
+    if (rasterizer) {
+        rasterizerStatistics = rasterizer->getStatistics();
+        rasterizer->resetStatistics();
+
+        Texture2DParameters params;
+        params.min = GL_NEAREST;
+        params.mag = GL_NEAREST;
+        params.width = (int)rasterizer->getWidth();
+        params.height = (int)rasterizer->getHeight();
+        if (ctx->texture2DGet("depthRasterizer") == 0) {
+            ctx->texture2DNew("depthRasterizer", params);
+        }
+        rasterizer->debugImage(depthPixels);
+        ctx->texture2DUpdate("depthRasterizer", params, depthPixels.data());
+    }
     ctx->uiCreateWindow("Informations", [&] {
         std::stringstream fps;
         fps << "FPS: " << 1.f / deltaTime;
         ImGui::TextColored(ImVec4(1, 1, 0, 1), fps.str().c_str());
+
+        Model* duck = scene->getModel("Duck");
+        if (!duck->isReady()) {
+            std::stringstream loading;
+            loading << "Loading: " << (i32)(duck->getLoadProgress() * 100.f) << "%";
+            ImGui::TextColored(ImVec4(1, 1, 0, 1), loading.str().c_str());
+        }
+
+        std::stringstream binds;
+        binds << "Binds: " << stateStatistics.issued << " issued, " << stateStatistics.skipped << " skipped";
+        ImGui::TextColored(ImVec4(1, 1, 0, 1), binds.str().c_str());
+
+        std::stringstream culling;
+        culling << "Culled: " << cullingStatistics.culled << " / " << cullingStatistics.meshes << " meshes (" << cullingStatistics.tests << " tests)";
+        ImGui::TextColored(ImVec4(1, 1, 0, 1), culling.str().c_str());
+
+        f32 lodBias = ctx->getRenderQueue()->getLodBias();
+        if (ImGui::SliderFloat("LOD bias", &lodBias, -2.f, 4.f)) {
+            ctx->getRenderQueue()->setLodBias(lodBias);
+        }
+
+        bool occlusionCulling = occlusion != nullptr;
+        if (ImGui::Checkbox("Occlusion culling", &occlusionCulling)) {
+            ctx->getRenderQueue()->setOcclusionCulling(occlusionCulling);
+        }
+        if (occlusion) {
+            std::stringstream queries;
+            queries << "Occlusion: " << occlusionStatistics.occluded << " occluded, " << occlusionStatistics.queries << " queries, "
+                << occlusionStatistics.stallsAvoided << " stalls avoided";
+            ImGui::TextColored(ImVec4(1, 1, 0, 1), queries.str().c_str());
+        }
+
+        bool softwareOcclusion = rasterizer != nullptr;
+        if (ImGui::Checkbox("Software occlusion", &softwareOcclusion)) {
+            ctx->getRenderQueue()->setSoftwareOcclusion(softwareOcclusion);
+        }
+        if (rasterizer) {
+            std::stringstream software;
+            software << "Occluders: " << rasterizerStatistics.occluders << " (" << rasterizerStatistics.triangles << " triangles, "
+                << rasterizerStatistics.skipped << " over budget), " << rasterizerStatistics.milliseconds << " ms";
+            ImGui::TextColored(ImVec4(1, 1, 0, 1), software.str().c_str());
+
+            std::stringstream tests;
+            tests << "Occluded: " << rasterizerStatistics.occluded << " / " << rasterizerStatistics.tests << " boxes";
+            ImGui::TextColored(ImVec4(1, 1, 0, 1), tests.str().c_str());
+
+            i32 budget = (i32)rasterizer->getTriangleBudget();
+            if (ImGui::SliderInt("Triangle budget", &budget, 0, 100000)) {
+                rasterizer->setTriangleBudget((u32)budget);
+            }
+
+            // bottom row first
+            ImGui::Image((ImTextureID)(intptr_t)ctx->texture2DGet("depthRasterizer"),
+                ImVec2((f32)rasterizer->getWidth(), (f32)rasterizer->getHeight()), ImVec2(0, 1), ImVec2(1, 0));
+        }
     }, flags);
     ctx->uiEnd();
-
-    angle += deltaTime * 100.f;
-    auto model = scene->getModel("Duck");
-    model->transform.rotation = glm::quat(glm::vec3(0.f, glm::radians(angle), 0.f));
-    model->render(deltaTime);
-
-    model->transform.position.x = 3.f;
-    model->transform.rotation = glm::quat(glm::vec3(0));
-    model->render(deltaTime);
 }
 
 void destroyScene(Scene* scene) {
@@ -37,19 +123,33 @@ int main(void)
     Context* ctx = window.getContext();
     Scene scene(ctx);
 
-    Model* model = scene.createModel("Duck", "../../assets/Duck.glb");
+    Light* light = scene.createPointLight();
+    light->setPosition(glm::vec3(0.f, 5.f, 5.f));
+    light->setColor(Color::white());
+    light->setIntensity(8.f);
+
+    ModelImportOptions options;
+    options.optimize = true;
+    Model* model = scene.createModelAsync("Duck", "../../assets/Duck.glb", options);
     model->transform.position.z = 5.f;
     model->transform.scale = glm::vec3(.5f);
+    model->setOccluder(true);
+
+    // a grid of colored ducks behind the first one, drawn with one draw per mesh
+    ModelInstances* ducks = scene.createInstances("Ducks", "Duck");
+    for (i32 x = -10; x < 10; x++) {
+        for (i32 z = 0; z < 20; z++) {
+            Transform transform;
+            transform.position = glm::vec3((f32)x * 3.f, 0.f, (f32)z * -3.f);
+            ducks->add(transform, Color(((f32)x + 10.f) / 20.f, 1.f, (f32)z / 20.f));
+        }
+    }
 
     scene.createFreeCamera("mainCamera", 90.f, 0.1f, 100.f);
     scene.setMainCamera("mainCamera");
 
-    Light* light = scene.createPointLight();
-    light->position = glm::vec3(0.f, 5.f, 5.f);
-    light->color = Color::white();
-    light->intensity = 8.f;
-
     scene.onRender = renderScene;
+    scene.onRenderUI = renderUI;
     scene.onDestroy = destroyScene;
 
     auto start = std::chrono::steady_clock::now();
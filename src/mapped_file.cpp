@@ -0,0 +1,115 @@
+#include "mapped_file.hpp"
+#include <spdlog/spdlog.h>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ay
+{
+    MappedFile::MappedFile()
+        : data(nullptr),
+        size(0)
+#ifdef _WIN32
+        , file(INVALID_HANDLE_VALUE),
+        mapping(nullptr)
+#endif
+    {
+    }
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+#ifdef _WIN32
+    bool MappedFile::open(const std::string& filename) {
+        close();
+
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            spdlog::error("Failed to open {}", filename);
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            spdlog::error("Failed to map {} (empty)", filename);
+            close();
+            return false;
+        }
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (view == nullptr) {
+            spdlog::error("Failed to map {}", filename);
+            close();
+            return false;
+        }
+
+        data = (const u8*)view;
+        size = (size_t)fileSize.QuadPart;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        data = nullptr;
+        size = 0;
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+    }
+#else
+    bool MappedFile::open(const std::string& filename) {
+        close();
+
+        const int file = ::open(filename.c_str(), O_RDONLY);
+        if (file < 0) {
+            spdlog::error("Failed to open {}", filename);
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(file, &info) != 0 || info.st_size == 0) {
+            spdlog::error("Failed to map {} (empty)", filename);
+            ::close(file);
+            return false;
+        }
+
+        // the mapping keeps its own reference to the file
+        void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        ::close(file);
+        if (view == MAP_FAILED) {
+            spdlog::error("Failed to map {}", filename);
+            return false;
+        }
+        madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+        data = (const u8*)view;
+        size = (size_t)info.st_size;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (data) {
+            munmap((void*)data, size);
+        }
+        data = nullptr;
+        size = 0;
+    }
+#endif
+}
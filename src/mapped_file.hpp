@@ -0,0 +1,60 @@
+#pragma once
+
+#include "types.hpp"
+#include <string>
+
+namespace ay
+{
+    class MappedFile {
+    public:
+        ///
+        /// @brief Constructor (nothing mapped)
+        ///
+        MappedFile();
+
+        ///
+        /// @brief Destructor
+        ///
+        ~MappedFile();
+
+        ///
+        /// @brief Map a file read-only in memory
+        /// @param filename Filename
+        /// @return True if mapped
+        ///
+        bool open(const std::string& filename);
+
+        ///
+        /// @brief Unmap the file
+        ///
+        void close();
+
+        ///
+        /// @brief Get the mapped bytes (the pages are read on first access)
+        /// @return Data (nullptr if not mapped)
+        ///
+        inline const u8* getData() const {
+            return data;
+        }
+
+        ///
+        /// @brief Get the file size
+        /// @return Size in bytes
+        ///
+        inline size_t getSize() const {
+            return size;
+        }
+
+    private:
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+
+    private:
+        const u8* data;
+        size_t size;
+#ifdef _WIN32
+        void* file;
+        void* mapping;
+#endif
+    };
+}
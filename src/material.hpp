@@ -7,6 +7,21 @@
 
 namespace ay
 {
+    ///
+    /// @brief Number of materials in a table of the materials uniform block (std140, 12 KB, within the 16 KB
+    /// every implementation allows), a model with more materials binds one table per draw
+    ///
+    constexpr u32 MATERIALS_PER_TABLE = 256;
+
+    ///
+    /// @brief Material as stored in the materials uniform block (std140)
+    ///
+    struct MaterialData {
+        glm::vec4 baseColor;
+        glm::vec4 emissiveFactor;
+        glm::vec4 factors; // x: metallic, y: roughness, z: alpha cutoff
+    };
+
     class Material {
     public:
         ///
@@ -49,6 +64,18 @@ namespace ay
                 doubleSided == m.doubleSided;
         }
 
+        ///
+        /// @brief Pack the material for the materials uniform block
+        /// @return Packed material
+        ///
+        inline MaterialData toData() const {
+            MaterialData data;
+            data.baseColor = baseColor.toVec();
+            data.emissiveFactor = emissiveFactor.toVec();
+            data.factors = glm::vec4(metallicFactor, roughnessFactor, alphaCutoff, 0.f);
+            return data;
+        }
+
     public:
         std::string name;
         Color baseColor;
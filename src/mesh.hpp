@@ -3,12 +3,24 @@
 #include "types.hpp"
 #include "context.hpp"
 #include "transform.hpp"
+#include "bounds.hpp"
+#include "geometry_arena.hpp"
 #include <string>
-#include <array>
 #include <vector>
 
 namespace ay
 {
+    struct MeshLod {
+        u32 firstIndex; // relative to the first index of the mesh
+        u32 indexCount;
+        f32 error; // simplification error relative to the radius of the mesh
+    };
+
+    struct OccluderMesh {
+        std::vector<glm::vec3> positions;
+        std::vector<u32> indices; // triangles, empty if the mesh is not low-poly enough to occlude
+    };
+
     class Mesh {
     public:
         ///
@@ -17,123 +29,147 @@ namespace ay
         ///
         Mesh(Context* ctx)
             : ctx(ctx),
-            vao(0),
-            buffers(),
+            arena(nullptr),
+            range(),
             verticesCount(0),
             normalsCount(0),
             texcoordsCount(0),
             colorsCount(0),
             indicesCount(0),
             drawMode(GL_TRIANGLES),
-            drawType(GL_UNSIGNED_INT)
+            bounds(),
+            lods(),
+            occluder()
         {
-            vao = ctx->vaoNew();
-            buffers[0] = ctx->bufferNew(); // indices
-            buffers[1] = ctx->bufferNew(); // positions
-            buffers[2] = ctx->bufferNew(); // normals
-            buffers[3] = ctx->bufferNew(); // uvs
-            buffers[4] = ctx->bufferNew(); // colors
         }
 
         ///
         /// @brief Destructor
         ///
         ~Mesh() {
-            ctx->vaoDispose(vao);
-            for (auto buffer : buffers) {
-                ctx->bufferDispose(buffer);
+            if (arena) {
+                arena->free(range);
             }
         }
 
         ///
-        /// @brief Render called each frame
+        /// @brief Upload the geometry to the geometry arena of its layout
+        /// @param data Vertices and indices
+        /// @param layout Vertex layout
         ///
-        inline void render() {
-            ctx->vaoUse(vao);
-            ctx->bufferUse<BufferUsage::ELEMENT>(buffers[0]);
-            ctx->draw(DrawMethod::ELEMENT, DrawParameters(drawMode, drawType, indicesCount, nullptr));
-            ctx->bufferUse<BufferUsage::ELEMENT>(0);
-            ctx->vaoUse(0);
+        inline void upload(const MeshData& data, const VertexLayout& layout) {
+            if (arena) {
+                arena->free(range);
+            }
+            arena = ctx->getGeometryArena(layout);
+            range = arena->allocate(data);
+            verticesCount = range.vertexCount;
+            indicesCount = range.indexCount;
+            lods.assign(1, MeshLod{ 0, range.indexCount, 0.f });
         }
 
         ///
-        /// @brief Compute the normals
-        /// 
-        inline void computeNormals() {
-            // Normals
-            std::vector<f32> normals;
-            normals.resize(3 * (size_t)normalsCount);
-
-            // Indices
-            ctx->bufferUse<BufferUsage::ELEMENT>(buffers[0]);
-            u32* dataIndex = reinterpret_cast<u32*>(ctx->bufferGetSubData<BufferUsage::ELEMENT>(0, indicesCount * sizeof(u32)));
-
-            // Positions
-            ctx->bufferUse<BufferUsage::ARRAY>(buffers[1]);
-            f32* dataPosition = reinterpret_cast<f32*>(ctx->bufferGetSubData<BufferUsage::ARRAY>(0, verticesCount * sizeof(f32) * 3));
+        /// @brief Upload geometry already in the vertex layout (cooked), without any conversion
+        /// @param layout Vertex layout
+        /// @param vertices Vertices (vertexCount * stride bytes)
+        /// @param vertexCount Number of vertices
+        /// @param indices Indices
+        /// @param indexCount Number of indices
+        ///
+        inline void upload(const VertexLayout& layout, const u8* vertices, u32 vertexCount, const u32* indices, u32 indexCount) {
+            if (arena) {
+                arena->free(range);
+            }
+            arena = ctx->getGeometryArena(layout);
+            range = arena->allocate(vertices, vertexCount, indices, indexCount);
+            verticesCount = range.vertexCount;
+            indicesCount = range.indexCount;
+            lods.assign(1, MeshLod{ 0, range.indexCount, 0.f });
+        }
 
-            for (size_t i = 0; i < indicesCount; i += 3) {
-                const size_t i1 = (size_t)dataIndex[i];
-                const size_t i2 = (size_t)dataIndex[i + 1];
-                const size_t i3 = (size_t)dataIndex[i + 2];
+        ///
+        /// @brief Set the levels of detail stored after the full mesh in the uploaded indices
+        /// @param levels Levels of detail, the full mesh first
+        ///
+        inline void setLods(const std::vector<MeshLod>& levels) {
+            lods = levels;
+            indicesCount = lods[0].indexCount;
+        }
 
-                const f32 x1 = dataPosition[i1 * 3];
-                const f32 y1 = dataPosition[i1 * 3 + 1];
-                const f32 z1 = dataPosition[i1 * 3 + 2];
+        ///
+        /// @brief Keep a copy of some triangles on the CPU for the software depth rasterizer
+        /// @param data Vertices and indices
+        /// @param firstIndex First index of the triangles
+        /// @param indexCount Number of indices
+        ///
+        inline void setOccluder(const MeshData& data, u32 firstIndex, u32 indexCount) {
+            // only the used positions are kept
+            std::vector<u32> remap(data.vertices.size(), ~0u);
+            occluder.positions.clear();
+            occluder.indices.resize(indexCount);
+            for (u32 i = 0; i < indexCount; i++) {
+                u32& vertex = remap[data.indices[firstIndex + i]];
+                if (vertex == ~0u) {
+                    vertex = (u32)occluder.positions.size();
+                    occluder.positions.push_back(data.vertices[data.indices[firstIndex + i]].position);
+                }
+                occluder.indices[i] = vertex;
+            }
+        }
 
-                const f32 x2 = dataPosition[i2 * 3];
-                const f32 y2 = dataPosition[i2 * 3 + 1];
-                const f32 z2 = dataPosition[i2 * 3 + 2];
+        ///
+        /// @brief Render called each frame
+        ///
+        inline void render() {
+            ctx->vaoUse(arena->getVao());
+            ctx->draw(DrawMethod::ELEMENT_BASE_VERTEX, DrawParameters(drawMode, GL_UNSIGNED_INT, (GLsizei)indicesCount,
+                (GLvoid*)((size_t)range.firstIndex * sizeof(u32)), 0, (GLint)range.baseVertex));
+        }
 
-                const f32 x3 = dataPosition[i3 * 3];
-                const f32 y3 = dataPosition[i3 * 3 + 1];
-                const f32 z3 = dataPosition[i3 * 3 + 2];
+        ///
+        /// @brief Check if the normals are octahedral encoded
+        /// @return True if encoded
+        ///
+        inline bool hasOctNormals() const {
+            return arena && arena->getLayout().hasOctNormals();
+        }
 
-                glm::vec3 v1 = glm::vec3(x1, y1, z1);
-                glm::vec3 v2 = glm::vec3(x2, y2, z2);
-                glm::vec3 v3 = glm::vec3(x3, y3, z3);
-                glm::vec3 u = v2 - v1;
-                glm::vec3 v = v3 - v1;
+        ///
+        /// @brief Compute flat normals
+        /// @param data Vertices and indices (triangles)
+        ///
+        static inline void computeNormals(MeshData& data) {
+            for (size_t i = 0; i + 2 < data.indices.size(); i += 3) {
+                Vertex& v1 = data.vertices[data.indices[i]];
+                Vertex& v2 = data.vertices[data.indices[i + 1]];
+                Vertex& v3 = data.vertices[data.indices[i + 2]];
+                glm::vec3 u = v2.position - v1.position;
+                glm::vec3 v = v3.position - v1.position;
                 glm::vec3 normal = glm::normalize(glm::cross(u, v));
-
-                normals[i1 * 3] = normal.x;
-                normals[i1 * 3 + 1] = normal.y;
-                normals[i1 * 3 + 2] = normal.z;
-
-                normals[i2 * 3] = normal.x;
-                normals[i2 * 3 + 1] = normal.y;
-                normals[i2 * 3 + 2] = normal.z;
-
-                normals[i3 * 3] = normal.x;
-                normals[i3 * 3 + 1] = normal.y;
-                normals[i3 * 3 + 2] = normal.z;
+                v1.normal = normal;
+                v2.normal = normal;
+                v3.normal = normal;
             }
-
-            // Clean all and save data
-            ctx->bufferUnmap<BufferUsage::ARRAY>();
-            ctx->bufferUse<BufferUsage::ARRAY>(buffers[2]);
-            f32* ptr = reinterpret_cast<f32*>(ctx->bufferSetSubData<BufferUsage::ARRAY>(0, normalsCount * sizeof(f32) * 3));
-            std::copy(normals.begin(), normals.end(), ptr);
-            ctx->bufferUnmap<BufferUsage::ARRAY>();
-            ctx->bufferUse<BufferUsage::ELEMENT>(buffers[0]);
-            ctx->bufferUnmap<BufferUsage::ELEMENT>();
-            ctx->bufferUse<BufferUsage::ELEMENT>(0);
         }
 
     private:
         friend class Model;
         friend class ModelNode;
+        friend class ModelInstances;
+        friend class CookedModel;
 
     private:
         Context* ctx;
-        VAO vao;
-        std::array<Buffer, 5> buffers;
+        GeometryArena* arena;
+        GeometryRange range;
         u32 verticesCount;
         u32 normalsCount;
         u32 texcoordsCount;
         u32 colorsCount;
         u32 indicesCount;
         GLenum drawMode;
-        GLenum drawType;
+        BoundingBox bounds; // local bounds
+        std::vector<MeshLod> lods;
+        OccluderMesh occluder; // kept on the CPU for the software depth rasterizer
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,340 @@
+#include "mesh_optimizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace ay
+{
+    const u32 MeshOptimizer::CACHE_SIZE;
+
+    // Forsyth scoring, the cache is larger than the simulated FIFO as in the original article
+    static const u32 SCORE_CACHE_SIZE = 32;
+    static const f32 LAST_TRIANGLE_SCORE = 0.75f;
+    static const f32 CACHE_DECAY_POWER = 1.5f;
+    static const f32 VALENCE_BOOST_SCALE = 2.f;
+    static const f32 VALENCE_BOOST_POWER = 0.5f;
+
+    ///
+    /// @brief Score of a vertex
+    /// @param cachePosition Position in the cache (-1 if not in the cache)
+    /// @param remaining Number of triangles not emitted using the vertex
+    /// @return Score
+    ///
+    static f32 vertexScore(i32 cachePosition, u32 remaining) {
+        if (remaining == 0) {
+            return -1.f;
+        }
+
+        f32 score = 0.f;
+        if (cachePosition >= 0) {
+            if (cachePosition < 3) {
+                // the vertices of the last triangle get a fixed score so the strip direction does not matter
+                score = LAST_TRIANGLE_SCORE;
+            }
+            else {
+                const f32 scale = 1.f / (f32)(SCORE_CACHE_SIZE - 3);
+                score = std::pow(1.f - (f32)(cachePosition - 3) * scale, CACHE_DECAY_POWER);
+            }
+        }
+
+        // favour the vertices with few triangles left, to finish them and avoid lonely triangles
+        return score + VALENCE_BOOST_SCALE * std::pow((f32)remaining, -VALENCE_BOOST_POWER);
+    }
+
+    class FifoCache {
+    public:
+        FifoCache(u32 vertexCount)
+            : stamps(vertexCount, 0),
+            time(MeshOptimizer::CACHE_SIZE + 1)
+        {
+        }
+
+        ///
+        /// @brief Access a vertex
+        /// @param vertex Vertex index
+        /// @return True on a miss
+        ///
+        inline bool access(u32 vertex) {
+            if (time - stamps[vertex] > MeshOptimizer::CACHE_SIZE) {
+                stamps[vertex] = time++;
+                return true;
+            }
+            return false;
+        }
+
+        ///
+        /// @brief Access the vertices of a triangle
+        /// @param indices Triangle indices
+        /// @return Number of misses
+        ///
+        inline u32 access(const u32* indices) {
+            return (u32)access(indices[0]) + (u32)access(indices[1]) + (u32)access(indices[2]);
+        }
+
+        ///
+        /// @brief Empty the cache
+        ///
+        inline void reset() {
+            time += MeshOptimizer::CACHE_SIZE + 1;
+        }
+
+    private:
+        std::vector<u32> stamps;
+        u32 time;
+    };
+
+    void MeshOptimizer::optimizeVertexCache(std::vector<u32>& indices, u32 vertexCount) {
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        // triangles of each vertex, the first remaining[v] entries are the ones not emitted
+        std::vector<u32> remaining(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            remaining[indices[i]]++;
+        }
+
+        std::vector<u32> offsets(vertexCount + 1, 0);
+        for (u32 v = 0; v < vertexCount; v++) {
+            offsets[v + 1] = offsets[v] + remaining[v];
+        }
+
+        std::vector<u32> adjacency(triangleCount * 3);
+        std::vector<u32> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            adjacency[cursor[indices[i]]++] = (u32)(i / 3);
+        }
+
+        std::vector<f32> vertexScores(vertexCount);
+        for (u32 v = 0; v < vertexCount; v++) {
+            vertexScores[v] = vertexScore(-1, remaining[v]);
+        }
+
+        std::vector<f32> triangleScores(triangleCount);
+        std::vector<bool> emitted(triangleCount, false);
+        for (size_t t = 0; t < triangleCount; t++) {
+            triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+        }
+
+        std::vector<u32> result;
+        result.reserve(triangleCount * 3);
+        std::vector<u32> cache, nextCache;
+        cache.reserve(SCORE_CACHE_SIZE + 3);
+        nextCache.reserve(SCORE_CACHE_SIZE + 3);
+
+        const size_t none = (size_t)-1;
+        size_t best = 0;
+        size_t scan = 0;
+        for (size_t n = 0; n < triangleCount; n++) {
+            if (best == none) {
+                // nothing adjacent to the cache, continue with the next triangle in input order
+                while (emitted[scan]) {
+                    scan++;
+                }
+                best = scan;
+            }
+
+            const u32* triangle = indices.data() + best * 3;
+            result.insert(result.end(), triangle, triangle + 3);
+            emitted[best] = true;
+
+            nextCache.clear();
+            for (u32 k = 0; k < 3; k++) {
+                const u32 v = triangle[k];
+                if (std::find(nextCache.begin(), nextCache.end(), v) != nextCache.end()) {
+                    continue;
+                }
+                nextCache.push_back(v);
+
+                // remove the triangle from the live triangles of the vertex
+                u32* first = adjacency.data() + offsets[v];
+                u32* last = first + remaining[v];
+                u32* it = std::find(first, last, (u32)best);
+                std::swap(*it, *(last - 1));
+                remaining[v]--;
+            }
+
+            for (auto v : cache) {
+                if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end()) {
+                    nextCache.push_back(v);
+                }
+            }
+
+            // refresh the scores of the vertices whose position changed, and of their triangles
+            for (size_t i = 0; i < nextCache.size(); i++) {
+                const u32 v = nextCache[i];
+                const i32 position = i < SCORE_CACHE_SIZE ? (i32)i : -1;
+
+                const f32 score = vertexScore(position, remaining[v]);
+                const f32 delta = score - vertexScores[v];
+                vertexScores[v] = score;
+                for (u32 a = offsets[v]; a < offsets[v] + remaining[v]; a++) {
+                    triangleScores[adjacency[a]] += delta;
+                }
+            }
+
+            if (nextCache.size() > SCORE_CACHE_SIZE) {
+                nextCache.resize(SCORE_CACHE_SIZE);
+            }
+            std::swap(cache, nextCache);
+
+            // the next triangle is the best one using a cached vertex (degenerate triangles stay listed once emitted)
+            best = none;
+            f32 bestScore = -1.f;
+            for (auto v : cache) {
+                for (u32 a = offsets[v]; a < offsets[v] + remaining[v]; a++) {
+                    const u32 t = adjacency[a];
+                    if (!emitted[t] && triangleScores[t] > bestScore) {
+                        bestScore = triangleScores[t];
+                        best = t;
+                    }
+                }
+            }
+        }
+
+        indices.swap(result);
+    }
+
+    void MeshOptimizer::optimizeOverdraw(std::vector<u32>& indices, const std::vector<Vertex>& vertices, f32 threshold) {
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        const u32 vertexCount = (u32)vertices.size();
+
+        // hard boundaries: the cache has been flushed, every vertex of the triangle misses
+        std::vector<size_t> hardClusters;
+        FifoCache cache(vertexCount);
+        for (size_t t = 0; t < triangleCount; t++) {
+            if (cache.access(&indices[t * 3]) == 3) {
+                hardClusters.push_back(t);
+            }
+        }
+        hardClusters.push_back(triangleCount);
+        if (hardClusters[0] != 0) {
+            hardClusters.insert(hardClusters.begin(), 0);
+        }
+
+        // soft boundaries: split where the cluster is at least as cache friendly as the whole hard cluster,
+        // the cache is assumed cold at the start of every cluster since they are reordered
+        std::vector<size_t> clusters;
+        for (size_t c = 0; c + 1 < hardClusters.size(); c++) {
+            const size_t start = hardClusters[c];
+            const size_t end = hardClusters[c + 1];
+
+            cache.reset();
+            u32 misses = 0;
+            for (size_t t = start; t < end; t++) {
+                misses += cache.access(&indices[t * 3]);
+            }
+            const f32 limit = (f32)misses / (f32)(end - start) * threshold;
+
+            cache.reset();
+            clusters.push_back(start);
+            size_t clusterStart = start;
+            misses = 0;
+            for (size_t t = start; t + 1 < end; t++) {
+                misses += cache.access(&indices[t * 3]);
+                if ((f32)misses / (f32)(t - clusterStart + 1) <= limit) {
+                    clusters.push_back(t + 1);
+                    clusterStart = t + 1;
+                    misses = 0;
+                    cache.reset();
+                }
+            }
+        }
+        clusters.push_back(triangleCount);
+
+        // area weighted centroid and normal of each cluster
+        const size_t clusterCount = clusters.size() - 1;
+        std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.f));
+        std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.f));
+        glm::vec3 meshCentroid(0.f);
+        f32 meshArea = 0.f;
+        for (size_t c = 0; c < clusterCount; c++) {
+            f32 area = 0.f;
+            for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+                const glm::vec3& p0 = vertices[indices[t * 3]].position;
+                const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+                const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+                const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                const f32 triangleArea = glm::length(normal);
+                centroids[c] += (p0 + p1 + p2) * (triangleArea / 3.f);
+                normals[c] += normal;
+                area += triangleArea;
+            }
+            meshCentroid += centroids[c];
+            meshArea += area;
+            centroids[c] = area > 0.f ? centroids[c] / area : centroids[c];
+        }
+        meshCentroid = meshArea > 0.f ? meshCentroid / meshArea : meshCentroid;
+
+        // clusters facing outwards are drawn first, they occlude the ones behind them
+        std::vector<f32> sortKeys(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) {
+            const f32 length = glm::length(normals[c]);
+            sortKeys[c] = length > 0.f ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.f;
+        }
+
+        std::vector<size_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) {
+            order[c] = c;
+        }
+        std::stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) {
+            return sortKeys[a] > sortKeys[b];
+        });
+
+        std::vector<u32> result;
+        result.reserve(indices.size());
+        for (auto c : order) {
+            result.insert(result.end(), indices.begin() + (std::ptrdiff_t)(clusters[c] * 3), indices.begin() + (std::ptrdiff_t)(clusters[c + 1] * 3));
+        }
+        indices.swap(result);
+    }
+
+    void MeshOptimizer::optimizeVertexFetch(MeshData& data) {
+        const u32 unused = 0xffffffff;
+        std::vector<u32> remap(data.vertices.size(), unused);
+        std::vector<Vertex> vertices;
+        vertices.reserve(data.vertices.size());
+
+        for (auto& index : data.indices) {
+            if (remap[index] == unused) {
+                remap[index] = (u32)vertices.size();
+                vertices.push_back(data.vertices[index]);
+            }
+            index = remap[index];
+        }
+
+        data.vertices.swap(vertices);
+    }
+
+    VertexCacheStatistics MeshOptimizer::analyzeVertexCache(const std::vector<u32>& indices, u32 vertexCount) {
+        VertexCacheStatistics statistics;
+        FifoCache cache(vertexCount);
+        std::vector<bool> referenced(vertexCount, false);
+
+        statistics.triangles = (u32)(indices.size() / 3);
+        for (size_t i = 0; i < (size_t)statistics.triangles * 3; i++) {
+            statistics.misses += (u32)cache.access(indices[i]);
+            if (!referenced[indices[i]]) {
+                referenced[indices[i]] = true;
+                statistics.vertices++;
+            }
+        }
+        return statistics;
+    }
+
+    void MeshOptimizer::optimize(MeshData& data) {
+        const u32 vertexCount = (u32)data.vertices.size();
+        if (std::any_of(data.indices.begin(), data.indices.end(), [vertexCount](u32 index) { return index >= vertexCount; })) {
+            return;
+        }
+
+        optimizeVertexCache(data.indices, vertexCount);
+        optimizeOverdraw(data.indices, data.vertices);
+        optimizeVertexFetch(data);
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "types.hpp"
+#include "vertex_layout.hpp"
+#include <vector>
+
+namespace ay
+{
+    struct VertexCacheStatistics {
+        u32 triangles = 0;
+        u32 vertices = 0; // referenced vertices
+        u32 misses = 0; // vertex shader invocations
+
+        ///
+        /// @brief Average cache miss ratio (1 is optimal for big meshes, 3 is the worst)
+        /// @return Misses per triangle
+        ///
+        inline f32 acmr() const {
+            return triangles > 0 ? (f32)misses / (f32)triangles : 0.f;
+        }
+
+        ///
+        /// @brief Average transform to vertex ratio (1 is optimal)
+        /// @return Misses per vertex
+        ///
+        inline f32 atvr() const {
+            return vertices > 0 ? (f32)misses / (f32)vertices : 0.f;
+        }
+
+        ///
+        /// @brief Accumulate the statistics of another mesh
+        /// @param other Statistics
+        ///
+        inline void merge(const VertexCacheStatistics& other) {
+            triangles += other.triangles;
+            vertices += other.vertices;
+            misses += other.misses;
+        }
+    };
+
+    class MeshOptimizer {
+    public:
+        static const u32 CACHE_SIZE = 16; // FIFO size used by the statistics and the overdraw clusters
+
+        ///
+        /// @brief Reorder the triangles to reuse the post-transform vertex cache (Forsyth)
+        /// @param indices Triangle list indices
+        /// @param vertexCount Number of vertices
+        ///
+        static void optimizeVertexCache(std::vector<u32>& indices, u32 vertexCount);
+
+        ///
+        /// @brief Reorder clusters of triangles so the outward facing ones are drawn first (to run after optimizeVertexCache)
+        /// @param indices Triangle list indices
+        /// @param vertices Vertices
+        /// @param threshold Cache miss ratio allowed to grow by this factor to get smaller clusters
+        ///
+        static void optimizeOverdraw(std::vector<u32>& indices, const std::vector<Vertex>& vertices, f32 threshold = 1.05f);
+
+        ///
+        /// @brief Reorder the vertices in the order they are used, unused vertices are removed
+        /// @param data Vertices and indices
+        ///
+        static void optimizeVertexFetch(MeshData& data);
+
+        ///
+        /// @brief Simulate a FIFO vertex cache
+        /// @param indices Triangle list indices
+        /// @param vertexCount Number of vertices
+        /// @return Statistics
+        ///
+        static VertexCacheStatistics analyzeVertexCache(const std::vector<u32>& indices, u32 vertexCount);
+
+        ///
+        /// @brief Run every optimization
+        /// @param data Vertices and indices (triangle list)
+        ///
+        static void optimize(MeshData& data);
+    };
+}
@@ -0,0 +1,298 @@
+#include "mesh_simplifier.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace ay
+{
+    static const f64 BORDER_WEIGHT = 10.0; // borders are kept in place by planes perpendicular to them
+    static const u32 MAX_PASSES = 100;
+
+    enum class VertexKind : u8 {
+        MANIFOLD, // can collapse to any neighbour
+        BORDER, // can only collapse along its border
+        LOCKED // attribute seam or complex topology, never removed
+    };
+
+    struct Quadric {
+        f64 a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+        f64 b2 = 0.0, bc = 0.0, bd = 0.0;
+        f64 c2 = 0.0, cd = 0.0;
+        f64 d2 = 0.0;
+        f64 weight = 0.0;
+
+        ///
+        /// @brief Add the squared distance to a plane
+        /// @param n Plane normal
+        /// @param d Plane distance
+        /// @param w Weight
+        ///
+        inline void addPlane(const glm::vec3& n, f32 d, f64 w) {
+            const f64 a = n.x, b = n.y, c = n.z;
+            a2 += w * a * a; ab += w * a * b; ac += w * a * c; ad += w * a * d;
+            b2 += w * b * b; bc += w * b * c; bd += w * b * d;
+            c2 += w * c * c; cd += w * c * d;
+            d2 += w * d * d;
+            weight += w;
+        }
+
+        ///
+        /// @brief Add another quadric
+        /// @param q Quadric
+        ///
+        inline void add(const Quadric& q) {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+            b2 += q.b2; bc += q.bc; bd += q.bd;
+            c2 += q.c2; cd += q.cd;
+            d2 += q.d2;
+            weight += q.weight;
+        }
+
+        ///
+        /// @brief Weighted squared distance of a point to the planes
+        /// @param p Point
+        /// @return Error
+        ///
+        inline f64 evaluate(const glm::vec3& p) const {
+            const f64 x = p.x, y = p.y, z = p.z;
+            const f64 error = a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x +
+                b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y +
+                c2 * z * z + 2.0 * cd * z + d2;
+            return weight > 0.0 ? std::max(error, 0.0) / weight : 0.0;
+        }
+    };
+
+    struct Collapse {
+        u32 from; // vertex removed
+        u32 to; // vertex of the same triangle replacing it
+        f64 cost;
+    };
+
+    typedef std::pair<u32, u32> Edge;
+
+    ///
+    /// @brief Find the vertices sharing a position
+    /// @param vertices Vertices
+    /// @param weld Output, first vertex with the same position
+    /// @param wedges Output, number of vertices sharing the position of each weld vertex
+    ///
+    static void weldPositions(const std::vector<Vertex>& vertices, std::vector<u32>& weld, std::vector<u32>& wedges) {
+        std::vector<u32> order(vertices.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = (u32)i;
+        }
+
+        auto less = [&vertices](u32 a, u32 b) {
+            const glm::vec3& pa = vertices[a].position;
+            const glm::vec3& pb = vertices[b].position;
+            return pa.x != pb.x ? pa.x < pb.x : (pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z);
+        };
+        std::sort(order.begin(), order.end(), less);
+
+        weld.assign(vertices.size(), 0);
+        wedges.assign(vertices.size(), 0);
+        for (size_t i = 0; i < order.size(); i++) {
+            const bool same = i > 0 && !less(order[i - 1], order[i]);
+            weld[order[i]] = same ? weld[order[i - 1]] : order[i];
+            wedges[weld[order[i]]]++;
+        }
+    }
+
+    std::vector<u32> MeshSimplifier::simplify(const std::vector<u32>& indices, const std::vector<Vertex>& vertices,
+        size_t targetIndexCount, f32* error)
+    {
+        f64 maxError = 0.0;
+        std::vector<u32> weld, wedges;
+        weldPositions(vertices, weld, wedges);
+
+        std::vector<u32> current;
+        current.reserve(indices.size());
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            const u32 w0 = weld[indices[i]], w1 = weld[indices[i + 1]], w2 = weld[indices[i + 2]];
+            if (w0 != w1 && w1 != w2 && w2 != w0) {
+                current.insert(current.end(), indices.begin() + (std::ptrdiff_t)i, indices.begin() + (std::ptrdiff_t)i + 3);
+            }
+        }
+
+        // open edges have no opposite half edge
+        std::vector<Edge> halfEdges;
+        halfEdges.reserve(current.size());
+        for (size_t i = 0; i < current.size(); i += 3) {
+            for (u32 k = 0; k < 3; k++) {
+                halfEdges.push_back(Edge(weld[current[i + k]], weld[current[i + (k + 1) % 3]]));
+            }
+        }
+        std::sort(halfEdges.begin(), halfEdges.end());
+
+        std::vector<Edge> borderEdges;
+        std::vector<u32> borderCount(vertices.size(), 0);
+        for (auto& edge : halfEdges) {
+            if (!std::binary_search(halfEdges.begin(), halfEdges.end(), Edge(edge.second, edge.first))) {
+                borderEdges.push_back(Edge(std::min(edge.first, edge.second), std::max(edge.first, edge.second)));
+                borderCount[edge.first]++;
+                borderCount[edge.second]++;
+            }
+        }
+        std::sort(borderEdges.begin(), borderEdges.end());
+
+        std::vector<VertexKind> kinds(vertices.size(), VertexKind::LOCKED);
+        for (size_t v = 0; v < vertices.size(); v++) {
+            if (wedges[v] == 1) {
+                kinds[v] = borderCount[v] == 0 ? VertexKind::MANIFOLD :
+                    (borderCount[v] == 2 ? VertexKind::BORDER : VertexKind::LOCKED);
+            }
+        }
+
+        // quadrics of the triangle planes (area weighted) and of the borders
+        std::vector<Quadric> quadrics(vertices.size());
+        for (size_t i = 0; i < current.size(); i += 3) {
+            const glm::vec3& p0 = vertices[current[i]].position;
+            const glm::vec3& p1 = vertices[current[i + 1]].position;
+            const glm::vec3& p2 = vertices[current[i + 2]].position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const f32 length = glm::length(normal);
+            if (length <= 0.f) {
+                continue;
+            }
+            normal = normal / length;
+
+            for (u32 k = 0; k < 3; k++) {
+                const u32 a = weld[current[i + k]];
+                const u32 b = weld[current[i + (k + 1) % 3]];
+                quadrics[a].addPlane(normal, -glm::dot(normal, vertices[a].position), length * 0.5);
+
+                if (std::binary_search(borderEdges.begin(), borderEdges.end(), Edge(std::min(a, b), std::max(a, b)))) {
+                    const glm::vec3 edge = vertices[b].position - vertices[a].position;
+                    glm::vec3 side = glm::cross(edge, normal);
+                    const f32 sideLength = glm::length(side);
+                    if (sideLength > 0.f) {
+                        side = side / sideLength;
+                        const f32 d = -glm::dot(side, vertices[a].position);
+                        const f64 w = (f64)glm::dot(edge, edge) * BORDER_WEIGHT;
+                        quadrics[a].addPlane(side, d, w);
+                        quadrics[b].addPlane(side, d, w);
+                    }
+                }
+            }
+        }
+
+        std::vector<u32> offsets(vertices.size() + 1), adjacency, remap(vertices.size());
+        std::vector<u8> touched(vertices.size());
+        std::vector<Collapse> collapses;
+        size_t triangleCount = current.size() / 3;
+
+        for (u32 pass = 0; pass < MAX_PASSES && triangleCount * 3 > targetIndexCount; pass++) {
+            // triangles around each weld vertex
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for (auto index : current) {
+                offsets[weld[index] + 1]++;
+            }
+            for (size_t v = 0; v < vertices.size(); v++) {
+                offsets[v + 1] += offsets[v];
+            }
+            adjacency.resize(current.size());
+            std::vector<u32> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < current.size(); i++) {
+                adjacency[cursor[weld[current[i]]]++] = (u32)(i / 3);
+            }
+
+            // every allowed collapse, cheapest first
+            collapses.clear();
+            for (size_t i = 0; i < current.size(); i += 3) {
+                for (u32 k = 0; k < 6; k++) {
+                    const u32 from = current[i + k % 3];
+                    const u32 to = current[i + (k < 3 ? (k + 1) % 3 : (k + 2) % 3)];
+                    const u32 wf = weld[from], wt = weld[to];
+                    const bool allowed = kinds[wf] == VertexKind::MANIFOLD || (kinds[wf] == VertexKind::BORDER &&
+                        std::binary_search(borderEdges.begin(), borderEdges.end(), Edge(std::min(wf, wt), std::max(wf, wt))));
+                    if (allowed) {
+                        Quadric q = quadrics[wf];
+                        q.add(quadrics[wt]);
+                        collapses.push_back({ from, to, q.evaluate(vertices[wt].position) });
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+                return a.cost < b.cost;
+            });
+
+            for (size_t v = 0; v < vertices.size(); v++) {
+                remap[v] = (u32)v;
+            }
+            std::fill(touched.begin(), touched.end(), 0);
+
+            u32 collapsed = 0;
+            for (auto& collapse : collapses) {
+                const u32 wf = weld[collapse.from], wt = weld[collapse.to];
+                if (touched[wf] || touched[wt]) {
+                    continue;
+                }
+
+                // reject the collapse if a remaining triangle flips
+                bool flips = false;
+                u32 removed = 0;
+                for (u32 a = offsets[wf]; a < offsets[wf + 1] && !flips; a++) {
+                    const u32* triangle = current.data() + (size_t)adjacency[a] * 3;
+                    const u32 w0 = weld[triangle[0]], w1 = weld[triangle[1]], w2 = weld[triangle[2]];
+                    if (w0 == wt || w1 == wt || w2 == wt) {
+                        removed++;
+                        continue;
+                    }
+
+                    const glm::vec3& p0 = vertices[triangle[0]].position;
+                    const glm::vec3& p1 = vertices[triangle[1]].position;
+                    const glm::vec3& p2 = vertices[triangle[2]].position;
+                    const glm::vec3& target = vertices[wt].position;
+                    const glm::vec3 before = glm::cross(p1 - p0, p2 - p0);
+                    const glm::vec3 after = glm::cross((w1 == wf ? target : p1) - (w0 == wf ? target : p0),
+                        (w2 == wf ? target : p2) - (w0 == wf ? target : p0));
+                    flips = glm::dot(before, after) <= 0.f;
+                }
+                if (flips) {
+                    continue;
+                }
+
+                remap[collapse.from] = collapse.to;
+                quadrics[wt].add(quadrics[wf]);
+                maxError = std::max(maxError, collapse.cost);
+
+                // the neighbourhood changed, its collapses are evaluated again in the next pass
+                touched[wf] = 1;
+                touched[wt] = 1;
+                for (u32 a = offsets[wf]; a < offsets[wf + 1]; a++) {
+                    const u32* triangle = current.data() + (size_t)adjacency[a] * 3;
+                    touched[weld[triangle[0]]] = 1;
+                    touched[weld[triangle[1]]] = 1;
+                    touched[weld[triangle[2]]] = 1;
+                }
+
+                collapsed++;
+                triangleCount -= removed;
+                if (triangleCount * 3 <= targetIndexCount) {
+                    break;
+                }
+            }
+
+            if (collapsed == 0) {
+                break;
+            }
+
+            size_t count = 0;
+            for (size_t i = 0; i < current.size(); i += 3) {
+                const u32 i0 = remap[current[i]], i1 = remap[current[i + 1]], i2 = remap[current[i + 2]];
+                if (weld[i0] != weld[i1] && weld[i1] != weld[i2] && weld[i2] != weld[i0]) {
+                    current[count++] = i0;
+                    current[count++] = i1;
+                    current[count++] = i2;
+                }
+            }
+            current.resize(count);
+            triangleCount = count / 3;
+        }
+
+        if (error) {
+            *error = (f32)std::sqrt(maxError);
+        }
+        return current;
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "types.hpp"
+#include "vertex_layout.hpp"
+#include <vector>
+
+namespace ay
+{
+    class MeshSimplifier {
+    public:
+        ///
+        /// @brief Reduce a triangle list by quadric error edge collapses (the vertices are kept, only the indices change)
+        /// @param indices Triangle list indices
+        /// @param vertices Vertices
+        /// @param targetIndexCount Wanted number of indices (not reached if the mesh is too constrained)
+        /// @param error Output, largest distance between the result and the input (object space)
+        /// @return Simplified indices
+        ///
+        static std::vector<u32> simplify(const std::vector<u32>& indices, const std::vector<Vertex>& vertices,
+            size_t targetIndexCount, f32* error = nullptr);
+    };
+}
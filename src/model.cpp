@@ -3,13 +3,156 @@
 #include "model_node.hpp"
 #include "mesh.hpp"
 #include "material.hpp"
+#include "render_queue.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "thread_pool.hpp"
+#include "glb_reader.hpp"
+#include "mapped_file.hpp"
+#include "cooked_model.hpp"
+#include <stb_image.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
 
 namespace ay
 {
+    ///
+    /// @brief Get the peak resident memory of the process
+    /// @return Bytes (0 if unknown)
+    ///
+    static size_t peakResidentMemory() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? (size_t)counters.PeakWorkingSetSize : 0;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+#ifdef __APPLE__
+        return (size_t)usage.ru_maxrss;
+#else
+        return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+    }
+
+    ///
+    /// @brief Check the extension of a filename
+    /// @param filename Filename
+    /// @param extension Extension with its dot
+    /// @return True if the filename ends with the extension
+    ///
+    static bool hasExtension(const std::string& filename, const std::string& extension) {
+        return filename.size() >= extension.size() &&
+            filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+    }
+
+    ///
+    /// @brief tinygltf image loader keeping the encoded bytes (the images of a buffer view stay in the buffer)
+    ///
+    static bool keepEncodedImage(tinygltf::Image* image, const int, std::string*, std::string*, int, int,
+        const unsigned char* bytes, int size, void*)
+    {
+        if (image->bufferView < 0) {
+            image->image.assign(bytes, bytes + size);
+        }
+        image->as_is = true;
+        return true;
+    }
+
+    ///
+    /// @brief Decode base64 (the payload of a data uri)
+    /// @param text Base64 text
+    /// @return Bytes
+    ///
+    static std::vector<u8> decodeBase64(const std::string& text) {
+        std::vector<u8> bytes;
+        bytes.reserve(text.size() / 4 * 3);
+        u32 bits = 0;
+        i32 count = 0;
+        for (char c : text) {
+            i32 value = -1;
+            value = (c >= 'A' && c <= 'Z') ? c - 'A' : value;
+            value = (c >= 'a' && c <= 'z') ? c - 'a' + 26 : value;
+            value = (c >= '0' && c <= '9') ? c - '0' + 52 : value;
+            value = (c == '+' || c == '-') ? 62 : value;
+            value = (c == '/' || c == '_') ? 63 : value;
+            if (value < 0) {
+                // padding or whitespace
+                continue;
+            }
+
+            bits = (bits << 6) | (u32)value;
+            count += 6;
+            if (count >= 8) {
+                count -= 8;
+                bytes.push_back((u8)(bits >> count));
+            }
+        }
+        return bytes;
+    }
+
+    ///
+    /// @brief Read the encoded bytes of an image given by uri
+    /// @param uri Data uri, or path relative to the model
+    /// @param directory Directory of the model
+    /// @return Bytes (empty on error)
+    ///
+    static std::vector<u8> readImageUri(const std::string& uri, const std::string& directory) {
+        if (uri.compare(0, 5, "data:") == 0) {
+            const size_t payload = uri.find(";base64,");
+            return payload == std::string::npos ? std::vector<u8>() : decodeBase64(uri.substr(payload + 8));
+        }
+
+        std::ifstream file(directory + uri, std::ifstream::binary);
+        if (!file.is_open()) {
+            return std::vector<u8>();
+        }
+        return std::vector<u8>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+
     Model::Model(Context* ctx)
         : ctx(ctx),
+        threadPool(ctx ? ctx->getThreadPool() : nullptr),
         root(nullptr),
         materials(),
+        materialsBuffer(0),
+        materialsStride(0),
+        materialSlots(),
+        transforms(),
+        bounds(),
+        flatMeshes(),
+        meshBounds(),
+        meshHierarchy(),
+        movedMeshes(),
+        visibleMeshes(),
+        options(),
+        pendingMeshes(),
+        pendingImages(),
+        textureBindings(),
+        imageIndices(),
+        textures(),
+        state(ModelState::READY),
+        totalMeshes(0),
+        preparedMeshes(0),
+        uploadedMeshes(0),
+        uploadedImages(0),
+        placeholder(nullptr),
+        occluder(false),
+        cookedFile(nullptr),
         transform()
     {
         root = new ModelNode(*this);
@@ -38,74 +181,423 @@ namespace ay
         for (auto material : materials) {
             delete material.second;
         }
+
+        if (materialsBuffer != 0) {
+            ctx->bufferDispose(materialsBuffer);
+        }
+
+        for (auto texture : textures) {
+            if (texture != 0) {
+                ctx->texture2DDelete(texture);
+            }
+        }
+        delete cookedFile;
+    }
+
+    void Model::buildTransforms() {
+        transforms.clear();
+        flatMeshes.clear();
+
+        std::vector<std::pair<ModelNode*, i32>> nodes(1, std::make_pair(root, -1));
+        for (size_t i = 0; i < nodes.size(); i++) {
+            ModelNode* node = nodes[i].first;
+            node->index = transforms.add(nodes[i].second, node->transform);
+            node->firstMesh = (u32)flatMeshes.size();
+            flatMeshes.insert(flatMeshes.end(), node->meshes.begin(), node->meshes.end());
+            for (auto child : node->children) {
+                nodes.push_back(std::make_pair(child, (i32)node->index));
+            }
+        }
+
+        // every node is dirty, the first update fills the bounds and builds the hierarchy
+        meshBounds.assign(flatMeshes.size(), BoundingBox());
+        meshHierarchy = BoundingVolumeHierarchy();
+    }
+
+    void Model::prepareMeshes(const std::string& name) {
+        totalMeshes = (u32)pendingMeshes.size();
+        std::vector<VertexCacheStatistics> before(pendingMeshes.size()), after(pendingMeshes.size());
+        auto prepare = [this, &before, &after](size_t i) {
+            PendingMesh& pending = pendingMeshes[i];
+            if (pending.mesh->drawMode == GL_TRIANGLES) {
+                if (options.optimize) {
+                    before[i] = MeshOptimizer::analyzeVertexCache(pending.data.indices, (u32)pending.data.vertices.size());
+                    MeshOptimizer::optimize(pending.data);
+                    after[i] = MeshOptimizer::analyzeVertexCache(pending.data.indices, (u32)pending.data.vertices.size());
+                }
+                buildLods(pending);
+                buildOccluder(pending);
+            }
+            preparedMeshes++;
+        };
+
+        if (threadPool) {
+            threadPool->parallelFor(pendingMeshes.size(), prepare);
+        }
+        else {
+            for (size_t i = 0; i < pendingMeshes.size(); i++) {
+                prepare(i);
+            }
+        }
+
+        if (options.optimize) {
+            VertexCacheStatistics totalBefore, totalAfter;
+            for (size_t i = 0; i < pendingMeshes.size(); i++) {
+                totalBefore.merge(before[i]);
+                totalAfter.merge(after[i]);
+            }
+            spdlog::info("{}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}", name,
+                totalBefore.acmr(), totalAfter.acmr(), totalBefore.atvr(), totalAfter.atvr());
+        }
+    }
+
+    bool Model::upload(const std::chrono::steady_clock::time_point& deadline) {
+        if (uploadedMeshes == 0 && uploadedImages == 0) {
+            // submit the variants first, they compile while the textures and meshes upload
+            root->compileShaders();
+            uploadMaterials();
+            textures.assign(pendingImages.size(), 0);
+        }
+
+        while (uploadedImages < pendingImages.size()) {
+            PendingImage& image = pendingImages[uploadedImages];
+            textures[uploadedImages++] = image.compressed.format != 0 ?
+                ctx->texture2DCreateCompressed(image.params, image.compressed, image.pixels.data()) :
+                ctx->texture2DCreate(image.params, image.pixels.data());
+            image.pixels = std::vector<u8>();
+
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+        }
+
+        while (uploadedMeshes < pendingMeshes.size()) {
+            PendingMesh& pending = pendingMeshes[uploadedMeshes++];
+            if (pending.cookedVertices) {
+                pending.mesh->upload(pending.layout, pending.cookedVertices, pending.mesh->verticesCount,
+                    pending.cookedIndices, pending.mesh->indicesCount);
+            }
+            else {
+                pending.mesh->upload(pending.data, pending.layout);
+            }
+            if (!pending.lods.empty()) {
+                pending.mesh->setLods(pending.lods);
+            }
+            // the geometry is on the GPU, free it now instead of with the whole model
+            pending.data = MeshData();
+
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+        }
+
+        for (auto& binding : textureBindings) {
+            *binding.slot = textures[binding.image];
+        }
+
+        pendingMeshes.clear();
+        pendingImages.clear();
+        textureBindings.clear();
+        uploadedMeshes = 0;
+        uploadedImages = 0;
+        delete cookedFile;
+        cookedFile = nullptr;
+        root->setOccluder(occluder);
+        state = ModelState::READY;
+        return true;
+    }
+
+    Model::PendingImage* Model::addTexture(Texture2D& slot, i32 image) {
+        auto it = imageIndices.find(image);
+        const bool added = it == imageIndices.end();
+        if (added) {
+            it = imageIndices.insert(std::make_pair(image, pendingImages.size())).first;
+            pendingImages.push_back(PendingImage());
+        }
+        textureBindings.push_back(TextureBinding{ &slot, it->second });
+        return added ? &pendingImages.back() : nullptr;
+    }
+
+    bool Model::hasTexture(const Texture2D& slot) const {
+        if (slot != 0) {
+            return true;
+        }
+
+        for (auto& binding : textureBindings) {
+            if (binding.slot == &slot) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Model::decodeImages(const std::string& filename) {
+        imageIndices.clear();
+        if (pendingImages.empty()) {
+            return;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        const size_t separator = filename.find_last_of("/\\");
+        const std::string directory = separator == std::string::npos ? std::string() : filename.substr(0, separator + 1);
+        auto decode = [this, &directory](size_t i) {
+            PendingImage& image = pendingImages[i];
+            std::vector<ImageSource> sources;
+            for (auto& source : image.sources) {
+                // a compressed copy of an external image (cooked by aycook) is tried first
+                const bool external = !source.uri.empty() && source.uri.compare(0, 5, "data:") != 0;
+                const size_t extension = source.uri.find_last_of('.');
+                const size_t slash = source.uri.find_last_of("/\\");
+                const bool hasName = extension != std::string::npos && (slash == std::string::npos || extension > slash);
+                if (options.compressedTextures && ctx && external && hasName && !hasExtension(source.uri, ".ktx2")) {
+                    sources.push_back(ImageSource());
+                    sources.back().uri = source.uri.substr(0, extension) + ".ktx2";
+                }
+                sources.push_back(source);
+            }
+
+            int width = 0, height = 0;
+            for (auto& source : sources) {
+                std::vector<u8> file;
+                const u8* encoded = source.encoded;
+                size_t encodedSize = source.encodedSize;
+                if (encoded == nullptr) {
+                    file = readImageUri(source.uri, directory);
+                    encoded = file.data();
+                    encodedSize = file.size();
+                }
+
+                if (Ktx2Texture::isKtx2(encoded, encodedSize)) {
+                    // uploaded as is, only if the GPU can sample its format (Basis Universal is not transcoded) with the top row first
+                    Ktx2Image compressed;
+                    if (ctx && Ktx2Texture::read(encoded, encodedSize, compressed) && !compressed.bottomUp &&
+                        ctx->texture2DCompressedSupported(compressed.format)) {
+                        image.compressed = compressed;
+                        image.pixels.assign(encoded, encoded + encodedSize);
+                        width = compressed.width;
+                        height = compressed.height;
+                        break;
+                    }
+                    continue;
+                }
+
+                // thread-safe as long as nobody sets the global flip flag of stb
+                int channels = 0;
+                u8* pixels = encodedSize > 0 ? stbi_load_from_memory(encoded, (int)encodedSize, &width, &height, &channels, 4) : nullptr;
+                if (pixels) {
+                    image.pixels.assign(pixels, pixels + (size_t)width * (size_t)height * 4);
+                    stbi_image_free(pixels);
+                    break;
+                }
+            }
+
+            if (image.pixels.empty()) {
+                // the material keeps a texture, sampled white
+                spdlog::warn("Failed to decode image {} ({})", i,
+                    image.sources.empty() || image.sources.back().uri.empty() ? "embedded" : image.sources.back().uri);
+                width = height = 1;
+                image.pixels.assign(4, 255);
+            }
+
+            image.params.width = width;
+            image.params.height = height;
+            image.sources = std::vector<ImageSource>();
+        };
+
+        if (threadPool) {
+            threadPool->parallelFor(pendingImages.size(), decode);
+        }
+        else {
+            for (size_t i = 0; i < pendingImages.size(); i++) {
+                decode(i);
+            }
+        }
+
+        const std::chrono::duration<f32, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        spdlog::info("{}: {} images decoded in {:.1f} ms", filename, pendingImages.size(), elapsed.count());
+    }
+
+    void Model::keepImages() {
+        imageIndices.clear();
+        for (auto& image : pendingImages) {
+            for (auto& source : image.sources) {
+                if (source.encoded) {
+                    source.kept.assign(source.encoded, source.encoded + source.encodedSize);
+                    source.encoded = nullptr;
+                    source.encodedSize = 0;
+                }
+            }
+        }
+    }
+
+    void Model::buildLods(PendingMesh& pending) const {
+        MeshData& data = pending.data;
+        const BoundingBox& bounds = pending.mesh->bounds;
+        if (options.lodRatios.empty() || bounds.empty() || data.indices.empty()) {
+            return;
+        }
+
+        const f32 radius = glm::length(bounds.extent());
+        const size_t triangles = data.indices.size() / 3;
+        pending.lods.assign(1, MeshLod{ 0, (u32)data.indices.size(), 0.f });
+
+        // each level is simplified from the previous one, the errors add up
+        std::vector<u32> previous = data.indices;
+        f32 error = 0.f;
+        for (auto ratio : options.lodRatios) {
+            f32 lodError = 0.f;
+            std::vector<u32> lod = MeshSimplifier::simplify(previous, data.vertices, (size_t)((f32)triangles * ratio) * 3, &lodError);
+            if (lod.empty() || lod.size() * 10 > previous.size() * 9) {
+                // the mesh is too constrained to go further
+                break;
+            }
+
+            if (options.optimize) {
+                MeshOptimizer::optimizeVertexCache(lod, (u32)data.vertices.size());
+            }
+
+            error += lodError;
+            pending.lods.push_back(MeshLod{ (u32)data.indices.size(), (u32)lod.size(), radius > 0.f ? error / radius : 0.f });
+            data.indices.insert(data.indices.end(), lod.begin(), lod.end());
+            previous.swap(lod);
+        }
+    }
+
+    void Model::buildOccluder(PendingMesh& pending) const {
+        const MeshData& data = pending.data;
+        const MeshLod coarsest = pending.lods.empty() ? MeshLod{ 0, (u32)data.indices.size(), 0.f } : pending.lods.back();
+        if (coarsest.indexCount == 0 || coarsest.indexCount / 3 > options.occluderTriangles) {
+            return;
+        }
+        pending.mesh->setOccluder(data, coarsest.firstIndex, coarsest.indexCount);
+    }
+
+    void Model::setOccluder(bool enabled) {
+        // the nodes of a loading model belong to the worker, they are flagged once uploaded
+        occluder = enabled;
+        if (state == ModelState::READY) {
+            root->setOccluder(enabled);
+        }
+    }
+
+    void Model::uploadMaterials() {
+        const size_t tableSize = sizeof(MaterialData) * MATERIALS_PER_TABLE;
+        if ((GLint)tableSize > ctx->getMaxUniformBlockSize()) {
+            spdlog::error("Uniform blocks of {} bytes cannot hold a materials table ({} bytes)", ctx->getMaxUniformBlockSize(), tableSize);
+        }
+
+        // slot 0 is the default material, the others follow in the glTF order and fill as many tables as needed
+        materialSlots.clear();
+        std::vector<MaterialData> slots(1, Material().toData());
+        for (auto material : materials) {
+            materialSlots[material.first] = (u32)slots.size();
+            slots.push_back(material.second->toData());
+        }
+
+        const GLintptr alignment = (GLintptr)ctx->getUniformBufferAlignment();
+        const size_t tables = (slots.size() + MATERIALS_PER_TABLE - 1) / MATERIALS_PER_TABLE;
+        materialsStride = ((GLintptr)tableSize + alignment - 1) / alignment * alignment;
+        std::vector<u8> data((size_t)materialsStride * tables, 0);
+        for (size_t i = 0; i < slots.size(); i++) {
+            std::memcpy(data.data() + (size_t)materialsStride * (i / MATERIALS_PER_TABLE) + sizeof(MaterialData) * (i % MATERIALS_PER_TABLE),
+                &slots[i], sizeof(MaterialData));
+        }
+
+        if (materialsBuffer == 0) {
+            materialsBuffer = ctx->bufferNew();
+        }
+        for (size_t i = 0; i < tables; i++) {
+            ctx->uniformRangeAdd(materialsBuffer, materialsStride * (GLintptr)i);
+        }
+        ctx->bufferUse<BufferUsage::UNIFORM>(materialsBuffer);
+        ctx->bufferData<BufferUsage::UNIFORM, BufferTarget::STATIC_DRAW>((GLsizeiptr)data.size(), data.data());
+        ctx->bufferUse<BufferUsage::UNIFORM>(0);
+    }
+
+    i32 Model::materialIndex(i32 material) const {
+        auto it = materialSlots.find(material);
+        return it != materialSlots.end() ? (i32)(it->second % MATERIALS_PER_TABLE) : 0;
+    }
+
+    GLintptr Model::materialsOffset(i32 material) const {
+        auto it = materialSlots.find(material);
+        return it != materialSlots.end() ? materialsStride * (GLintptr)(it->second / MATERIALS_PER_TABLE) : 0;
+    }
+
+    void Model::update() {
+        transforms.set(root->index, transform);
+        transforms.update();
+
+        movedMeshes.clear();
+        root->updateBounds(movedMeshes);
+        if (meshHierarchy.size() != meshBounds.size()) {
+            meshHierarchy.build(meshBounds);
+        }
+        else if (!movedMeshes.empty()) {
+            meshHierarchy.refit(movedMeshes);
+        }
+        bounds = meshHierarchy.getBounds();
     }
 
     void Model::render(f32 deltaTime) {
-        ctx->shaderUniform("isAxis", 0);
-        root->transform = transform;
-        root->render();
+        if (state != ModelState::READY) {
+            if (placeholder) {
+                placeholder->transform = transform;
+                placeholder->render(deltaTime);
+            }
+            return;
+        }
+
+        update();
+
+        // only the meshes inside the frustum make draws
+        RenderQueue& queue = *ctx->getRenderQueue();
+        queue.cull(meshHierarchy, visibleMeshes);
+        root->render(queue, nullptr);
+    }
+
+    void Model::renderInstances(const InstanceBatch& batch) {
+        if (state != ModelState::READY) {
+            return;
+        }
+        root->render(*ctx->getRenderQueue(), &batch);
     }
 
     Model* Model::plane(Context* ctx) {
         Model* model = new Model(ctx);
         Mesh* mesh = new Mesh(ctx);
 
-        std::vector<f32> data = {
-            -1.f, 1.f, 0.f,
-            1.f, 1.f, 0.f,
-            1.f, -1.f, 0.f,
-            -1.f, -1.f, 0.f,
-
-            0.f, 0.f, 1.f,
-            0.f, 0.f, 1.f,
-            0.f, 0.f, 1.f,
-            0.f, 0.f, 1.f,
-
-            0.f, 0.f,
-            1.f, 0.f,
-            1.f, 1.f,
-            0.f, 1.f,
-
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f
+        MeshData data;
+        data.vertices = {
+            { glm::vec3(-1.f, 1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec2(0.f, 0.f), glm::vec3(1.f) },
+            { glm::vec3(1.f, 1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec2(1.f, 0.f), glm::vec3(1.f) },
+            { glm::vec3(1.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec2(1.f, 1.f), glm::vec3(1.f) },
+            { glm::vec3(-1.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec2(0.f, 1.f), glm::vec3(1.f) }
         };
 
-        std::vector<u32> indices = {
+        data.indices = {
             0, 2, 1,
             0, 3, 2
         };
 
-        mesh->indicesCount = (u32)indices.size();
         mesh->colorsCount = 4;
         mesh->normalsCount = 4;
         mesh->texcoordsCount = 4;
-        mesh->verticesCount = 4;
-
-        ctx->vaoUse(mesh->vao);
-        ctx->bufferUse<BufferUsage::ARRAY>(mesh->buffers[1]);
-        ctx->bufferData<BufferUsage::ARRAY, BufferTarget::STATIC_DRAW>(sizeof(f32) * 12, data.data());
-        ctx->bufferAttribute(0, GL_FLOAT, 3, sizeof(f32) * 3, nullptr);
-
-        ctx->bufferUse<BufferUsage::ARRAY>(mesh->buffers[2]);
-        ctx->bufferData<BufferUsage::ARRAY, BufferTarget::STATIC_DRAW>(sizeof(f32) * 12, data.data() + (sizeof(f32) * 12));
-        ctx->bufferAttribute(1, GL_FLOAT, 3, sizeof(f32) * 3, nullptr);
-
-        ctx->bufferUse<BufferUsage::ARRAY>(mesh->buffers[3]);
-        ctx->bufferData<BufferUsage::ARRAY, BufferTarget::STATIC_DRAW>(sizeof(f32) * 8, data.data() + (sizeof(f32) * 24));
-        ctx->bufferAttribute(2, GL_FLOAT, 2, sizeof(f32) * 2, nullptr);
+        mesh->bounds = BoundingBox(glm::vec3(-1.f, -1.f, 0.f), glm::vec3(1.f, 1.f, 0.f));
+        mesh->upload(data, VertexLayout::select(data, model->options.quantize));
+        mesh->setOccluder(data, 0, (u32)data.indices.size());
 
-        ctx->bufferUse<BufferUsage::ARRAY>(mesh->buffers[4]);
-        ctx->bufferData<BufferUsage::ARRAY, BufferTarget::STATIC_DRAW>(sizeof(f32) * 12, data.data() + (sizeof(f32) * 32));
-        ctx->bufferAttribute(3, GL_FLOAT, 3, sizeof(f32) * 3, nullptr);
-
-        ctx->bufferUse<BufferUsage::ELEMENT>(mesh->buffers[0]);
-        ctx->bufferData<BufferUsage::ELEMENT, BufferTarget::STATIC_DRAW>(sizeof(u32) * indices.size(), indices.data());
-        ctx->vaoUse(0);
+        ShaderFeatures features;
+        features.vertexColor = true;
+        features.texcoord = true;
+        features.octNormals = mesh->hasOctNormals();
 
         model->root->materials.push_back(-1);
         model->root->meshes.push_back(mesh);
+        model->root->features.push_back(features);
+        model->root->passes.push_back(RenderPass::OPAQUE_PASS);
+        model->buildTransforms();
+        model->uploadMaterials();
         return model;
     }
 
@@ -113,69 +605,25 @@ namespace ay
         Model* model = new Model(ctx);
         Mesh* mesh = new Mesh(ctx);
 
-        std::vector<f32> data = {
-            -1.f, 1.f, -1.f,
-            -1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, -1.f,
-            -1.f, -1.f, 1.f,
-            -1.f, -1.f, -1.f,
-            1.f, -1.f, -1.f,
-            1.f, -1.f, 1.f,
-            -1.f, 1.f, -1.f,
-            -1.f, 1.f, -1.f,
-            -1.f, 1.f, 1.f,
-            -1.f, 1.f, 1.f,
-            -1.f, -1.f, 1.f,
-            -1.f, -1.f, -1.f,
-
-            0.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,
-            0.f, 0.f, 0.f,
-
-            0.25f, 0.f,
-            0.75f, 0.f,
-            0.75f, 0.25f,
-            0.25f, 0.25f,
-            0.75f, 0.75f,
-            0.25f, 0.75f,
-            0.25f, 0.5f,
-            0.75f, 0.5f,
-            0.f, 0.25f,
-            0.25f, 1.f,
-            1.f, 0.25f,
-            0.75f, 1.f,
-            1.f, 0.5f,
-            0.f, 0.5f,
-
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f,
-            1.f, 1.f, 1.f
+        MeshData data;
+        data.vertices = {
+            { glm::vec3(-1.f, 1.f, -1.f), glm::vec3(0.f), glm::vec2(0.25f, 0.f), glm::vec3(1.f) },
+            { glm::vec3(-1.f, 1.f, 1.f), glm::vec3(0.f), glm::vec2(0.75f, 0.f), glm::vec3(1.f) },
+            { glm::vec3(1.f, 1.f, 1.f), glm::vec3(0.f), glm::vec2(0.75f, 0.25f), glm::vec3(1.f) },
+            { glm::vec3(1.f, 1.f, -1.f), glm::vec3(0.f), glm::vec2(0.25f, 0.25f), glm::vec3(1.f) },
+            { glm::vec3(-1.f, -1.f, 1.f), glm::vec3(0.f), glm::vec2(0.75f, 0.75f), glm::vec3(1.f) },
+            { glm::vec3(-1.f, -1.f, -1.f), glm::vec3(0.f), glm::vec2(0.25f, 0.75f), glm::vec3(1.f) },
+            { glm::vec3(1.f, -1.f, -1.f), glm::vec3(0.f), glm::vec2(0.25f, 0.5f), glm::vec3(1.f) },
+            { glm::vec3(1.f, -1.f, 1.f), glm::vec3(0.f), glm::vec2(0.75f, 0.5f), glm::vec3(1.f) },
+            { glm::vec3(-1.f, 1.f, -1.f), glm::vec3(0.f), glm::vec2(0.f, 0.25f), glm::vec3(1.f) },
+            { glm::vec3(-1.f, 1.f, -1.f), glm::vec3(0.f), glm::vec2(0.25f, 1.f), glm::vec3(1.f) },
+            { glm::vec3(-1.f, 1.f, 1.f), glm::vec3(0.f), glm::vec2(1.f, 0.25f), glm::vec3(1.f) },
+            { glm::vec3(-1.f, 1.f, 1.f), glm::vec3(0.f), glm::vec2(0.75f, 1.f), glm::vec3(1.f) },
+            { glm::vec3(-1.f, -1.f, 1.f), glm::vec3(0.f), glm::vec2(1.f, 0.5f), glm::vec3(1.f) },
+            { glm::vec3(-1.f, -1.f, -1.f), glm::vec3(0.f), glm::vec2(0.f, 0.5f), glm::vec3(1.f) }
         };
 
-        std::vector<u32> indices = {
+        data.indices = {
             0, 2, 1, 0, 3, 2,
             2, 3, 6, 2, 6, 7,
             7, 6, 5, 7, 5, 4,
@@ -184,66 +632,137 @@ namespace ay
             4, 5, 9, 4, 9, 11
         };
 
-        mesh->indicesCount = (u32)indices.size();
         mesh->colorsCount = 14;
         mesh->normalsCount = 14;
         mesh->texcoordsCount = 14;
-        mesh->verticesCount = 14;
-
-        ctx->vaoUse(mesh->vao);
-        ctx->bufferUse<BufferUsage::ARRAY>(mesh->buffers[1]);
-        ctx->bufferData<BufferUsage::ARRAY, BufferTarget::STATIC_DRAW>(sizeof(f32) * 42, data.data());
-        ctx->bufferAttribute(0, GL_FLOAT, 3, sizeof(f32) * 3, nullptr);
-
-        ctx->bufferUse<BufferUsage::ARRAY>(mesh->buffers[2]);
-        ctx->bufferData<BufferUsage::ARRAY, BufferTarget::STATIC_DRAW>(sizeof(f32) * 42, data.data() + (sizeof(f32) * 42));
-        ctx->bufferAttribute(1, GL_FLOAT, 3, sizeof(f32) * 3, nullptr);
-
-        ctx->bufferUse<BufferUsage::ARRAY>(mesh->buffers[3]);
-        ctx->bufferData<BufferUsage::ARRAY, BufferTarget::STATIC_DRAW>(sizeof(f32) * 28, data.data() + (sizeof(f32) * 84));
-        ctx->bufferAttribute(2, GL_FLOAT, 2, sizeof(f32) * 2, nullptr);
+        mesh->bounds = BoundingBox(glm::vec3(-1.f), glm::vec3(1.f));
+        Mesh::computeNormals(data);
+        mesh->upload(data, VertexLayout::select(data, model->options.quantize));
+        mesh->setOccluder(data, 0, (u32)data.indices.size());
 
-        ctx->bufferUse<BufferUsage::ARRAY>(mesh->buffers[4]);
-        ctx->bufferData<BufferUsage::ARRAY, BufferTarget::STATIC_DRAW>(sizeof(f32) * 42, data.data() + (sizeof(f32) * 112));
-        ctx->bufferAttribute(3, GL_FLOAT, 3, sizeof(f32) * 3, nullptr);
-
-        ctx->bufferUse<BufferUsage::ELEMENT>(mesh->buffers[0]);
-        ctx->bufferData<BufferUsage::ELEMENT, BufferTarget::STATIC_DRAW>(sizeof(u32) * indices.size(), indices.data());
-        ctx->vaoUse(0);
-
-        mesh->computeNormals();
+        ShaderFeatures features;
+        features.vertexColor = true;
+        features.texcoord = true;
+        features.octNormals = mesh->hasOctNormals();
 
         model->root->materials.push_back(-1);
         model->root->meshes.push_back(mesh);
+        model->root->features.push_back(features);
+        model->root->passes.push_back(RenderPass::OPAQUE_PASS);
+        model->buildTransforms();
+        model->uploadMaterials();
         return model;
     }
 
-    Model* Model::fromFile(Context* ctx, const std::string& filename) {
-        tinygltf::Model model;
-        tinygltf::TinyGLTF loader;
-        std::string err, warn;
+    Model* Model::fromFile(Context* ctx, const std::string& filename, const ModelImportOptions& options) {
         Model* myModel = new Model(ctx);
+        myModel->options = options;
+        myModel->import(filename);
+        myModel->upload(std::chrono::steady_clock::time_point::max());
+        return myModel;
+    }
 
-        bool ret = loader.LoadBinaryFromFile(&model, &err, &warn, filename);
-        if (!warn.empty()) {
-            spdlog::warn("{}", warn);
+    void Model::import(const std::string& filename) {
+        const auto start = std::chrono::steady_clock::now();
+
+        if (hasExtension(filename, ".aymesh")) {
+            // cooked offline, nothing left to prepare
+            const bool cooked = CookedModel::read(*this, filename);
+            if (ctx) {
+                decodeImages(filename);
+            }
+            else {
+                keepImages();
+            }
+            buildTransforms();
+            const std::chrono::duration<f32, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            if (cooked) {
+                spdlog::info("Mesh {} loaded successfully in {:.1f} ms (cooked, peak RSS {} MB)", filename, elapsed.count(),
+                    peakResidentMemory() / (1024 * 1024));
+            }
+            return;
         }
 
-        if (!err.empty()) {
-            spdlog::error("{}", err);
+        // the mapped reader only handles self-contained binary files, the others go through tinygltf
+        const bool glb = hasExtension(filename, ".glb");
+        // both keep the encoded images until they are decoded
+        GlbReader reader;
+        tinygltf::Model model;
+        const bool mapped = options.mapGlb && glb && reader.open(filename);
+        if (mapped) {
+            // json throws on a field of the wrong type, it must not escape the loader thread
+            try {
+                const nlohmann::json& nodes = reader.getArray("nodes");
+                const nlohmann::json& scenes = reader.getArray("scenes");
+                const size_t sceneIndex = (size_t)std::max(reader.getJson().value("scene", 0), 0);
+                if (sceneIndex < scenes.size()) {
+                    std::vector<u8> visited(nodes.size(), 0);
+                    for (auto node : scenes[sceneIndex].value("nodes", std::vector<i32>())) {
+                        ModelNode* child = root->processNode(reader, node, visited, 1);
+                        if (child) {
+                            root->addChild(child);
+                        }
+                    }
+                }
+            }
+            catch (const nlohmann::json::exception& e) {
+                spdlog::error("Failed to read {}: {}", filename, e.what());
+                for (auto child : root->children) {
+                    delete child;
+                }
+                root->children.clear();
+                pendingMeshes.clear();
+                pendingImages.clear();
+                textureBindings.clear();
+                imageIndices.clear();
+                buildTransforms();
+                return;
+            }
         }
-
-        if (!ret) {
-            spdlog::error("Failed to parse {}", filename);
-            return myModel;
+        else {
+            tinygltf::TinyGLTF loader;
+            std::string err, warn;
+            // the images are decoded in parallel once the materials are known
+            loader.SetImageLoader(keepEncodedImage, nullptr);
+
+            bool ret = glb ? loader.LoadBinaryFromFile(&model, &err, &warn, filename) : loader.LoadASCIIFromFile(&model, &err, &warn, filename);
+            if (!warn.empty()) {
+                spdlog::warn("{}", warn);
+            }
+
+            if (!err.empty()) {
+                spdlog::error("{}", err);
+            }
+
+            if (!ret) {
+                spdlog::error("Failed to parse {}", filename);
+                buildTransforms();
+                return;
+            }
+
+            if (!model.scenes.empty()) {
+                const tinygltf::Scene& scene = model.scenes[(size_t)std::max(model.defaultScene, 0)];
+                std::vector<u8> visited(model.nodes.size(), 0);
+                for (auto node : scene.nodes) {
+                    ModelNode* child = root->processNode(model, node, visited, 1);
+                    if (child) {
+                        root->addChild(child);
+                    }
+                }
+            }
         }
-
-        auto scene = model.scenes[model.defaultScene];
-        for (auto node : scene.nodes) {
-            myModel->root->addChild(myModel->root->processNode(model, model.nodes[node]));
+        // the cooker writes the images as they are encoded
+        if (ctx) {
+            decodeImages(filename);
+        }
+        else {
+            keepImages();
         }
+        prepareMeshes(filename);
+        buildTransforms();
 
-        spdlog::info("Mesh {} loaded successfully", filename);
-        return myModel;
+        const std::chrono::duration<f32, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        spdlog::info("Mesh {} loaded successfully in {:.1f} ms ({}, peak RSS {} MB)", filename, elapsed.count(),
+            mapped ? "mapped" : "tinygltf", peakResidentMemory() / (1024 * 1024));
     }
 }
\ No newline at end of file
@@ -1,15 +1,42 @@
 #pragma once
 
 #include "types.hpp"
+#include "context.hpp"
 #include "transform.hpp"
+#include "transform_store.hpp"
+#include "bounds.hpp"
+#include "culling.hpp"
+#include "mesh.hpp"
+#include "ktx2.hpp"
+#include <atomic>
+#include <chrono>
 #include <map>
+#include <unordered_map>
 #include <string>
+#include <vector>
 
 namespace ay
 {
-    class Context;
     class Material;
     class ModelNode;
+    class MappedFile;
+    class ThreadPool;
+    struct InstanceBatch;
+
+    struct ModelImportOptions {
+        bool quantize = true; // compact vertex formats (half positions, oct normals, ...)
+        bool optimize = false; // reorder triangles and vertices for the vertex cache and overdraw
+        std::vector<f32> lodRatios = { .5f, .25f, .1f }; // triangles of each generated level of detail
+        bool mapGlb = true; // read .glb files in place from a memory mapping instead of tinygltf
+        u32 occluderTriangles = 512; // meshes whose coarsest level of detail is under this can be occluders (0 for none)
+        bool compressedTextures = true; // prefer a KTX2 next to an external image (foo.ktx2 for foo.png) if the GPU supports its format
+    };
+
+    enum class ModelState {
+        LOADING, // read and prepared on a worker
+        UPLOADING, // uploaded by the render thread a few meshes per frame
+        READY
+    };
 
     class Model {
     public:
@@ -36,9 +63,10 @@ namespace ay
         /// @brief Create a new mesh from file (obj)
         /// @param ctx Context
         /// @param filename Filename
+        /// @param options Import options
         /// @return Mesh
         ///
-        static Model* fromFile(Context* ctx, const std::string& filename);
+        static Model* fromFile(Context* ctx, const std::string& filename, const ModelImportOptions& options = ModelImportOptions());
 
         ///
         /// @brief Render called each frame
@@ -46,6 +74,87 @@ namespace ay
         ///
         void render(f32 deltaTime);
 
+        ///
+        /// @brief Get the world bounds of the model (valid after a render)
+        /// @return Bounds
+        ///
+        inline const BoundingBox& getBounds() const {
+            return bounds;
+        }
+
+        ///
+        /// @brief Get the root node, its children are the nodes of the file (valid once the model is ready)
+        /// @return Root node (its transform follows the model transform)
+        ///
+        inline ModelNode* getRoot() const {
+            return root;
+        }
+
+        ///
+        /// @brief Draw the low-poly meshes of the model in the software depth buffer to hide the draws behind them
+        /// @param enabled Enable
+        ///
+        void setOccluder(bool enabled);
+
+        ///
+        /// @brief Check if the model is loaded (an asynchronous load draws the placeholder until then)
+        /// @return True if ready
+        ///
+        inline bool isReady() const {
+            return state == ModelState::READY;
+        }
+
+        ///
+        /// @brief Get the loading progress
+        /// @return Progress in [0, 1]
+        ///
+        inline f32 getLoadProgress() const {
+            const u32 total = totalMeshes;
+            if (state == ModelState::READY) {
+                return 1.f;
+            }
+            return total == 0 ? 0.f : .5f * ((f32)preparedMeshes + (f32)uploadedMeshes) / (f32)total;
+        }
+
+        ///
+        /// @brief Set the model drawn with the transform of this one while it loads
+        /// @param model Placeholder (nullptr for none)
+        ///
+        inline void setPlaceholder(Model* model) {
+            placeholder = model;
+        }
+
+    private:
+        struct PendingMesh {
+            Mesh* mesh;
+            MeshData data;
+            VertexLayout layout;
+            std::vector<MeshLod> lods;
+            const u8* cookedVertices; // already in the layout, in the mapped cooked file (nullptr to encode data)
+            const u32* cookedIndices;
+        };
+
+        struct ImageSource {
+            ImageSource() : encoded(nullptr), encodedSize(0), uri(), kept() {}
+            const u8* encoded; // png, jpeg, ktx2, ... in the glTF buffers (valid while importing), nullptr to read the uri
+            size_t encodedSize;
+            std::string uri; // external file or data uri
+            std::vector<u8> kept; // copy of the encoded bytes for the cooker, the glTF buffers are released after the import
+        };
+
+        struct PendingImage {
+            PendingImage() : sources(), pixels(), compressed(), params() {}
+            std::vector<ImageSource> sources; // by preference, the first one decoded is kept
+            std::vector<u8> pixels; // RGBA8 once decoded, or the KTX2 file if compressed
+            Ktx2Image compressed; // levels in the pixels (format 0 if not compressed)
+            Texture2DParameters params;
+        };
+
+        struct TextureBinding {
+            Texture2D* slot; // texture of a material, set once uploaded
+            size_t image; // index in the pending images and the textures
+        };
+
     private:
         ///
         /// @brief Constructor
@@ -53,13 +162,133 @@ namespace ay
         ///
         Model(Context* ctx);
 
+        ///
+        /// @brief Update the world matrices and bounds of the nodes
+        ///
+        void update();
+
+        ///
+        /// @brief Queue one instanced draw per mesh
+        /// @param batch Instances
+        ///
+        void renderInstances(const InstanceBatch& batch);
+
+        ///
+        /// @brief Fill the transform store from the node hierarchy (breadth-first)
+        ///
+        void buildTransforms();
+
+        ///
+        /// @brief Read a file into the nodes and prepare its meshes, without any GL call (worker thread)
+        /// @param filename Filename (glTF, or .aymesh cooked by aycook)
+        ///
+        void import(const std::string& filename);
+
+        ///
+        /// @brief Optimize the loaded meshes and build their levels of detail (in parallel)
+        /// @param name Model name for the log
+        ///
+        void prepareMeshes(const std::string& name);
+
+        ///
+        /// @brief Bind a glTF image to a texture of a material (each image is decoded and uploaded once)
+        /// @param slot Texture of a material, set once the image is uploaded
+        /// @param image glTF image index
+        /// @return Image to describe if it is new, nullptr if already bound to another texture
+        ///
+        PendingImage* addTexture(Texture2D& slot, i32 image);
+
+        ///
+        /// @brief Check if a texture of a material has an image, uploaded or not
+        /// @param slot Texture of a material
+        /// @return True if textured
+        ///
+        bool hasTexture(const Texture2D& slot) const;
+
+        ///
+        /// @brief Decode the images bound to the materials (in parallel)
+        /// @param filename Model filename, the external images are relative to it
+        ///
+        void decodeImages(const std::string& filename);
+
+        ///
+        /// @brief Keep the encoded images bound to the materials without decoding them (cooking, no GL context)
+        ///
+        void keepImages();
+
+        ///
+        /// @brief Upload the decoded images, the prepared meshes and the materials (render thread)
+        /// @param deadline Stop after the mesh ending past this time
+        /// @return True once everything is uploaded (the model is ready)
+        ///
+        bool upload(const std::chrono::steady_clock::time_point& deadline);
+
+        ///
+        /// @brief Simplify a loaded mesh into levels of detail, their indices are appended to the mesh indices
+        /// @param pending Loaded mesh
+        ///
+        void buildLods(PendingMesh& pending) const;
+
+        ///
+        /// @brief Keep the coarsest level of detail of a loaded mesh on the CPU if it is low-poly enough to occlude
+        /// @param pending Loaded mesh
+        ///
+        void buildOccluder(PendingMesh& pending) const;
+
+        ///
+        /// @brief Upload the materials tables to the GPU, as many as the materials need
+        ///
+        void uploadMaterials();
+
+        ///
+        /// @brief Get the index of a material in its materials table
+        /// @param material glTF material index (-1 for the default material)
+        /// @return Index in the table
+        ///
+        i32 materialIndex(i32 material) const;
+
+        ///
+        /// @brief Get the offset of the materials table of a material in the materials buffer
+        /// @param material glTF material index (-1 for the default material)
+        /// @return Offset in bytes
+        ///
+        GLintptr materialsOffset(i32 material) const;
+
     private:
         friend class ModelNode;
+        friend class ModelInstances;
+        friend class ModelLoader;
+        friend class CookedModel;
 
     private:
-        Context* ctx;
+        Context* ctx; // nullptr when imported by the cooker
+        ThreadPool* threadPool; // prepares the meshes (nullptr to prepare them serially)
         ModelNode* root;
         std::map<i32, Material*> materials;
+        Buffer materialsBuffer; // created with the first upload, one range per table
+        GLintptr materialsStride; // between two tables, aligned for glBindBufferRange
+        std::unordered_map<i32, u32> materialSlots; // glTF material -> slot in the tables (0 is the default material)
+        TransformStore transforms;
+        BoundingBox bounds;
+        std::vector<const Mesh*> flatMeshes; // every mesh, the meshes of a node follow each other
+        std::vector<BoundingBox> meshBounds; // world bounds of the flat meshes
+        BoundingVolumeHierarchy meshHierarchy; // over the mesh bounds, refitted when nodes move
+        std::vector<u32> movedMeshes; // meshes whose node moved during the last update
+        std::vector<u8> visibleMeshes; // meshes inside the frustum this frame
+        ModelImportOptions options;
+        std::vector<PendingMesh> pendingMeshes; // loaded but not uploaded yet
+        std::vector<PendingImage> pendingImages;
+        std::vector<TextureBinding> textureBindings;
+        std::map<i32, size_t> imageIndices; // glTF image -> pending image, while importing
+        std::vector<Texture2D> textures; // owned, bound to the materials
+        ModelState state; // render thread
+        std::atomic<u32> totalMeshes;
+        std::atomic<u32> preparedMeshes;
+        size_t uploadedMeshes;
+        size_t uploadedImages;
+        Model* placeholder;
+        bool occluder;
+        MappedFile* cookedFile; // mapped until the meshes are uploaded
 
     public:
         Transform transform;
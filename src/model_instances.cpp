@@ -0,0 +1,160 @@
+#include "model_instances.hpp"
+#include "model.hpp"
+#include <algorithm>
+
+namespace ay
+{
+    ModelInstances::ModelInstances(Context* ctx, Model* model)
+        : ctx(ctx),
+        model(model),
+        buffer(0),
+        capacity(0),
+        instances(),
+        modelBounds(),
+        instanceBounds(),
+        hierarchy(),
+        moved(),
+        visible(),
+        lodLevels(),
+        selectedLevels(),
+        visibleInstances(),
+        ranges(),
+        meshRanges()
+    {
+        buffer = ctx->bufferNew();
+    }
+
+    ModelInstances::~ModelInstances() {
+        ctx->bufferDispose(buffer);
+    }
+
+    u32 ModelInstances::add(const Transform& transform, const Color& color) {
+        instances.push_back(InstanceData());
+        const u32 index = (u32)instances.size() - 1;
+        setTransform(index, transform);
+        setColor(index, color);
+        return index;
+    }
+
+    void ModelInstances::setTransform(u32 index, const Transform& transform) {
+        InstanceData& instance = instances[index];
+        instance.modelMatrix = transform.getTransform();
+        instance.normalMatrix = glm::transpose(glm::inverse(glm::mat3(instance.modelMatrix)));
+        moved.push_back(index);
+    }
+
+    void ModelInstances::setColor(u32 index, const Color& color) {
+        instances[index].color = color.toVec();
+    }
+
+    void ModelInstances::clear() {
+        instances.clear();
+        moved.clear();
+    }
+
+    void ModelInstances::render(f32 deltaTime) {
+        (void)deltaTime;
+        if (instances.empty() || !model->isReady()) {
+            return;
+        }
+
+        model->update();
+        RenderQueue& queue = *ctx->getRenderQueue();
+
+        // the instance bounds follow the model bounds, moving the model moves every instance
+        const BoundingBox& currentBounds = model->getBounds();
+        if (currentBounds.min != modelBounds.min || currentBounds.max != modelBounds.max) {
+            modelBounds = currentBounds;
+            moved.resize(instances.size());
+            for (size_t i = 0; i < instances.size(); i++) {
+                moved[i] = (u32)i;
+            }
+        }
+
+        if (hierarchy.size() != instances.size()) {
+            instanceBounds.resize(instances.size());
+            for (size_t i = 0; i < instances.size(); i++) {
+                instanceBounds[i] = modelBounds.transform(instances[i].modelMatrix);
+            }
+            hierarchy.build(instanceBounds);
+        }
+        else if (!moved.empty()) {
+            for (u32 i : moved) {
+                instanceBounds[i] = modelBounds.transform(instances[i].modelMatrix);
+            }
+            hierarchy.refit(moved);
+        }
+        moved.clear();
+        queue.cull(hierarchy, visible);
+
+        // levels of detail of each mesh of the model
+        const std::vector<const Mesh*>& meshes = model->flatMeshes;
+        if (meshRanges.size() != meshes.size() + 1) {
+            meshRanges.assign(1, 0);
+            for (auto mesh : meshes) {
+                meshRanges.push_back(meshRanges.back() + (u32)mesh->lods.size());
+            }
+            ranges.assign(meshRanges.back(), InstanceRange());
+        }
+        lodLevels.resize(instances.size() * meshes.size(), 0);
+
+        // the visible instances of each mesh, grouped by level of detail
+        visibleInstances.clear();
+        for (size_t j = 0; j < meshes.size(); j++) {
+            const Mesh* mesh = meshes[j];
+            InstanceRange* levels = &ranges[meshRanges[j]];
+            for (size_t level = 0; level < mesh->lods.size(); level++) {
+                levels[level].count = 0;
+                levels[level].bounds = BoundingBox();
+            }
+
+            selectedLevels.clear();
+            for (size_t i = 0; i < instances.size(); i++) {
+                if (!visible[i]) {
+                    continue;
+                }
+                const BoundingBox bounds = model->meshBounds[j].transform(instances[i].modelMatrix);
+                const u32 level = queue.selectLod(bounds, mesh->lods, lodLevels[i * meshes.size() + j]);
+                selectedLevels.push_back((u8)level);
+                levels[level].count++;
+                levels[level].bounds.merge(bounds);
+            }
+
+            u32 first = (u32)visibleInstances.size();
+            for (size_t level = 0; level < mesh->lods.size(); level++) {
+                levels[level].first = first;
+                first += levels[level].count;
+                levels[level].count = 0;
+            }
+            visibleInstances.resize(first);
+
+            size_t selected = 0;
+            for (size_t i = 0; i < instances.size(); i++) {
+                if (visible[i]) {
+                    InstanceRange& range = levels[selectedLevels[selected++]];
+                    visibleInstances[range.first + range.count++] = instances[i];
+                }
+            }
+        }
+
+        if (visibleInstances.empty()) {
+            return;
+        }
+
+        ctx->bufferUse<BufferUsage::ARRAY>(buffer);
+        if (visibleInstances.size() > capacity) {
+            // grow geometrically so that the visible instances rarely reallocate it
+            capacity = std::max(visibleInstances.size(), capacity * 2);
+        }
+        // fresh storage each frame, the GPU may still read the previous one
+        ctx->bufferData<BufferUsage::ARRAY, BufferTarget::DYNAMIC_DRAW>(sizeof(InstanceData) * capacity, nullptr);
+        ctx->bufferSubData<BufferUsage::ARRAY>(0, sizeof(InstanceData) * visibleInstances.size(), visibleInstances.data());
+        ctx->bufferUse<BufferUsage::ARRAY>(0);
+
+        InstanceBatch batch;
+        batch.buffer = buffer;
+        batch.ranges = ranges.data();
+        batch.meshRanges = meshRanges.data();
+        model->renderInstances(batch);
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "types.hpp"
+#include "context.hpp"
+#include "transform.hpp"
+#include "color.hpp"
+#include "bounds.hpp"
+#include "render_queue.hpp"
+#include "culling.hpp"
+#include <vector>
+
+namespace ay
+{
+    class Model;
+
+    class ModelInstances {
+    public:
+        ///
+        /// @brief Constructor
+        /// @param ctx Context
+        /// @param model Model drawn by every instance (not owned)
+        ///
+        ModelInstances(Context* ctx, Model* model);
+
+        ///
+        /// @brief Destructor
+        ///
+        ~ModelInstances();
+
+        ///
+        /// @brief Add an instance
+        /// @param transform Transform (applied after the model transform)
+        /// @param color Color multiplied with the base color
+        /// @return Instance index
+        ///
+        u32 add(const Transform& transform, const Color& color = Color::white());
+
+        ///
+        /// @brief Set the transform of an instance
+        /// @param index Instance index
+        /// @param transform Transform
+        ///
+        void setTransform(u32 index, const Transform& transform);
+
+        ///
+        /// @brief Set the color of an instance
+        /// @param index Instance index
+        /// @param color Color
+        ///
+        void setColor(u32 index, const Color& color);
+
+        ///
+        /// @brief Remove every instance
+        ///
+        void clear();
+
+        ///
+        /// @brief Get the number of instances
+        /// @return Instances count
+        ///
+        inline u32 size() const {
+            return (u32)instances.size();
+        }
+
+        ///
+        /// @brief Get the model
+        /// @return Model
+        ///
+        inline Model* getModel() const {
+            return model;
+        }
+
+        ///
+        /// @brief Render called each frame (the visible instances, one draw per mesh and level of detail)
+        /// @param deltaTime Elapsed time between each frame
+        ///
+        void render(f32 deltaTime);
+
+    private:
+        Context* ctx;
+        Model* model;
+        Buffer buffer;
+        size_t capacity; // instances allocated in the buffer
+        std::vector<InstanceData> instances;
+        BoundingBox modelBounds; // model bounds used for the instance bounds
+        std::vector<BoundingBox> instanceBounds; // world bounds of each instance
+        BoundingVolumeHierarchy hierarchy; // over the instance bounds
+        std::vector<u32> moved; // instances moved since the last frame
+        std::vector<u8> visible; // instances inside the frustum this frame
+        std::vector<u8> lodLevels; // level of detail of each mesh of each instance the previous frame (hysteresis)
+        std::vector<u8> selectedLevels; // level of detail of each visible instance, for the current mesh
+        std::vector<InstanceData> visibleInstances; // uploaded each frame, grouped by mesh then by level of detail
+        std::vector<InstanceRange> ranges; // one per level of detail of each mesh (stable, they identify the draws)
+        std::vector<u32> meshRanges; // first range of each mesh
+    };
+}
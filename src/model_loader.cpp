@@ -0,0 +1,49 @@
+#include "model_loader.hpp"
+#include "thread_pool.hpp"
+#include <chrono>
+#include <thread>
+
+namespace ay
+{
+    Model* ModelLoader::load(const std::string& filename, const ModelImportOptions& options) {
+        Model* model = new Model(ctx);
+        model->options = options;
+        model->state = ModelState::LOADING;
+
+        importing++;
+        ctx->getThreadPool()->submit([this, model, filename]() {
+            // no GL call on the worker, the render thread uploads
+            model->import(filename);
+            imported.push(model);
+            importing--;
+        });
+        return model;
+    }
+
+    void ModelLoader::update() {
+        Model* model = nullptr;
+        while (imported.pop(model)) {
+            model->state = ModelState::UPLOADING;
+            uploading.push_back(model);
+        }
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds((long long)(uploadBudget * 1000.f));
+        size_t done = 0;
+        while (done < uploading.size()) {
+            if (!uploading[done]->upload(deadline)) {
+                break;
+            }
+            done++;
+            if (std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+        }
+        uploading.erase(uploading.begin(), uploading.begin() + (std::ptrdiff_t)done);
+    }
+
+    void ModelLoader::wait() {
+        while (importing > 0) {
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "types.hpp"
+#include "context.hpp"
+#include "model.hpp"
+#include "mpsc_queue.hpp"
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace ay
+{
+    class ModelLoader {
+    public:
+        ///
+        /// @brief Constructor
+        /// @param ctx Context
+        ///
+        ModelLoader(Context* ctx)
+            : ctx(ctx),
+            uploadBudget(2.f),
+            imported(),
+            uploading(),
+            importing(0)
+        {
+        }
+
+        ///
+        /// @brief Destructor (waits for the imports in progress)
+        ///
+        ~ModelLoader() {
+            wait();
+        }
+
+        ///
+        /// @brief Load a model in the background, it is ready after a few updates
+        /// @param filename Filename
+        /// @param options Import options
+        /// @return Model (not ready, drawn as its placeholder)
+        ///
+        Model* load(const std::string& filename, const ModelImportOptions& options = ModelImportOptions());
+
+        ///
+        /// @brief Upload the imported models within the budget, called once per frame by the render thread
+        ///
+        void update();
+
+        ///
+        /// @brief Wait for the imports in progress (their upload still happens in update)
+        ///
+        void wait();
+
+        ///
+        /// @brief Set the time spent uploading each frame
+        /// @param milliseconds Budget (at least one mesh is uploaded per frame)
+        ///
+        inline void setUploadBudget(f32 milliseconds) {
+            uploadBudget = milliseconds;
+        }
+
+        ///
+        /// @brief Get the time spent uploading each frame
+        /// @return Budget in milliseconds
+        ///
+        inline f32 getUploadBudget() const {
+            return uploadBudget;
+        }
+
+        ///
+        /// @brief Get the number of models not ready yet
+        /// @return Models
+        ///
+        inline u32 getPendingCount() const {
+            return importing + (u32)uploading.size();
+        }
+
+    private:
+        ModelLoader(const ModelLoader&);
+        ModelLoader& operator=(const ModelLoader&);
+
+    private:
+        Context* ctx;
+        f32 uploadBudget;
+        MpscQueue<Model*> imported; // workers to render thread
+        std::vector<Model*> uploading; // render thread, oldest first
+        std::atomic<u32> importing;
+    };
+}
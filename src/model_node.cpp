@@ -3,10 +3,211 @@
 #include "material.hpp"
 #include "mesh.hpp"
 #include "context.hpp"
+#include "render_queue.hpp"
+#include "glb_reader.hpp"
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstring>
 
 namespace ay
 {
+    ///
+    /// @brief Read an accessor as floats (normalized integers are converted to [0, 1] or [-1, 1])
+    /// @param accessor Accessor
+    /// @return Values (count * components)
+    ///
+    static std::vector<f32> readAccessor(const AccessorView& accessor) {
+        const size_t components = (size_t)accessor.components;
+        const size_t componentSize = (size_t)tinygltf::GetComponentSizeInBytes(accessor.componentType);
+
+        std::vector<f32> values(accessor.count * components);
+        for (size_t i = 0; i < accessor.count; i++) {
+            for (size_t c = 0; c < components; c++) {
+                const u8* ptr = accessor.data + i * accessor.stride + c * componentSize;
+                f32 value = 0.f;
+                switch (accessor.componentType) {
+                case TINYGLTF_COMPONENT_TYPE_FLOAT: { f32 v; std::memcpy(&v, ptr, sizeof(v)); value = v; break; }
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: value = accessor.normalized ? *ptr / 255.f : (f32)*ptr; break;
+                case TINYGLTF_COMPONENT_TYPE_BYTE: { i8 v = (i8)*ptr; value = accessor.normalized ? std::max(v / 127.f, -1.f) : (f32)v; break; }
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: { u16 v; std::memcpy(&v, ptr, sizeof(v)); value = accessor.normalized ? v / 65535.f : (f32)v; break; }
+                case TINYGLTF_COMPONENT_TYPE_SHORT: { i16 v; std::memcpy(&v, ptr, sizeof(v)); value = accessor.normalized ? std::max(v / 32767.f, -1.f) : (f32)v; break; }
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: { u32 v; std::memcpy(&v, ptr, sizeof(v)); value = (f32)v; break; }
+                default: break;
+                }
+                values[i * components + c] = value;
+            }
+        }
+        return values;
+    }
+
+    ///
+    /// @brief Read an index accessor
+    /// @param accessor Accessor
+    /// @param indices Output, indices
+    /// @return False if the accessor is not a scalar unsigned byte, short or int
+    ///
+    static bool readIndices(const AccessorView& accessor, std::vector<u32>& indices) {
+        if (accessor.components != 1 || (accessor.componentType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE &&
+            accessor.componentType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT && accessor.componentType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)) {
+            return false;
+        }
+
+        indices.resize(accessor.count);
+        for (size_t i = 0; i < accessor.count; i++) {
+            const u8* ptr = accessor.data + i * accessor.stride;
+            switch (accessor.componentType) {
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: indices[i] = *ptr; break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: { u16 v; std::memcpy(&v, ptr, sizeof(v)); indices[i] = v; break; }
+            default: std::memcpy(&indices[i], ptr, sizeof(u32)); break;
+            }
+        }
+        return true;
+    }
+
+    ///
+    /// @brief Point to the elements of a tinygltf accessor
+    /// @param model glTF model
+    /// @param accessor Accessor (with a buffer view)
+    /// @return View
+    ///
+    static AccessorView accessorView(const tinygltf::Model& model, const tinygltf::Accessor& accessor) {
+        const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+        AccessorView result;
+        result.data = model.buffers[view.buffer].data.data() + view.byteOffset + accessor.byteOffset;
+        result.count = accessor.count;
+        result.stride = (size_t)accessor.ByteStride(view);
+        result.componentType = (u32)accessor.componentType;
+        result.components = (u32)tinygltf::GetNumComponentsInType((u32)accessor.type);
+        result.normalized = accessor.normalized;
+        result.minValues = accessor.minValues;
+        result.maxValues = accessor.maxValues;
+        return result;
+    }
+
+    ///
+    /// @brief Local transform of a glTF node
+    /// @param matrix Matrix (16 values or empty)
+    /// @param translation Translation (3 values or empty)
+    /// @param rotation Quaternion x y z w (4 values or empty)
+    /// @param scale Scale (3 values or empty)
+    /// @return Transform
+    ///
+    static Transform nodeTransform(const std::vector<f64>& matrix, const std::vector<f64>& translation,
+        const std::vector<f64>& rotation, const std::vector<f64>& scale)
+    {
+        Transform transform;
+        if (matrix.size() == 16) {
+            return Transform(glm::make_mat4(matrix.data()));
+        }
+
+        if (translation.size() >= 3) {
+            transform.position = glm::vec3((f32)translation[0], (f32)translation[1], (f32)translation[2]);
+        }
+
+        if (scale.size() >= 3) {
+            transform.scale = glm::vec3((f32)scale[0], (f32)scale[1], (f32)scale[2]);
+        }
+
+        if (rotation.size() >= 4) {
+            transform.rotation = glm::quat((f32)rotation[3], (f32)rotation[0], (f32)rotation[1], (f32)rotation[2]);
+        }
+        return transform;
+    }
+
+    ///
+    /// @brief Create a material from a glTF material
+    /// @param material glTF material
+    /// @return Material
+    ///
+    static Material* readMaterial(const tinygltf::Material& material) {
+        const tinygltf::PbrMetallicRoughness& pbr = material.pbrMetallicRoughness;
+        Material* mat = new Material();
+        mat->alphaCutoff = (f32)material.alphaCutoff;
+        mat->baseColor = Color((f32)pbr.baseColorFactor[0], (f32)pbr.baseColorFactor[1], (f32)pbr.baseColorFactor[2], (f32)pbr.baseColorFactor[3]);
+        mat->metallicFactor = (f32)pbr.metallicFactor;
+        mat->emissiveFactor = Color((f32)material.emissiveFactor[0], (f32)material.emissiveFactor[1], (f32)material.emissiveFactor[2]);
+        mat->doubleSided = material.doubleSided;
+        mat->roughnessFactor = (f32)pbr.roughnessFactor;
+        mat->name = material.name;
+        mat->alphaMode = material.alphaMode == "MASK" ? Material::AlphaMode::MASK_MODE :
+            (material.alphaMode == "BLEND" ? Material::AlphaMode::BLEND_MODE : Material::AlphaMode::OPAQUE_MODE);
+        return mat;
+    }
+
+    ///
+    /// @brief Create a material from the JSON of a glTF material (same defaults as tinygltf)
+    /// @param material JSON material
+    /// @return Material
+    ///
+    static Material* readMaterial(const nlohmann::json& material) {
+        static const nlohmann::json noPbr = nlohmann::json::object();
+        auto it = material.find("pbrMetallicRoughness");
+        const nlohmann::json& pbr = it != material.end() ? *it : noPbr;
+        const std::vector<f64> baseColor = pbr.value("baseColorFactor", std::vector<f64>{ 1.0, 1.0, 1.0, 1.0 });
+        const std::vector<f64> emissive = material.value("emissiveFactor", std::vector<f64>{ 0.0, 0.0, 0.0 });
+        const std::string alphaMode = material.value("alphaMode", std::string("OPAQUE"));
+
+        Material* mat = new Material();
+        mat->alphaCutoff = material.value("alphaCutoff", .5f);
+        if (baseColor.size() >= 4) {
+            mat->baseColor = Color((f32)baseColor[0], (f32)baseColor[1], (f32)baseColor[2], (f32)baseColor[3]);
+        }
+        mat->metallicFactor = pbr.value("metallicFactor", 1.f);
+        if (emissive.size() >= 3) {
+            mat->emissiveFactor = Color((f32)emissive[0], (f32)emissive[1], (f32)emissive[2]);
+        }
+        mat->doubleSided = material.value("doubleSided", false);
+        mat->roughnessFactor = pbr.value("roughnessFactor", 1.f);
+        mat->name = material.value("name", std::string());
+        mat->alphaMode = alphaMode == "MASK" ? Material::AlphaMode::MASK_MODE :
+            (alphaMode == "BLEND" ? Material::AlphaMode::BLEND_MODE : Material::AlphaMode::OPAQUE_MODE);
+        return mat;
+    }
+
+    static const u32 MAX_NODE_DEPTH = 256; // the nodes are processed recursively on the loader thread
+
+    ///
+    /// @brief Check that a node can join the hierarchy, a node listed twice would make a cycle or a shared subtree
+    /// @param index glTF node index
+    /// @param count Number of glTF nodes
+    /// @param visited Nodes already in the hierarchy, updated
+    /// @param depth Depth of the node
+    /// @return False if the node is refused
+    ///
+    static bool visitNode(i32 index, size_t count, std::vector<u8>& visited, u32 depth) {
+        if (index < 0 || (size_t)index >= count) {
+            return false;
+        }
+        if (visited[(size_t)index] != 0) {
+            spdlog::error("Node {} ignored, it is already in the hierarchy", index);
+            return false;
+        }
+        if (depth >= MAX_NODE_DEPTH) {
+            spdlog::error("Node {} ignored, the hierarchy is deeper than {} nodes", index, MAX_NODE_DEPTH);
+            return false;
+        }
+        visited[(size_t)index] = 1;
+        return true;
+    }
+
+    ///
+    /// @brief Texture parameters of a glTF sampler (mipmapped, trilinear by default)
+    /// @param minFilter Minification filter (-1 if undefined)
+    /// @param magFilter Magnification filter (-1 if undefined)
+    /// @param wrapS Wrap mode along s
+    /// @param wrapT Wrap mode along t
+    /// @return Parameters
+    ///
+    static Texture2DParameters samplerParameters(i32 minFilter, i32 magFilter, i32 wrapS, i32 wrapT) {
+        Texture2DParameters params;
+        params.min = minFilter > 0 ? minFilter : GL_LINEAR_MIPMAP_LINEAR;
+        params.mag = magFilter > 0 ? magFilter : GL_LINEAR;
+        params.wrapS = wrapS;
+        params.wrapT = wrapT;
+        params.mipmap = true;
+        return params;
+    }
+
     ModelNode::~ModelNode() {
         for (auto mesh : meshes) {
             delete mesh;
@@ -17,149 +218,486 @@ namespace ay
         }
     }
 
-    void ModelNode::render() const {
-        for (size_t i = 0; i < meshes.size(); i++) {
-            // default material
-            Material* material = new Material();
-            material->baseColor = Color::white();
-
-            if (materials[i] >= 0) {
-                delete material;
-                material = model.materials.at(materials[i]);
-            }
-
-            model.ctx->shaderUniform("material.baseColor", material->baseColor.toVec());
-            model.ctx->shaderUniform("material.metallicFactor", material->metallicFactor);
-            model.ctx->shaderUniform("material.roughnessFactor", material->roughnessFactor);
-            model.ctx->shaderUniform("material.emissiveFactor", material->emissiveFactor.toVec());
+    void ModelNode::setTransform(const Transform& transform) {
+        this->transform = transform;
+        if (index < model.transforms.size()) {
+            // marked dirty only if it changed
+            model.transforms.set(index, transform);
+        }
+    }
 
-            auto _transform = getTransform();
-            model.ctx->shaderUniform("modelMatrix", _transform);
-            model.ctx->shaderUniform("normalMatrix", glm::transpose(glm::inverse(_transform)));
+    Transform ModelNode::getTransform() const {
+        return index < model.transforms.size() ? model.transforms.get(index) : transform;
+    }
 
-            meshes[i]->render();
+    void ModelNode::updateBounds(std::vector<u32>& moved) {
+        if (model.transforms.isChanged(index)) {
+            const glm::mat4& worldMatrix = model.transforms.getWorldMatrix(index);
+            for (size_t i = 0; i < meshes.size(); i++) {
+                model.meshBounds[firstMesh + i] = meshes[i]->bounds.transform(worldMatrix);
+                moved.push_back(firstMesh + (u32)i);
+            }
         }
 
         for (auto child : children) {
-            child->render();
+            child->updateBounds(moved);
         }
     }
 
-    ModelNode* ModelNode::processNode(tinygltf::Model model, tinygltf::Node node) {
-        auto translation = node.translation;
-        auto rotation = node.rotation;
-        auto scale = node.scale;
-        auto matrix = node.matrix;
-
-        ModelNode* _node = new ModelNode(*this);
+    void ModelNode::render(RenderQueue& queue, const InstanceBatch* batch) const {
+        const ShaderFeatures& sceneFeatures = model.ctx->shaderGetSceneFeatures();
+        const glm::mat4& worldMatrix = model.transforms.getWorldMatrix(index);
+        const glm::mat3& normalMatrix = model.transforms.getNormalMatrix(index);
 
-        if (matrix.size() > 0) {
-            _node->transform = Transform(glm::make_mat4(matrix.data()));
+        // the variants only change with the lights of the scene
+        const u32 sceneKey = (u32)sceneFeatures.pointLights | ((u32)sceneFeatures.directionalLights << 8);
+        if (shadersKey != sceneKey || shaders.size() != meshes.size() * 2) {
+            shaders.assign(meshes.size() * 2, 0);
+            shadersKey = sceneKey;
         }
-        else {
-            if (translation.size() > 0) {
-                _node->transform.position = glm::vec3((f32)translation[0], (f32)translation[1], (f32)translation[2]);
+
+        for (size_t i = 0; i < meshes.size(); i++) {
+            if (batch == nullptr && !model.visibleMeshes[firstMesh + i]) {
+                continue;
             }
 
-            if (scale.size() > 0) {
-                _node->transform.scale = glm::vec3((f32)scale[0], (f32)scale[1], (f32)scale[2]);
+            Shader& shader = shaders[batch != nullptr ? meshes.size() + i : i];
+            if (shader == 0) {
+                ShaderFeatures meshFeatures = features[i];
+                meshFeatures.pointLights = sceneFeatures.pointLights;
+                meshFeatures.directionalLights = sceneFeatures.directionalLights;
+                meshFeatures.instanced = batch != nullptr;
+                shader = model.ctx->shaderVariant("default", meshFeatures);
             }
 
-            if (rotation.size() > 0) {
-                _node->transform.rotation = glm::quat(glm::vec3((f32)rotation[0], (f32)rotation[1], (f32)rotation[2]));
+            const Mesh* mesh = meshes[i];
+            DrawPacket packet;
+            packet.pass = passes[i];
+            packet.shader = shader;
+            packet.materials = model.materialsBuffer;
+            packet.materialsOffset = model.materialsOffset(materials[i]);
+            packet.materialIndex = model.materialIndex(materials[i]);
+            packet.texture = features[i].baseColorTexture ? model.materials.at(materials[i])->baseColorTexture : 0;
+            packet.vao = mesh->arena->getVao();
+            packet.mode = mesh->drawMode;
+            packet.type = GL_UNSIGNED_INT;
+            packet.baseVertex = (GLint)mesh->range.baseVertex;
+            packet.modelMatrix = worldMatrix;
+            packet.normalMatrix = normalMatrix;
+
+            if (batch == nullptr) {
+                const BoundingBox& bounds = model.meshBounds[firstMesh + i];
+                lodLevels.resize(meshes.size(), 0);
+                const MeshLod& lod = mesh->lods[queue.selectLod(bounds, mesh->lods, lodLevels[i])];
+                packet.count = (GLsizei)lod.indexCount;
+                packet.offset = (GLvoid*)(((size_t)mesh->range.firstIndex + lod.firstIndex) * sizeof(u32));
+                packet.bounds = bounds;
+                packet.instances = 0;
+                packet.instanceCount = 0;
+                packet.firstInstance = 0;
+                packet.object = mesh;
+                packet.occluder = occluder && !mesh->occluder.indices.empty() ? &mesh->occluder : nullptr;
+                queue.push(packet);
+                continue;
+            }
+
+            // the instances were culled and grouped by level of detail, one draw per level
+            const InstanceRange* ranges = batch->ranges + batch->meshRanges[firstMesh + i];
+            for (size_t level = 0; level < mesh->lods.size(); level++) {
+                const InstanceRange& range = ranges[level];
+                if (range.count == 0) {
+                    continue;
+                }
+
+                const MeshLod& lod = mesh->lods[level];
+                packet.count = (GLsizei)lod.indexCount;
+                packet.offset = (GLvoid*)(((size_t)mesh->range.firstIndex + lod.firstIndex) * sizeof(u32));
+                packet.bounds = range.bounds;
+                packet.instances = batch->buffer;
+                packet.instanceCount = (GLsizei)range.count;
+                packet.firstInstance = range.first;
+                packet.object = &range;
+                packet.occluder = nullptr;
+                queue.push(packet);
             }
         }
 
+        for (auto child : children) {
+            child->render(queue, batch);
+        }
+    }
+
+    ModelNode* ModelNode::processNode(const tinygltf::Model& tmodel, i32 index, std::vector<u8>& visited, u32 depth) {
+        if (!visitNode(index, tmodel.nodes.size(), visited, depth)) {
+            return nullptr;
+        }
+
+        const tinygltf::Node& node = tmodel.nodes[(size_t)index];
+        ModelNode* _node = new ModelNode(this->model);
+        _node->transform = nodeTransform(node.matrix, node.translation, node.rotation, node.scale);
+
         if (node.mesh >= 0) {
-            _node->processMesh(model, model.meshes[node.mesh]);
+            _node->processMesh(tmodel, tmodel.meshes[node.mesh]);
         }
 
         // if child process them
         for (auto childNode : node.children) {
-            _node->addChild(processNode(model, model.nodes[childNode]));
+            ModelNode* child = processNode(tmodel, childNode, visited, depth + 1);
+            if (child) {
+                _node->addChild(child);
+            }
         }
 
         return _node;
     }
 
-    void ModelNode::processMesh(tinygltf::Model tmodel, tinygltf::Mesh tmesh) {
-        for (auto primitive : tmesh.primitives) {
-            Mesh* mesh = new Mesh(model.ctx);
-            meshes.push_back(mesh);
+    ModelNode* ModelNode::processNode(const GlbReader& reader, i32 index, std::vector<u8>& visited, u32 depth) {
+        const nlohmann::json& nodes = reader.getArray("nodes");
+        if (!visitNode(index, nodes.size(), visited, depth)) {
+            return nullptr;
+        }
+
+        const nlohmann::json& node = nodes[(size_t)index];
+        ModelNode* _node = new ModelNode(this->model);
+        // a field of the wrong type throws, the import gives up on the whole file
+        try {
+            _node->transform = nodeTransform(node.value("matrix", std::vector<f64>()), node.value("translation", std::vector<f64>()),
+                node.value("rotation", std::vector<f64>()), node.value("scale", std::vector<f64>()));
+
+            const nlohmann::json& meshes = reader.getArray("meshes");
+            const i32 mesh = node.value("mesh", -1);
+            if (mesh >= 0 && (size_t)mesh < meshes.size()) {
+                _node->processMesh(reader, meshes[(size_t)mesh]);
+            }
 
-            // Material
+            for (auto childNode : node.value("children", std::vector<i32>())) {
+                ModelNode* child = processNode(reader, childNode, visited, depth + 1);
+                if (child) {
+                    _node->addChild(child);
+                }
+            }
+        }
+        catch (...) {
+            delete _node;
+            throw;
+        }
+
+        return _node;
+    }
+
+    void ModelNode::processMesh(const tinygltf::Model& tmodel, const tinygltf::Mesh& tmesh) {
+        for (auto& primitive : tmesh.primitives) {
             i32 materialIndex = primitive.material;
-            materials.push_back(materialIndex);
             if (materialIndex >= 0 && model.materials.find(materialIndex) == model.materials.end()) {
-                auto material = tmodel.materials[materialIndex];
-                auto pbr = material.pbrMetallicRoughness;
-                Material* mat = new Material();
-                mat->alphaCutoff = (f32)material.alphaCutoff;
-                mat->baseColor = Color((f32)pbr.baseColorFactor[0], (f32)pbr.baseColorFactor[1], (f32)pbr.baseColorFactor[2], (f32)pbr.baseColorFactor[3]);
-                mat->metallicFactor = (f32)pbr.metallicFactor;
-                mat->emissiveFactor = Color((f32)material.emissiveFactor[0], (f32)material.emissiveFactor[1], (f32)material.emissiveFactor[2]);
-                mat->doubleSided = material.doubleSided;
-                mat->roughnessFactor = (f32)pbr.roughnessFactor;
-                mat->name = material.name;
-                model.materials.insert(std::make_pair(materialIndex, mat));
-            }
-
-            model.ctx->vaoUse(mesh->vao);
-
-            // VBOs
+                Material* material = readMaterial(tmodel.materials[materialIndex]);
+                model.materials.insert(std::make_pair(materialIndex, material));
+                readTextures(tmodel, tmodel.materials[materialIndex], *material);
+            }
+
+            std::vector<std::pair<std::string, AccessorView>> attributes;
             for (auto& attribute : primitive.attributes) {
-                auto attrName = attribute.first;
-                auto accessor = tmodel.accessors[attribute.second];
-                i32 index = -1;
-                index = (attrName == "POSITION") ? 0 : index;
-                index = (attrName == "NORMAL") ? 1 : index;
-                index = (attrName == "TEXCOORD_0") ? 2 : index;
-                index = (attrName == "COLOR_0") ? 3 : index;
-
-                if (index == -1) continue;
-                auto bufferView = tmodel.bufferViews[accessor.bufferView];
-                auto buffer = tmodel.buffers[bufferView.buffer];
-                i32 stride = accessor.ByteStride(bufferView);
-
-                model.ctx->bufferUse<BufferUsage::ARRAY>(mesh->buffers[(size_t)(index)+1]);
-
-                GLsizeiptr bufferSize = 0;
-                if (bufferView.byteLength + bufferView.byteOffset + accessor.byteOffset >= buffer.data.size()) {
-                    bufferSize = buffer.data.size() - (bufferView.byteOffset + accessor.byteOffset);
+                const tinygltf::Accessor& accessor = tmodel.accessors[attribute.second];
+                if (accessor.bufferView >= 0) {
+                    attributes.push_back(std::make_pair(attribute.first, accessorView(tmodel, accessor)));
                 }
-                else {
-                    bufferSize = bufferView.byteLength;
+            }
+
+            AccessorView indices;
+            const bool indexed = primitive.indices >= 0;
+            if (indexed) {
+                indices = accessorView(tmodel, tmodel.accessors[primitive.indices]);
+            }
+            processPrimitive(attributes, indexed ? &indices : nullptr, materialIndex, primitive.mode);
+        }
+    }
+
+    void ModelNode::processMesh(const GlbReader& reader, const nlohmann::json& tmesh) {
+        const nlohmann::json& materialsJson = reader.getArray("materials");
+        static const nlohmann::json noPrimitives = nlohmann::json::array();
+        auto primitives = tmesh.find("primitives");
+        for (auto& primitive : primitives != tmesh.end() ? *primitives : noPrimitives) {
+            i32 materialIndex = primitive.value("material", -1);
+            if ((size_t)(materialIndex + 1) > materialsJson.size()) {
+                materialIndex = -1;
+            }
+            if (materialIndex >= 0 && model.materials.find(materialIndex) == model.materials.end()) {
+                Material* material = readMaterial(materialsJson[(size_t)materialIndex]);
+                model.materials.insert(std::make_pair(materialIndex, material));
+                readTextures(reader, materialsJson[(size_t)materialIndex], *material);
+            }
+
+            std::vector<std::pair<std::string, AccessorView>> attributes;
+            auto attributesJson = primitive.find("attributes");
+            if (attributesJson != primitive.end() && attributesJson->is_object()) {
+                for (auto it = attributesJson->begin(); it != attributesJson->end(); ++it) {
+                    AccessorView view;
+                    if (it->is_number_integer() && reader.getAccessor(it->get<i32>(), view)) {
+                        attributes.push_back(std::make_pair(it.key(), view));
+                    }
                 }
+            }
+
+            AccessorView indices;
+            const bool indexed = reader.getAccessor(primitive.value("indices", -1), indices);
+            processPrimitive(attributes, indexed ? &indices : nullptr, materialIndex, primitive.value("mode", -1));
+        }
+    }
+
+    void ModelNode::readTextures(const tinygltf::Model& tmodel, const tinygltf::Material& tmaterial, Material& material) {
+        const i32 textures[] = {
+            tmaterial.pbrMetallicRoughness.baseColorTexture.index,
+            tmaterial.pbrMetallicRoughness.metallicRoughnessTexture.index,
+            tmaterial.normalTexture.index,
+            tmaterial.occlusionTexture.index,
+            tmaterial.emissiveTexture.index
+        };
+        Texture2D* slots[] = {
+            &material.baseColorTexture,
+            &material.metallicRoughnessTexture,
+            &material.normalTexture,
+            &material.occlusionTexture,
+            &material.emissiveTexture
+        };
+
+        for (size_t i = 0; i < sizeof(textures) / sizeof(textures[0]); i++) {
+            if (textures[i] < 0 || (size_t)textures[i] >= tmodel.textures.size()) {
+                continue;
+            }
+
+            // an image only named by an extension (KHR_texture_basisu, ...) cannot be decoded
+            const tinygltf::Texture& texture = tmodel.textures[(size_t)textures[i]];
+            if (texture.source < 0 || (size_t)texture.source >= tmodel.images.size()) {
+                spdlog::warn("Texture {} ignored, it has no image to decode", textures[i]);
+                continue;
+            }
+
+            Model::PendingImage* pending = model.addTexture(*slots[i], texture.source);
+            if (pending == nullptr) {
+                continue;
+            }
+
+            const tinygltf::Image& image = tmodel.images[(size_t)texture.source];
+            Model::ImageSource imageSource;
+            if (image.bufferView >= 0) {
+                // validated by tinygltf
+                const tinygltf::BufferView& bufferView = tmodel.bufferViews[(size_t)image.bufferView];
+                imageSource.encoded = tmodel.buffers[(size_t)bufferView.buffer].data.data() + bufferView.byteOffset;
+                imageSource.encodedSize = bufferView.byteLength;
+            }
+            else if (!image.image.empty()) {
+                imageSource.encoded = image.image.data();
+                imageSource.encodedSize = image.image.size();
+            }
+            imageSource.uri = image.uri;
+            pending->sources.push_back(imageSource);
+
+            if (texture.sampler >= 0 && (size_t)texture.sampler < tmodel.samplers.size()) {
+                const tinygltf::Sampler& sampler = tmodel.samplers[(size_t)texture.sampler];
+                pending->params = samplerParameters(sampler.minFilter, sampler.magFilter, sampler.wrapS, sampler.wrapT);
+            }
+            else {
+                pending->params = samplerParameters(-1, -1, GL_REPEAT, GL_REPEAT);
+            }
+        }
+    }
+
+    void ModelNode::readTextures(const GlbReader& reader, const nlohmann::json& tmaterial, Material& material) {
+        static const nlohmann::json none = nlohmann::json::object();
+        auto pbr = tmaterial.find("pbrMetallicRoughness");
+        const nlohmann::json& pbrJson = pbr != tmaterial.end() && pbr->is_object() ? *pbr : none;
+        const nlohmann::json* textureInfos[] = { &pbrJson, &pbrJson, &tmaterial, &tmaterial, &tmaterial };
+        const char* names[] = { "baseColorTexture", "metallicRoughnessTexture", "normalTexture", "occlusionTexture", "emissiveTexture" };
+        Texture2D* slots[] = {
+            &material.baseColorTexture,
+            &material.metallicRoughnessTexture,
+            &material.normalTexture,
+            &material.occlusionTexture,
+            &material.emissiveTexture
+        };
+
+        const nlohmann::json& textures = reader.getArray("textures");
+        const nlohmann::json& images = reader.getArray("images");
+        const nlohmann::json& samplers = reader.getArray("samplers");
+        for (size_t i = 0; i < sizeof(slots) / sizeof(slots[0]); i++) {
+            auto info = textureInfos[i]->find(names[i]);
+            if (info == textureInfos[i]->end() || !info->is_object()) {
+                continue;
+            }
+
+            const i32 textureIndex = info->value("index", -1);
+            if (textureIndex < 0 || (size_t)textureIndex >= textures.size()) {
+                continue;
+            }
+
+            // an image only named by an extension (KHR_texture_basisu, ...) cannot be decoded
+            const nlohmann::json& texture = textures[(size_t)textureIndex];
+            const i32 source = texture.value("source", -1);
+            if (source < 0 || (size_t)source >= images.size()) {
+                spdlog::warn("Texture {} ignored, it has no image to decode", textureIndex);
+                continue;
+            }
+
+            Model::PendingImage* pending = model.addTexture(*slots[i], source);
+            if (pending == nullptr) {
+                continue;
+            }
+
+            const nlohmann::json& image = images[(size_t)source];
+            Model::ImageSource imageSource;
+            if (!reader.getBufferView(image.value("bufferView", -1), imageSource.encoded, imageSource.encodedSize)) {
+                imageSource.encoded = nullptr;
+                imageSource.encodedSize = 0;
+                imageSource.uri = image.value("uri", std::string());
+            }
+            pending->sources.push_back(imageSource);
+
+            const i32 samplerIndex = texture.value("sampler", -1);
+            const nlohmann::json& sampler = samplerIndex >= 0 && (size_t)samplerIndex < samplers.size() ? samplers[(size_t)samplerIndex] : none;
+            pending->params = samplerParameters(sampler.value("minFilter", -1), sampler.value("magFilter", -1),
+                sampler.value("wrapS", (i32)GL_REPEAT), sampler.value("wrapT", (i32)GL_REPEAT));
+        }
+    }
+
+    void ModelNode::processPrimitive(const std::vector<std::pair<std::string, AccessorView>>& attributes, const AccessorView* indices,
+        i32 materialIndex, i32 mode)
+    {
+        Mesh* mesh = new Mesh(model.ctx);
 
-                model.ctx->bufferData<BufferUsage::ARRAY, BufferTarget::STATIC_DRAW>(bufferSize, buffer.data.data() + bufferView.byteOffset + accessor.byteOffset);
-                model.ctx->bufferAttribute((Attribute)index, (GLenum)accessor.componentType, (GLint)accessor.type, (GLsizei)stride, nullptr);
+        // Vertices
+        MeshData data;
+        for (auto& attribute : attributes) {
+            const std::string& attrName = attribute.first;
+            const AccessorView& accessor = attribute.second;
+            i32 index = -1;
+            index = (attrName == "POSITION") ? 0 : index;
+            index = (attrName == "NORMAL") ? 1 : index;
+            index = (attrName == "TEXCOORD_0") ? 2 : index;
+            index = (attrName == "COLOR_0") ? 3 : index;
 
+            if (index == -1) continue;
+            // positions, normals and colors read 3 values per vertex, texture coordinates 2
+            const u32 required = index == 2 ? 2 : 3;
+            if (accessor.components < required) {
+                spdlog::warn("Attribute {} ignored, it has {} components instead of {}", attrName, accessor.components, required);
+                continue;
+            }
+
+            const std::vector<f32> values = readAccessor(accessor);
+            data.vertices.resize(std::max(data.vertices.size(), accessor.count));
+
+            for (size_t i = 0; i < accessor.count; i++) {
+                const f32* value = values.data() + i * (size_t)accessor.components;
+                Vertex& vertex = data.vertices[i];
                 if (index == 0) {
-                    mesh->verticesCount = (u32)accessor.count;
+                    vertex.position = glm::vec3(value[0], value[1], value[2]);
                 }
                 else if (index == 1) {
-                    mesh->normalsCount = (u32)accessor.count;
+                    vertex.normal = glm::vec3(value[0], value[1], value[2]);
                 }
                 else if (index == 2) {
-                    mesh->texcoordsCount = (u32)accessor.count;
+                    vertex.uv = glm::vec2(value[0], value[1]);
                 }
-                else if (index == 3) {
-                    mesh->colorsCount = (u32)accessor.count;
+                else {
+                    vertex.color = glm::vec3(value[0], value[1], value[2]);
                 }
             }
 
-            // EBO (indices)
-            auto indexAccessor = tmodel.accessors[primitive.indices];
-            auto indicesBufferView = tmodel.bufferViews[indexAccessor.bufferView];
-            auto indicesBuffer = tmodel.buffers[indicesBufferView.buffer];
-            model.ctx->bufferUse<BufferUsage::ELEMENT>(mesh->buffers[0]);
-            model.ctx->bufferData<BufferUsage::ELEMENT, BufferTarget::STATIC_DRAW>(indicesBufferView.byteLength, indicesBuffer.data.data() + indicesBufferView.byteOffset);
-            model.ctx->bufferUse<BufferUsage::ELEMENT>(0);
-            mesh->indicesCount = (u32)indexAccessor.count;
-            mesh->drawMode = (GLenum)primitive.mode;
-            mesh->drawType = (GLenum)indexAccessor.componentType;
+            if (index == 0) {
+                mesh->verticesCount = (u32)accessor.count;
+                if (accessor.minValues.size() >= 3 && accessor.maxValues.size() >= 3) {
+                    mesh->bounds = BoundingBox(
+                        glm::vec3((f32)accessor.minValues[0], (f32)accessor.minValues[1], (f32)accessor.minValues[2]),
+                        glm::vec3((f32)accessor.maxValues[0], (f32)accessor.maxValues[1], (f32)accessor.maxValues[2]));
+                }
+            }
+            else if (index == 1) {
+                mesh->normalsCount = (u32)accessor.count;
+            }
+            else if (index == 2) {
+                mesh->texcoordsCount = (u32)accessor.count;
+            }
+            else if (index == 3) {
+                mesh->colorsCount = (u32)accessor.count;
+            }
+        }
 
-            model.ctx->vaoUse(0);
+        // Indices
+        if (indices) {
+            if (!readIndices(*indices, data.indices)) {
+                spdlog::error("Primitive dropped, its indices are not unsigned integers");
+                delete mesh;
+                return;
+            }
+        }
+        else {
+            data.indices.resize(data.vertices.size());
+            for (size_t i = 0; i < data.indices.size(); i++) {
+                data.indices[i] = (u32)i;
+            }
+        }
+
+        // the optimizer, the simplifier and the occluder index the positions without checking
+        if (mesh->verticesCount == 0) {
+            spdlog::error("Primitive dropped, it has no positions");
+            delete mesh;
+            return;
+        }
+        for (u32 index : data.indices) {
+            if (index >= mesh->verticesCount) {
+                spdlog::error("Primitive dropped, index {} out of {} vertices", index, mesh->verticesCount);
+                delete mesh;
+                return;
+            }
+        }
+
+        // min and max are optional, an empty box would be culled with whichever meshes share its hierarchy node
+        if (mesh->bounds.empty()) {
+            for (u32 i = 0; i < mesh->verticesCount; i++) {
+                mesh->bounds.merge(data.vertices[i].position);
+            }
+        }
+
+        mesh->drawMode = mode >= 0 ? (GLenum)mode : GL_TRIANGLES;
+        if (mesh->drawMode == GL_TRIANGLES && data.indices.size() % 3 != 0) {
+            spdlog::warn("Primitive has {} indices, the last incomplete triangle is ignored", data.indices.size());
+            data.indices.resize(data.indices.size() - data.indices.size() % 3);
+        }
+        // uploaded once every mesh is loaded, after the optional optimization
+        const VertexLayout layout = VertexLayout::select(data, model.options.quantize);
+        model.pendingMeshes.push_back({ mesh, std::move(data), layout, std::vector<MeshLod>(), nullptr, nullptr });
+        addMesh(mesh, materialIndex, layout.hasOctNormals());
+    }
+
+    void ModelNode::addMesh(Mesh* mesh, i32 materialIndex, bool octNormals) {
+        meshes.push_back(mesh);
+        materials.push_back(materialIndex);
+
+        // Shader features
+        ShaderFeatures meshFeatures;
+        meshFeatures.vertexColor = mesh->colorsCount > 0;
+        meshFeatures.texcoord = mesh->texcoordsCount > 0;
+        meshFeatures.octNormals = octNormals;
+        if (materialIndex >= 0) {
+            const Material* mat = model.materials.at(materialIndex);
+            meshFeatures.baseColorTexture = meshFeatures.texcoord && model.hasTexture(mat->baseColorTexture);
+            meshFeatures.alphaMask = mat->alphaMode == Material::AlphaMode::MASK_MODE;
+            meshFeatures.doubleSided = mat->doubleSided;
+        }
+        features.push_back(meshFeatures);
+        passes.push_back(materialIndex >= 0 && model.materials.at(materialIndex)->alphaMode == Material::AlphaMode::BLEND_MODE ?
+            RenderPass::TRANSPARENT_PASS : RenderPass::OPAQUE_PASS);
+    }
+
+    void ModelNode::compileShaders() const {
+        const ShaderFeatures& sceneFeatures = model.ctx->shaderGetSceneFeatures();
+        for (auto meshFeatures : features) {
+            meshFeatures.pointLights = sceneFeatures.pointLights;
+            meshFeatures.directionalLights = sceneFeatures.directionalLights;
+            model.ctx->shaderVariant("default", meshFeatures);
+        }
+
+        for (auto child : children) {
+            child->compileShaders();
         }
     }
-}
\ No newline at end of file
+}
@@ -1,23 +1,64 @@
 #pragma once
 
 #include "types.hpp"
+#include "context.hpp"
 #include "tiny_gltf.h"
+#include "json.hpp"
 #include "transform.hpp"
+#include "bounds.hpp"
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace ay
 {
     class Model;
+    class GlbReader;
+    struct AccessorView;
     class Mesh;
+    class Material;
+    class RenderQueue;
+    struct InstanceBatch;
+    enum class RenderPass;
 
     class ModelNode {
+    public:
+        ///
+        /// @brief Set the local transform, the node and its descendants are recomposed on the next update
+        /// @param transform Local transform
+        ///
+        void setTransform(const Transform& transform);
+
+        ///
+        /// @brief Get the local transform
+        /// @return Local transform
+        ///
+        Transform getTransform() const;
+
+        ///
+        /// @brief Get the parent node
+        /// @return Parent (nullptr for the root)
+        ///
+        inline ModelNode* getParent() const {
+            return parent;
+        }
+
+        ///
+        /// @brief Get the child nodes
+        /// @return Children
+        ///
+        inline const std::vector<ModelNode*>& getChildren() const {
+            return children;
+        }
+
     private:
         ///
         /// @brief Constructor
         /// @param model Model
         /// 
         ModelNode(Model& model)
-            : model(model), parent(nullptr), children(), transform(), meshes(), materials()
+            : model(model), parent(nullptr), children(), transform(), index(0),
+            meshes(), materials(), features(), passes(), shaders(), shadersKey(0xffffffff), firstMesh(0), lodLevels(), occluder(false)
         {
         }
 
@@ -36,45 +77,120 @@ namespace ay
         }
 
         ///
-        /// @brief Get transform
-        /// @return Transform
+        /// @brief Draw the node and its children in the software depth buffer
+        /// @param enabled Enable
         ///
-        inline glm::mat4 getTransform() const {
-            glm::mat4 t = transform.getTransform(); // local transform
-            if (parent != nullptr) {
-                t *= parent->getTransform();
+        inline void setOccluder(bool enabled) {
+            occluder = enabled;
+            for (auto child : children) {
+                child->setOccluder(enabled);
             }
-            return t;
         }
 
         ///
-        /// @brief Render
+        /// @brief Refresh the world bounds of the meshes of the nodes that moved
+        /// @param moved Output, appended with the index of each refreshed mesh in the model mesh bounds
+        ///
+        void updateBounds(std::vector<u32>& moved);
+
+        ///
+        /// @brief Render (queue the draws of the node and its children)
+        /// @param queue Render queue
+        /// @param batch Instances to draw (nullptr for a single draw)
         /// 
-        void render() const;
+        void render(RenderQueue& queue, const InstanceBatch* batch) const;
+
+        ///
+        /// @brief Submit the shader variants of the node and its children (they compile in the background)
+        ///
+        void compileShaders() const;
 
         ///
         /// @brief Process Node
         /// @param model glTF model
-        /// @param node glTF node
+        /// @param index glTF node index
+        /// @param visited Nodes already in the hierarchy (one flag per glTF node)
+        /// @param depth Depth of the node
+        /// @return Node, nullptr if the index is invalid, already visited (a cycle) or too deep
         /// 
-        ModelNode* processNode(tinygltf::Model model, tinygltf::Node node);
+        ModelNode* processNode(const tinygltf::Model& model, i32 index, std::vector<u8>& visited, u32 depth);
+
+        ///
+        /// @brief Process Node of a mapped GLB
+        /// @param reader GLB reader
+        /// @param index glTF node index
+        /// @param visited Nodes already in the hierarchy (one flag per glTF node)
+        /// @param depth Depth of the node
+        /// @return Node, nullptr if the index is invalid, already visited (a cycle) or too deep
+        ///
+        ModelNode* processNode(const GlbReader& reader, i32 index, std::vector<u8>& visited, u32 depth);
 
         ///
         /// @brief Process Mesh
         /// @param model glTF model
         /// @param mesh glTF mesh
         /// 
-        void processMesh(tinygltf::Model tmodel, tinygltf::Mesh tmesh);
+        void processMesh(const tinygltf::Model& tmodel, const tinygltf::Mesh& tmesh);
+
+        ///
+        /// @brief Process Mesh of a mapped GLB
+        /// @param reader GLB reader
+        /// @param mesh JSON mesh
+        ///
+        void processMesh(const GlbReader& reader, const nlohmann::json& tmesh);
+
+        ///
+        /// @brief Bind the images of a material to its textures, they are decoded once every node is read
+        /// @param tmodel glTF model
+        /// @param tmaterial glTF material
+        /// @param material Material
+        ///
+        void readTextures(const tinygltf::Model& tmodel, const tinygltf::Material& tmaterial, Material& material);
+
+        ///
+        /// @brief Bind the images of a material of a mapped GLB to its textures
+        /// @param reader GLB reader
+        /// @param tmaterial JSON material
+        /// @param material Material
+        ///
+        void readTextures(const GlbReader& reader, const nlohmann::json& tmaterial, Material& material);
+
+        ///
+        /// @brief Read a primitive into a new mesh (uploaded with the other meshes of the model)
+        /// @param attributes Vertex attributes by glTF name
+        /// @param indices Indices (nullptr if not indexed)
+        /// @param materialIndex glTF material index (-1 for the default material)
+        /// @param mode glTF primitive mode (-1 for triangles)
+        ///
+        void processPrimitive(const std::vector<std::pair<std::string, AccessorView>>& attributes, const AccessorView* indices,
+            i32 materialIndex, i32 mode);
+
+        ///
+        /// @brief Add a mesh to the node with its shader features and pass
+        /// @param mesh Mesh
+        /// @param materialIndex glTF material index (-1 for the default material)
+        /// @param octNormals True if the vertex layout has octahedral normals
+        ///
+        void addMesh(Mesh* mesh, i32 materialIndex, bool octNormals);
 
     private:
         friend class Model;
+        friend class CookedModel;
 
     private:
         Model& model;
         ModelNode* parent;
         std::vector<ModelNode*> children;
-        Transform transform;
+        Transform transform; // local transform, seeds the model transform store when it is built
+        u32 index; // index in the model transform store
         std::vector<Mesh*> meshes;
         std::vector<i32> materials;
+        std::vector<ShaderFeatures> features;
+        std::vector<RenderPass> passes;
+        mutable std::vector<Shader> shaders; // variant of each mesh, the single draws then the instanced ones (0 until resolved)
+        mutable u32 shadersKey; // scene lights the variants were resolved for
+        u32 firstMesh; // index of the first mesh in the model mesh bounds
+        mutable std::vector<u8> lodLevels; // level of detail of each mesh the previous frame (hysteresis)
+        bool occluder;
     };
 }
\ No newline at end of file
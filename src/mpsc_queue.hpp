@@ -0,0 +1,79 @@
+#pragma once
+
+#include "types.hpp"
+#include <atomic>
+
+namespace ay
+{
+    ///
+    /// @brief Lock-free queue with many producers and one consumer (linked list swapped at the head)
+    ///
+    template <typename T>
+    class MpscQueue {
+    public:
+        ///
+        /// @brief Constructor
+        ///
+        MpscQueue()
+            : head(nullptr),
+            tail(nullptr)
+        {
+            Node* stub = new Node();
+            head.store(stub);
+            tail = stub;
+        }
+
+        ///
+        /// @brief Destructor (the values still queued are dropped)
+        ///
+        ~MpscQueue() {
+            while (tail) {
+                Node* next = tail->next.load();
+                delete tail;
+                tail = next;
+            }
+        }
+
+        ///
+        /// @brief Queue a value (any thread)
+        /// @param value Value
+        ///
+        inline void push(const T& value) {
+            Node* node = new Node();
+            node->value = value;
+            Node* previous = head.exchange(node, std::memory_order_acq_rel);
+            // the consumer stops at previous until this store, the value is never lost
+            previous->next.store(node, std::memory_order_release);
+        }
+
+        ///
+        /// @brief Take the oldest value (consumer thread only)
+        /// @param value Output, value
+        /// @return False if empty
+        ///
+        inline bool pop(T& value) {
+            Node* next = tail->next.load(std::memory_order_acquire);
+            if (next == nullptr) {
+                return false;
+            }
+            value = next->value;
+            delete tail;
+            tail = next;
+            return true;
+        }
+
+    private:
+        struct Node {
+            Node() : next(nullptr), value() {}
+            std::atomic<Node*> next;
+            T value;
+        };
+
+        MpscQueue(const MpscQueue&);
+        MpscQueue& operator=(const MpscQueue&);
+
+    private:
+        std::atomic<Node*> head; // last pushed
+        Node* tail; // already consumed, its next is the oldest value
+    };
+}
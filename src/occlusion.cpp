@@ -0,0 +1,155 @@
+#include "occlusion.hpp"
+#include "shaders/occlusion.hpp"
+
+namespace ay
+{
+    static const u32 VISIBLE_QUERY_INTERVAL = 4; // visible draws are checked again every few frames
+    static const u32 EVICT_FRAMES = 120; // entries of draws not seen for this long are removed
+    static const f32 CAMERA_MARGIN = .1f; // boxes this close to the camera may be clipped by the near plane
+
+    OcclusionCuller::OcclusionCuller(Context* ctx)
+        : ctx(ctx),
+        cubeVao(0),
+        cubeVertices(0),
+        cubeIndices(0),
+        frame(1),
+        cameraPosition(0.f),
+        entries(),
+        hidden(),
+        statistics()
+    {
+        resetStatistics();
+        ctx->shaderFromMemory("occlusion", OCCLUSION_VERTEX, OCCLUSION_FRAGMENT);
+
+        f32 vertices[] = {
+            0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 1.f, 1.f, 0.f, 0.f, 1.f, 0.f,
+            0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f, 1.f, 1.f, 0.f, 1.f, 1.f
+        };
+        u8 indices[] = {
+            0, 2, 1, 0, 3, 2,
+            4, 5, 6, 4, 6, 7,
+            0, 1, 5, 0, 5, 4,
+            3, 7, 6, 3, 6, 2,
+            0, 4, 7, 0, 7, 3,
+            1, 2, 6, 1, 6, 5
+        };
+
+        cubeVao = ctx->vaoNew();
+        cubeVertices = ctx->bufferNew();
+        cubeIndices = ctx->bufferNew();
+        ctx->vaoUse(cubeVao);
+        ctx->bufferUse<BufferUsage::ARRAY>(cubeVertices);
+        ctx->bufferData<BufferUsage::ARRAY, BufferTarget::STATIC_DRAW>(sizeof(vertices), vertices);
+        ctx->bufferAttribute(0, GL_FLOAT, 3, 0, (GLvoid*)0);
+        ctx->bufferUse<BufferUsage::ELEMENT>(cubeIndices);
+        ctx->bufferData<BufferUsage::ELEMENT, BufferTarget::STATIC_DRAW>(sizeof(indices), indices);
+        ctx->vaoUse(0);
+    }
+
+    OcclusionCuller::~OcclusionCuller() {
+        for (auto& entry : entries) {
+            if (entry.second.query != 0) {
+                ctx->queryDispose(entry.second.query);
+            }
+        }
+        ctx->vaoDispose(cubeVao);
+        ctx->bufferDispose(cubeVertices);
+        ctx->bufferDispose(cubeIndices);
+        ctx->shaderDispose("occlusion");
+    }
+
+    void OcclusionCuller::begin(const glm::vec3& _cameraPosition) {
+        frame++;
+        cameraPosition = _cameraPosition;
+        hidden.clear();
+
+        for (auto it = entries.begin(); it != entries.end();) {
+            Entry& entry = it->second;
+            if (frame - entry.lastUsed > EVICT_FRAMES) {
+                if (entry.query != 0) {
+                    ctx->queryDispose(entry.query);
+                }
+                it = entries.erase(it);
+                continue;
+            }
+
+            // never wait on the GPU, a result not ready keeps the last known visibility
+            if (entry.pending) {
+                if (ctx->queryAvailable(entry.query)) {
+                    entry.visible = ctx->queryResult(entry.query);
+                    entry.pending = false;
+                }
+                else {
+                    statistics.stallsAvoided++;
+                }
+            }
+            ++it;
+        }
+    }
+
+    bool OcclusionCuller::test(const void* object, Buffer instances, const BoundingBox& bounds, Query& query) {
+        Entry& entry = entries[std::make_pair(object, instances)];
+        entry.lastUsed = frame;
+        entry.bounds = bounds;
+        query = 0;
+
+        // the box would be clipped by the near plane, the query cannot be trusted
+        const glm::vec3 margin(CAMERA_MARGIN);
+        const glm::vec3 lo = bounds.min - margin, hi = bounds.max + margin;
+        if (cameraPosition.x >= lo.x && cameraPosition.y >= lo.y && cameraPosition.z >= lo.z &&
+            cameraPosition.x <= hi.x && cameraPosition.y <= hi.y && cameraPosition.z <= hi.z) {
+            entry.visible = true;
+            return true;
+        }
+
+        if (entry.visible) {
+            // query the draw itself, it costs nothing more than the draw
+            if (!entry.pending && frame - entry.lastQueried >= VISIBLE_QUERY_INTERVAL) {
+                if (entry.query == 0) {
+                    entry.query = ctx->queryNew();
+                }
+                entry.pending = true;
+                entry.lastQueried = frame;
+                statistics.queries++;
+                query = entry.query;
+            }
+            return true;
+        }
+
+        statistics.occluded++;
+        if (!entry.pending) {
+            hidden.push_back(&entry);
+        }
+        return false;
+    }
+
+    void OcclusionCuller::queryHidden() {
+        if (hidden.empty()) {
+            return;
+        }
+
+        ctx->shaderUse("occlusion");
+        const Uniform boxMin = ctx->shaderUniformLocation("boxMin");
+        const Uniform boxMax = ctx->shaderUniformLocation("boxMax");
+        ctx->vaoUse(cubeVao);
+        ctx->writeMask(false, false);
+
+        for (auto entry : hidden) {
+            if (entry->query == 0) {
+                entry->query = ctx->queryNew();
+            }
+            entry->pending = true;
+            entry->lastQueried = frame;
+            statistics.queries++;
+
+            ctx->shaderUniform(boxMin, entry->bounds.min);
+            ctx->shaderUniform(boxMax, entry->bounds.max);
+            ctx->queryBegin(entry->query);
+            ctx->draw(DrawMethod::ELEMENT, DrawParameters(GL_TRIANGLES, GL_UNSIGNED_BYTE, 36, (GLvoid*)0));
+            ctx->queryEnd();
+        }
+
+        ctx->writeMask(true, true);
+        hidden.clear();
+    }
+}
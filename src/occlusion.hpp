@@ -0,0 +1,91 @@
+#pragma once
+
+#include "types.hpp"
+#include "context.hpp"
+#include "bounds.hpp"
+#include <map>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace ay
+{
+    struct OcclusionStatistics {
+        u32 queries; // queries issued
+        u32 occluded; // draws skipped
+        u32 stallsAvoided; // results not ready, the previous visibility was used instead of waiting
+    };
+
+    class OcclusionCuller {
+    public:
+        ///
+        /// @brief Constructor
+        /// @param ctx Context
+        ///
+        OcclusionCuller(Context* ctx);
+
+        ///
+        /// @brief Destructor
+        ///
+        ~OcclusionCuller();
+
+        ///
+        /// @brief Start a frame, collect the results ready without waiting
+        /// @param cameraPosition World position of the camera
+        ///
+        void begin(const glm::vec3& cameraPosition);
+
+        ///
+        /// @brief Decide if a draw is submitted from the visibility of the previous frames
+        /// @param object Identity of the draw across frames
+        /// @param instances Instance buffer of the draw (0 if not instanced)
+        /// @param bounds World bounds
+        /// @param query Output, query to wrap the draw in (0 if none)
+        /// @return True if the draw has to be submitted
+        ///
+        bool test(const void* object, Buffer instances, const BoundingBox& bounds, Query& query);
+
+        ///
+        /// @brief Query the bounding boxes of the hidden draws (after the opaque draws, the shader and vao change)
+        ///
+        void queryHidden();
+
+        ///
+        /// @brief Get statistics since the last reset
+        /// @return Statistics
+        ///
+        inline const OcclusionStatistics& getStatistics() const {
+            return statistics;
+        }
+
+        ///
+        /// @brief Reset statistics
+        ///
+        inline void resetStatistics() {
+            statistics.queries = 0;
+            statistics.occluded = 0;
+            statistics.stallsAvoided = 0;
+        }
+
+    private:
+        struct Entry {
+            Query query = 0;
+            bool visible = true;
+            bool pending = false; // the query result has not been read yet
+            u32 lastUsed = 0; // frame
+            u32 lastQueried = 0; // frame
+            BoundingBox bounds;
+        };
+
+    private:
+        Context* ctx;
+        VAO cubeVao;
+        Buffer cubeVertices;
+        Buffer cubeIndices;
+        u32 frame;
+        glm::vec3 cameraPosition;
+        std::map<std::pair<const void*, Buffer>, Entry> entries;
+        std::vector<Entry*> hidden; // box queries of this frame
+        OcclusionStatistics statistics;
+    };
+}
@@ -0,0 +1,270 @@
+#include "render_queue.hpp"
+#include "mesh.hpp"
+#include "material.hpp"
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+
+namespace ay
+{
+    static const Attribute INSTANCE_MODEL_MATRIX = 4; // 4 to 7
+    static const Attribute INSTANCE_NORMAL_MATRIX = 8; // 8 to 10
+    static const Attribute INSTANCE_COLOR = 11;
+    static const f32 LOD_PIXEL_ERROR = 1.f; // tolerated simplification error on screen
+    static const f32 LOD_MIN_DISTANCE = .01f;
+
+    ///
+    /// @brief Quantize a view depth, the bits of a positive float are ordered like its value
+    ///
+    static unsigned long long depthBits(f32 depth) {
+        depth = std::max(depth, 0.f);
+        u32 bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        return (unsigned long long)(bits >> 8);
+    }
+
+    u32 RenderQueue::selectLod(const BoundingBox& bounds, const std::vector<MeshLod>& lods, u8& current) const {
+        if (lods.size() <= 1 || bounds.empty()) {
+            current = 0;
+            return 0;
+        }
+
+        // projected radius of the bounding sphere (from its closest point), the errors are relative to the radius
+        const f32 radius = glm::length(bounds.extent());
+        const f32 distance = std::max(glm::length(bounds.center() - cameraPosition) - radius, LOD_MIN_DISTANCE);
+        const f32 pixels = radius * lodScale / distance;
+        const f32 threshold = LOD_PIXEL_ERROR * std::exp2(lodBias);
+
+        // coarsest level under the threshold, going coarser than the current level needs a margin against popping
+        u32 level = 0;
+        for (u32 i = 1; i < (u32)lods.size(); i++) {
+            const f32 limit = i > current ? threshold * (1.f - lodHysteresis) : threshold;
+            if (lods[i].error * pixels > limit) {
+                break;
+            }
+            level = i;
+        }
+
+        current = (u8)level;
+        return level;
+    }
+
+    void RenderQueue::cull(const BoundingVolumeHierarchy& hierarchy, std::vector<u8>& visible) {
+        statistics.tests += hierarchy.cull(frustum, visible);
+        statistics.meshes += (u32)visible.size();
+        for (u8 flag : visible) {
+            statistics.culled += flag == 0 ? 1 : 0;
+        }
+    }
+
+    void RenderQueue::push(const DrawPacket& packet) {
+        const glm::vec4 position = viewMatrix * packet.modelMatrix[3];
+        const unsigned long long depth = depthBits(-position.z);
+
+        // dense ids given by the context when the objects are created, distinct up to 4096 programs, 1024 tables and 256 vaos
+        const unsigned long long shader = ctx->shaderSortId(packet.shader);
+        const unsigned long long table = ctx->uniformRangeSortId(packet.materials, packet.materialsOffset);
+        const unsigned long long vao = ctx->vaoSortId(packet.vao);
+
+        // opaque: pass | program | materials table | material | vao | depth (front to back)
+        // transparent: pass | depth (back to front) | program | materials table | material
+        unsigned long long key = (unsigned long long)packet.pass << 62;
+        if (packet.pass == RenderPass::OPAQUE_PASS) {
+            key |= (shader & 0xfff) << 50;
+            key |= (table & 0x3ff) << 40;
+            key |= ((unsigned long long)packet.materialIndex & 0xff) << 32;
+            key |= (vao & 0xff) << 24;
+            key |= depth;
+        }
+        else {
+            key |= (~depth & 0xffffff) << 38;
+            key |= (shader & 0xfff) << 26;
+            key |= (table & 0x3ff) << 16;
+            key |= ((unsigned long long)packet.materialIndex & 0xff) << 8;
+        }
+
+        keys.push_back(key);
+        packets.push_back(packet);
+    }
+
+    void RenderQueue::occlude() {
+        rasterizer->begin(viewProjection);
+        for (auto& packet : packets) {
+            if (packet.occluder != nullptr && !packet.bounds.empty()) {
+                // solid angle of the bounding sphere
+                const f32 radius = glm::length(packet.bounds.extent());
+                const glm::vec3 direction = packet.bounds.center() - cameraPosition;
+                const f32 distanceSquared = std::max(glm::dot(direction, direction), LOD_MIN_DISTANCE * LOD_MIN_DISTANCE);
+                rasterizer->addOccluder(packet.occluder, packet.modelMatrix, radius * radius / distanceSquared);
+            }
+        }
+        rasterizer->rasterize();
+
+        size_t count = 0;
+        for (size_t i = 0; i < packets.size(); i++) {
+            if (!packets[i].bounds.empty() && !rasterizer->testBox(packets[i].bounds)) {
+                continue;
+            }
+            packets[count] = packets[i];
+            keys[count] = keys[i];
+            count++;
+        }
+        packets.resize(count);
+        keys.resize(count);
+    }
+
+    void RenderQueue::bindInstances(Buffer instances, u32 first) {
+        // no base instance in GLES, the attributes start at the first instance
+        const GLsizei stride = (GLsizei)sizeof(InstanceData);
+        const size_t base = (size_t)first * sizeof(InstanceData);
+        ctx->bufferUse<BufferUsage::ARRAY>(instances);
+        for (Attribute i = 0; i < 4; i++) {
+            ctx->bufferAttribute(INSTANCE_MODEL_MATRIX + i, GL_FLOAT, 4, stride, (GLvoid*)(base + offsetof(InstanceData, modelMatrix) + i * sizeof(glm::vec4)));
+            ctx->bufferAttributeDivisor(INSTANCE_MODEL_MATRIX + i, 1);
+        }
+        for (Attribute i = 0; i < 3; i++) {
+            ctx->bufferAttribute(INSTANCE_NORMAL_MATRIX + i, GL_FLOAT, 3, stride, (GLvoid*)(base + offsetof(InstanceData, normalMatrix) + i * sizeof(glm::vec3)));
+            ctx->bufferAttributeDivisor(INSTANCE_NORMAL_MATRIX + i, 1);
+        }
+        ctx->bufferAttribute(INSTANCE_COLOR, GL_FLOAT, 4, stride, (GLvoid*)(base + offsetof(InstanceData, color)));
+        ctx->bufferAttributeDivisor(INSTANCE_COLOR, 1);
+    }
+
+    void RenderQueue::sort() {
+        const size_t count = keys.size();
+        order.resize(count);
+        sortedKeys.resize(count);
+        sortedOrder.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            order[i] = (u32)i;
+        }
+
+        // LSD radix sort, 8 bits per pass
+        for (u32 shift = 0; shift < 64; shift += 8) {
+            size_t histogram[256] = { 0 };
+            for (size_t i = 0; i < count; i++) {
+                histogram[(keys[i] >> shift) & 0xff]++;
+            }
+
+            // every key shares this byte
+            if (histogram[(keys[0] >> shift) & 0xff] == count) {
+                continue;
+            }
+
+            size_t offset = 0;
+            for (size_t i = 0; i < 256; i++) {
+                size_t n = histogram[i];
+                histogram[i] = offset;
+                offset += n;
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                size_t slot = histogram[(keys[i] >> shift) & 0xff]++;
+                sortedKeys[slot] = keys[i];
+                sortedOrder[slot] = order[i];
+            }
+            keys.swap(sortedKeys);
+            order.swap(sortedOrder);
+        }
+    }
+
+    void RenderQueue::flush() {
+        if (rasterizer) {
+            occlude();
+        }
+        if (packets.empty()) {
+            return;
+        }
+
+        sort();
+
+        if (occlusion) {
+            occlusion->begin(cameraPosition);
+        }
+
+        Shader shader = 0;
+        bool linked = false;
+        Uniform modelMatrix = -1, normalMatrix = -1, materialIndex = -1;
+        VAO instancesVao = 0;
+        Buffer instances = 0;
+        u32 firstInstance = 0;
+        bool transparent = false;
+        for (u32 index : order) {
+            const DrawPacket& packet = packets[index];
+            if (!transparent && packet.pass != RenderPass::OPAQUE_PASS) {
+                // every occluder is in the depth buffer, the transparent draws must not hide anything
+                if (occlusion) {
+                    occlusion->queryHidden();
+                    shader = 0;
+                    instancesVao = 0;
+                }
+                // sorted back to front, tested against the opaque depth without writing it
+                ctx->blend(true);
+                ctx->writeMask(true, false);
+                transparent = true;
+            }
+
+            if (packet.shader != shader) {
+                ctx->shaderUse(packet.shader);
+                shader = packet.shader;
+                linked = ctx->shaderGetCurrent() != 0;
+                modelMatrix = ctx->shaderUniformLocation("modelMatrix");
+                normalMatrix = ctx->shaderUniformLocation("normalMatrix");
+                materialIndex = ctx->shaderUniformLocation("materialIndex");
+            }
+
+            if (!linked) {
+                continue;
+            }
+
+            Query query = 0;
+            if (occlusion && packet.pass == RenderPass::OPAQUE_PASS && packet.object != nullptr && !packet.bounds.empty() &&
+                !occlusion->test(packet.object, packet.instances, packet.bounds, query)) {
+                continue;
+            }
+
+            ctx->bufferBindRange<BufferUsage::UNIFORM>((GLuint)UniformBlockBinding::MATERIALS, packet.materials,
+                packet.materialsOffset, sizeof(MaterialData) * MATERIALS_PER_TABLE);
+            ctx->shaderUniform(materialIndex, packet.materialIndex);
+            if (packet.texture != 0) {
+                ctx->texture2DUse(packet.texture);
+            }
+            ctx->shaderUniform(modelMatrix, packet.modelMatrix);
+            ctx->shaderUniform(normalMatrix, packet.normalMatrix);
+            ctx->vaoUse(packet.vao);
+
+            if (query != 0) {
+                ctx->queryBegin(query);
+            }
+
+            if (packet.instances == 0) {
+                ctx->draw(DrawMethod::ELEMENT_BASE_VERTEX, DrawParameters(packet.mode, packet.type, packet.count, packet.offset, 0, packet.baseVertex));
+            }
+            else {
+                // the instance attributes live in the vao of the mesh
+                if (packet.vao != instancesVao || packet.instances != instances || packet.firstInstance != firstInstance) {
+                    bindInstances(packet.instances, packet.firstInstance);
+                    instancesVao = packet.vao;
+                    instances = packet.instances;
+                    firstInstance = packet.firstInstance;
+                }
+                ctx->draw(DrawMethod::INSTANCE_BASE_VERTEX, DrawParameters(packet.mode, packet.type, packet.count, packet.offset, packet.instanceCount, packet.baseVertex));
+            }
+
+            if (query != 0) {
+                ctx->queryEnd();
+            }
+        }
+
+        if (transparent) {
+            ctx->blend(false);
+            ctx->writeMask(true, true);
+        }
+        else if (occlusion) {
+            occlusion->queryHidden();
+        }
+
+        packets.clear();
+        keys.clear();
+    }
+}
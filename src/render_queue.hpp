@@ -0,0 +1,276 @@
+#pragma once
+
+#include "types.hpp"
+#include "context.hpp"
+#include "bounds.hpp"
+#include "culling.hpp"
+#include "occlusion.hpp"
+#include "depth_rasterizer.hpp"
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace ay
+{
+    struct MeshLod;
+    struct OccluderMesh;
+
+    enum class RenderPass {
+        OPAQUE_PASS = 0,
+        TRANSPARENT_PASS = 1
+    };
+
+    struct InstanceData {
+        glm::mat4 modelMatrix;
+        glm::mat3 normalMatrix;
+        glm::vec4 color;
+    };
+
+    struct InstanceRange {
+        u32 first; // in the instance buffer
+        u32 count;
+        BoundingBox bounds; // world bounds of the instances
+    };
+
+    struct InstanceBatch {
+        Buffer buffer; // InstanceData of the visible instances, grouped by mesh then by level of detail
+        const InstanceRange* ranges; // one per level of detail of each mesh
+        const u32* meshRanges; // first range of each mesh, in the order of the model mesh bounds
+    };
+
+    struct DrawPacket {
+        RenderPass pass;
+        Shader shader;
+        Buffer materials;
+        GLintptr materialsOffset; // table of the material in the buffer
+        i32 materialIndex; // in its table
+        Texture2D texture; // base color, bound to the first unit (0 for none)
+        VAO vao;
+        GLenum mode;
+        GLenum type;
+        GLsizei count;
+        GLvoid* offset;
+        GLint baseVertex;
+        glm::mat4 modelMatrix;
+        glm::mat3 normalMatrix;
+        BoundingBox bounds; // world bounds for the occlusion tests, empty if unknown (never occluded)
+        Buffer instances; // 0 if not instanced
+        GLsizei instanceCount;
+        u32 firstInstance; // in the instance buffer
+        const void* object; // identity across frames for the occlusion queries, nullptr if none
+        const OccluderMesh* occluder; // drawn in the software depth buffer, nullptr if not an occluder
+    };
+
+    struct CullingStatistics {
+        u32 meshes;
+        u32 culled;
+        u32 tests;
+    };
+
+    class RenderQueue {
+    public:
+        ///
+        /// @brief Constructor
+        /// @param ctx Context
+        ///
+        RenderQueue(Context* ctx)
+            : ctx(ctx),
+            viewMatrix(1.f),
+            viewProjection(1.f),
+            cameraPosition(0.f),
+            lodScale(1.f),
+            lodBias(0.f),
+            lodHysteresis(.25f),
+            occlusion(nullptr),
+            rasterizer(nullptr),
+            frustum(),
+            statistics(),
+            packets(),
+            keys(),
+            order(),
+            sortedKeys(),
+            sortedOrder()
+        {
+            resetCullingStatistics();
+        }
+
+        ///
+        /// @brief Destructor
+        ///
+        ~RenderQueue() {
+            delete occlusion;
+            delete rasterizer;
+        }
+
+        ///
+        /// @brief Start a new frame
+        /// @param projection Projection matrix of the camera
+        /// @param view View matrix of the camera
+        ///
+        inline void begin(const glm::mat4& projection, const glm::mat4& view) {
+            viewMatrix = view;
+            cameraPosition = glm::vec3(glm::inverse(view)[3]);
+            // pixels per unit at distance 1 (projection[1][1] is the cotangent of the half vertical fov)
+            lodScale = projection[1][1] * (f32)ctx->getWindow().getSize().second * .5f;
+            viewProjection = projection * view;
+            frustum = Frustum(viewProjection);
+            packets.clear();
+            keys.clear();
+        }
+
+        ///
+        /// @brief Select the level of detail of a mesh from the projected size of its bounding sphere
+        /// @param bounds World bounds
+        /// @param lods Levels of detail, the finest first
+        /// @param current Level used the previous frame, updated
+        /// @return Level
+        ///
+        u32 selectLod(const BoundingBox& bounds, const std::vector<MeshLod>& lods, u8& current) const;
+
+        ///
+        /// @brief Find the boxes of a hierarchy inside the frustum of the frame (before making their draws)
+        /// @param hierarchy Hierarchy over world boxes
+        /// @param visible Output, one flag per box
+        ///
+        void cull(const BoundingVolumeHierarchy& hierarchy, std::vector<u8>& visible);
+
+        ///
+        /// @brief Set the global level of detail bias
+        /// @param bias Each unit doubles the tolerated error (negative for more details)
+        ///
+        inline void setLodBias(f32 bias) {
+            lodBias = bias;
+        }
+
+        ///
+        /// @brief Get the global level of detail bias
+        /// @return Bias
+        ///
+        inline f32 getLodBias() const {
+            return lodBias;
+        }
+
+        ///
+        /// @brief Set the level of detail hysteresis
+        /// @param hysteresis Fraction of the tolerated error a coarser level must be under to be selected
+        ///
+        inline void setLodHysteresis(f32 hysteresis) {
+            lodHysteresis = hysteresis;
+        }
+
+        ///
+        /// @brief Enable occlusion culling (the opaque draws hidden last frame are skipped and their boxes queried)
+        /// @param enabled Enable
+        ///
+        inline void setOcclusionCulling(bool enabled) {
+            if (enabled && occlusion == nullptr) {
+                occlusion = new OcclusionCuller(ctx);
+            }
+            else if (!enabled) {
+                delete occlusion;
+                occlusion = nullptr;
+            }
+        }
+
+        ///
+        /// @brief Get the occlusion culler
+        /// @return Occlusion culler (nullptr if disabled)
+        ///
+        inline OcclusionCuller* getOcclusionCuller() const {
+            return occlusion;
+        }
+
+        ///
+        /// @brief Enable software occlusion culling (the occluders are rasterized on the CPU and the draws tested against them)
+        /// @param enabled Enable
+        ///
+        inline void setSoftwareOcclusion(bool enabled) {
+            if (enabled && rasterizer == nullptr) {
+                rasterizer = new DepthRasterizer(ctx->getThreadPool());
+            }
+            else if (!enabled) {
+                delete rasterizer;
+                rasterizer = nullptr;
+            }
+        }
+
+        ///
+        /// @brief Get the software depth rasterizer
+        /// @return Rasterizer (nullptr if disabled)
+        ///
+        inline DepthRasterizer* getDepthRasterizer() const {
+            return rasterizer;
+        }
+
+        ///
+        /// @brief Add a draw to the queue
+        /// @param packet Draw packet
+        ///
+        void push(const DrawPacket& packet);
+
+        ///
+        /// @brief Sort the draws and submit them
+        ///
+        void flush();
+
+        ///
+        /// @brief Get the number of queued draws
+        /// @return Draws count
+        ///
+        inline size_t size() const {
+            return packets.size();
+        }
+
+        ///
+        /// @brief Get culling statistics since the last reset
+        /// @return Statistics
+        ///
+        inline const CullingStatistics& getCullingStatistics() const {
+            return statistics;
+        }
+
+        ///
+        /// @brief Reset culling statistics
+        ///
+        inline void resetCullingStatistics() {
+            statistics.meshes = 0;
+            statistics.culled = 0;
+            statistics.tests = 0;
+        }
+
+    private:
+        ///
+        /// @brief Rasterize the occluders and remove the draws hidden behind them
+        ///
+        void occlude();
+
+        ///
+        /// @brief Point the instance attributes of the bound vao to an instance buffer
+        /// @param instances Instance buffer
+        /// @param first First instance
+        ///
+        void bindInstances(Buffer instances, u32 first);
+
+        ///
+        /// @brief Radix sort of the keys (result in order)
+        ///
+        void sort();
+
+    private:
+        Context* ctx;
+        glm::mat4 viewMatrix;
+        glm::mat4 viewProjection;
+        glm::vec3 cameraPosition;
+        f32 lodScale;
+        f32 lodBias;
+        f32 lodHysteresis;
+        OcclusionCuller* occlusion;
+        DepthRasterizer* rasterizer;
+        Frustum frustum;
+        CullingStatistics statistics;
+        std::vector<DrawPacket> packets;
+        std::vector<unsigned long long> keys; // 64 bits on every compiler (u64 is 32 bits with MSVC)
+        std::vector<u32> order;
+        std::vector<unsigned long long> sortedKeys;
+        std::vector<u32> sortedOrder;
+    };
+}
@@ -5,6 +5,9 @@
 #include "camera.hpp"
 #include "light.hpp"
 #include "model.hpp"
+#include "model_instances.hpp"
+#include "render_queue.hpp"
+#include "model_loader.hpp"
 #include <map>
 #include <string>
 #include <functional>
@@ -19,6 +22,7 @@ namespace ay
         ///
         Scene(Context* ctx)
             : onRender([](Scene*, f32) {}),
+            onRenderUI([](Scene*, f32) {}),
             onDestroy([](Scene*) {}),
             ctx(ctx),
             cameras(),
@@ -27,14 +31,20 @@ namespace ay
             directionalLights(),
             numberOfPointLights(0),
             numberOfDirectionalLights(0),
-            models()
+            models(),
+            instances(),
+            loader(ctx)
         {
+            updateLightsCount();
         }
 
         ///
         /// @brief Destructor
         ///
         ~Scene() {
+            // the workers still write to the models being imported
+            loader.wait();
+
             for (auto camera : cameras) {
                 delete camera.second;
             }
@@ -47,6 +57,10 @@ namespace ay
                 delete light;
             }
 
+            for (auto instance : instances) {
+                delete instance.second;
+            }
+
             for (auto model : models) {
                 delete model.second;
             }
@@ -65,18 +79,45 @@ namespace ay
         ///
         /// @brief Create a new model from file
         /// @param name Model name
+        /// @param filename Filename
+        /// @param options Import options
         /// @return Model instance
         ///
-        inline Model* createModel(const std::string& name, const std::string& filename) {
+        inline Model* createModel(const std::string& name, const std::string& filename, const ModelImportOptions& options = ModelImportOptions()) {
+            auto it = models.find(name);
+            if (it == models.end()) {
+                Model* model = Model::fromFile(ctx, filename, options);
+                models.insert(std::make_pair(name, model));
+                return model;
+            }
+            return it->second;
+        }
+
+        ///
+        /// @brief Create a new model from file, read and prepared in the background
+        /// @param name Model name
+        /// @param filename Filename
+        /// @param options Import options
+        /// @return Model instance (not ready yet, see Model::isReady)
+        ///
+        inline Model* createModelAsync(const std::string& name, const std::string& filename, const ModelImportOptions& options = ModelImportOptions()) {
             auto it = models.find(name);
             if (it == models.end()) {
-                Model* model = Model::fromFile(ctx, filename);
+                Model* model = loader.load(filename, options);
                 models.insert(std::make_pair(name, model));
                 return model;
             }
             return it->second;
         }
 
+        ///
+        /// @brief Get the loader of the asynchronous models
+        /// @return Loader
+        ///
+        inline ModelLoader& getModelLoader() {
+            return loader;
+        }
+
         ///
         /// @brief Get the model
         /// @param name Model name
@@ -90,6 +131,41 @@ namespace ay
             return nullptr;
         }
 
+        ///
+        /// @brief Create a new instance set of a model
+        /// @param name Instance set name
+        /// @param model Name of the instanced model
+        /// @return Instance set (nullptr if the model does not exist)
+        ///
+        inline ModelInstances* createInstances(const std::string& name, const std::string& model) {
+            auto it = instances.find(name);
+            if (it == instances.end()) {
+                Model* instancedModel = getModel(model);
+                if (instancedModel == nullptr) {
+                    spdlog::error("Model {} does not exist", model);
+                    return nullptr;
+                }
+
+                ModelInstances* instance = new ModelInstances(ctx, instancedModel);
+                instances.insert(std::make_pair(name, instance));
+                return instance;
+            }
+            return it->second;
+        }
+
+        ///
+        /// @brief Get an instance set
+        /// @param name Instance set name
+        /// @return Instance set
+        ///
+        inline ModelInstances* getInstances(const std::string& name) {
+            auto it = instances.find(name);
+            if (it != instances.end()) {
+                return it->second;
+            }
+            return nullptr;
+        }
+
         ///
         /// @brief Create a new perspective camera
         /// @param name Camera name
@@ -170,6 +246,7 @@ namespace ay
 
             Light* light = new Light();
             pointsLights.at(numberOfPointLights++) = light;
+            updateLightsCount();
             return light;
         }
 
@@ -185,6 +262,7 @@ namespace ay
 
             Light* light = new Light();
             directionalLights.at(numberOfDirectionalLights++) = light;
+            updateLightsCount();
             return light;
         }
 
@@ -194,33 +272,60 @@ namespace ay
         ///
         void render(f32 deltaTime) {
             mainCamera->update(deltaTime);
+            updateLights();
+            loader.update();
 
+            RenderQueue* queue = ctx->getRenderQueue();
+            queue->begin(mainCamera->getProjectionMatrix(), mainCamera->getViewMatrix());
             onRender(this, deltaTime);
+            queue->flush();
 
-            // lights
-            for (size_t i = 0; i < numberOfDirectionalLights; i++) {
-                auto light = directionalLights[i];
-                std::stringstream ss;
-                ss << "directionalLights[" << i << "]";
-                ctx->shaderUniform(ss.str() + ".color", light->color.toVec());
-                ctx->shaderUniform(ss.str() + ".position", light->position);
-                ctx->shaderUniform(ss.str() + ".intensity", light->intensity);
-            }
-            ctx->shaderUniform("directionalLightsCount", (i32)numberOfDirectionalLights);
+            onRenderUI(this, deltaTime);
+        }
+
+    private:
+        ///
+        /// @brief Upload the number of lights to the lights uniform block
+        ///
+        inline void updateLightsCount() const {
+            i32 counts[2] = { (i32)numberOfPointLights, (i32)numberOfDirectionalLights };
+            ctx->uniformBlockUpdate("Lights", 0, sizeof(counts), counts);
+
+            ShaderFeatures features = ctx->shaderGetSceneFeatures();
+            features.pointLights = (u8)numberOfPointLights;
+            features.directionalLights = (u8)numberOfDirectionalLights;
+            ctx->shaderSetSceneFeatures(features);
+        }
+
+        ///
+        /// @brief Upload the lights changed since the last frame
+        ///
+        inline void updateLights() {
+            const GLintptr pointLightsOffset = sizeof(i32) * 4;
+            const GLintptr directionalLightsOffset = pointLightsOffset + sizeof(LightData) * pointsLights.size();
 
             for (size_t i = 0; i < numberOfPointLights; i++) {
-                auto light = pointsLights[i];
-                std::stringstream ss;
-                ss << "pointLights[" << i << "]";
-                ctx->shaderUniform(ss.str() + ".color", light->color.toVec());
-                ctx->shaderUniform(ss.str() + ".position", light->position);
-                ctx->shaderUniform(ss.str() + ".intensity", light->intensity);
+                Light* light = pointsLights[i];
+                if (light->dirty) {
+                    LightData data = light->toData();
+                    ctx->uniformBlockUpdate("Lights", pointLightsOffset + sizeof(LightData) * i, sizeof(data), &data);
+                    light->dirty = false;
+                }
+            }
+
+            for (size_t i = 0; i < numberOfDirectionalLights; i++) {
+                Light* light = directionalLights[i];
+                if (light->dirty) {
+                    LightData data = light->toData();
+                    ctx->uniformBlockUpdate("Lights", directionalLightsOffset + sizeof(LightData) * i, sizeof(data), &data);
+                    light->dirty = false;
+                }
             }
-            ctx->shaderUniform("pointLightsCount", (i32)numberOfPointLights);
         }
 
     public:
         std::function<void(Scene*, f32)> onRender;
+        std::function<void(Scene*, f32)> onRenderUI;
         std::function<void(Scene*)> onDestroy;
 
     private:
@@ -232,5 +337,7 @@ namespace ay
         size_t numberOfPointLights;
         size_t numberOfDirectionalLights;
         std::map<std::string, Model*> models;
+        std::map<std::string, ModelInstances*> instances;
+        ModelLoader loader;
     };
 }
\ No newline at end of file
@@ -2,117 +2,201 @@
 
 #include <string>
 
-const std::string BLINN_PHONG_VERTEX = "#version 320 es\n \
-    layout(location = 0) in vec3 position; \
-    layout(location = 1) in vec3 normal; \
-    layout(location = 2) in vec2 uv; \
-    layout(location = 3) in vec3 color; \
-    \
-    out VS_OUT{ \
-        vec3 position; \
-        vec3 normal; \
-        vec2 uv; \
-        vec3 color; \
-    } vs_out; \
-    \
-    uniform mat4 projectionMatrix; \
-    uniform mat4 viewMatrix; \
-    uniform mat4 modelMatrix; \
-    uniform mat4 normalMatrix; \
-    \
-    void main() { \
-        vec4 worldPos = modelMatrix * vec4(position, 1.0); \
-        gl_Position = projectionMatrix * viewMatrix * worldPos; \
-        vs_out.position = worldPos.xyz / worldPos.w; \
-        vs_out.normal = (normalMatrix * vec4(normal, 1.0)).xyz; \
-        vs_out.uv = uv; \
-        vs_out.color = color; \
-    } \
+const std::string BLINN_PHONG_VERTEX = "#version 320 es\n\
+    layout(location = 0) in vec3 position;\n\
+    #ifdef OCT_NORMALS\n\
+    layout(location = 1) in vec2 octNormal;\n\
+    #else\n\
+    layout(location = 1) in vec3 normal;\n\
+    #endif\n\
+    layout(location = 2) in vec2 uv;\n\
+    layout(location = 3) in vec3 color;\n\
+    #ifdef INSTANCED\n\
+    layout(location = 4) in mat4 instanceModelMatrix;\n\
+    layout(location = 8) in mat3 instanceNormalMatrix;\n\
+    layout(location = 11) in vec4 instanceColor;\n\
+    #endif\n\
+    \n\
+    out VS_OUT{\n\
+        vec3 position;\n\
+        vec3 normal;\n\
+    #ifdef HAS_TEXCOORD\n\
+        vec2 uv;\n\
+    #endif\n\
+    #ifdef HAS_VERTEX_COLOR\n\
+        vec3 color;\n\
+    #endif\n\
+    #ifdef INSTANCED\n\
+        vec4 instanceColor;\n\
+    #endif\n\
+    } vs_out;\n\
+    \n\
+    layout(std140) uniform Camera {\n\
+        highp mat4 projectionMatrix;\n\
+        highp mat4 viewMatrix;\n\
+        highp vec4 cameraPosition;\n\
+    };\n\
+    \n\
+    uniform mat4 modelMatrix;\n\
+    uniform mat3 normalMatrix;\n\
+    \n\
+    #ifdef OCT_NORMALS\n\
+    vec3 octDecode(vec2 e) {\n\
+        vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n\
+        float t = max(-n.z, 0.0);\n\
+        n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);\n\
+        return normalize(n);\n\
+    }\n\
+    #endif\n\
+    \n\
+    void main() {\n\
+    #ifdef OCT_NORMALS\n\
+        vec3 normal = octDecode(octNormal);\n\
+    #endif\n\
+    #ifdef INSTANCED\n\
+        vec4 worldPos = instanceModelMatrix * (modelMatrix * vec4(position, 1.0));\n\
+        vs_out.normal = instanceNormalMatrix * (normalMatrix * normal);\n\
+        vs_out.instanceColor = instanceColor;\n\
+    #else\n\
+        vec4 worldPos = modelMatrix * vec4(position, 1.0);\n\
+        vs_out.normal = normalMatrix * normal;\n\
+    #endif\n\
+        gl_Position = projectionMatrix * viewMatrix * worldPos;\n\
+        vs_out.position = worldPos.xyz / worldPos.w;\n\
+    #ifdef HAS_TEXCOORD\n\
+        vs_out.uv = uv;\n\
+    #endif\n\
+    #ifdef HAS_VERTEX_COLOR\n\
+        vs_out.color = color;\n\
+    #endif\n\
+    }\n\
 ";
 
-const std::string BLINN_PHONG_FRAGMENT = "#version 320 es\n \
-    precision mediump float; \
-    \
-    out vec4 fragOut; \
-    \
-    in VS_OUT{ \
-        vec3 position; \
-        vec3 normal; \
-        vec2 uv; \
-        vec3 color; \
-    } fs_in; \
-    \
-    uniform bool isAxis; \
-    uniform vec3 cameraPosition; \
-    uniform sampler2D albedo; \
-    \
-    struct Light { \
-        vec3 position; \
-        vec4 color; \
-        float intensity; \
-    }; \
-    \
-    uniform int pointLightsCount; \
-    uniform int directionalLightsCount; \
-    uniform Light pointLights[16]; \
-    uniform Light directionalLights[8]; \
-    \
-    struct Material { \
-        vec4 baseColor; \
-        float metallicFactor; \
-        float roughnessFactor; \
-        vec4 emissiveFactor; \
-    }; \
-    \
-    uniform Material material; \
-    \
-    const vec3 ambientColor = vec3(0.1, 0.1, 0.1); \
-    const vec3 diffuseColor = vec3(0.5, 0.5, 0.5); \
-    const vec3 specColor = vec3(1.0, 1.0, 1.0); \
-    const float shininess = 8.0; \
-    \
-    vec3 computeLight(Light light, bool isPoint) { \
-        vec3 N = normalize(fs_in.normal); \
-        vec3 L = light.position - fs_in.position; \
-        float distance = length(L); \
-        distance = distance * distance; \
-        L = normalize(L); \
-        float specular = 0.0; \
-        float lambertian = max(dot(L, N), 0.0); \
-        \
-        if (lambertian > 0.0) { \
-            vec3 V = normalize(cameraPosition - fs_in.position); \
-            vec3 H = (L + V) / length(L + V); \
-            float angle = max(dot(H, N), 0.0); \
-            specular = pow(angle, shininess); \
-        } \
-        \
-        float intensity = light.intensity; \
-        if (isPoint) { \
-            intensity *= 1.0 / distance; \
-        } \
-        \
-        return ambientColor + \
-            material.baseColor.rgb * lambertian * light.color.xyz * intensity + \
-            specColor * specular * light.color.xyz * intensity; \
-    } \
-    \
-    void main() { \
-        vec3 color = vec3(0, 0, 0); \
-        \
-        for (int i = 0; i < directionalLightsCount; i++) { \
-            color += computeLight(directionalLights[i], false); \
-        } \
-        \
-        for (int i = 0; i < pointLightsCount; i++) { \
-            color += computeLight(pointLights[i], true); \
-        } \
-        \
-        if (isAxis) { \
-            fragOut = vec4(fs_in.color, 1.0); \
-        } \
-        else { \
-            fragOut = vec4(color, 1.0); \
-        } \
-    } \
-";
\ No newline at end of file
+const std::string BLINN_PHONG_FRAGMENT = "#version 320 es\n\
+    precision mediump float;\n\
+    \n\
+    out vec4 fragOut;\n\
+    \n\
+    in VS_OUT{\n\
+        vec3 position;\n\
+        vec3 normal;\n\
+    #ifdef HAS_TEXCOORD\n\
+        vec2 uv;\n\
+    #endif\n\
+    #ifdef HAS_VERTEX_COLOR\n\
+        vec3 color;\n\
+    #endif\n\
+    #ifdef INSTANCED\n\
+        vec4 instanceColor;\n\
+    #endif\n\
+    } fs_in;\n\
+    \n\
+    uniform sampler2D albedo;\n\
+    \n\
+    layout(std140) uniform Camera {\n\
+        highp mat4 projectionMatrix;\n\
+        highp mat4 viewMatrix;\n\
+        highp vec4 cameraPosition;\n\
+    };\n\
+    \n\
+    struct Light {\n\
+        vec4 position;\n\
+        vec4 color;\n\
+    };\n\
+    \n\
+    layout(std140) uniform Lights {\n\
+        int pointLightsCount;\n\
+        int directionalLightsCount;\n\
+        Light pointLights[16];\n\
+        Light directionalLights[8];\n\
+    };\n\
+    \n\
+    struct Material {\n\
+        vec4 baseColor;\n\
+        vec4 emissiveFactor;\n\
+        vec4 factors;\n\
+    };\n\
+    \n\
+    layout(std140) uniform Materials {\n\
+        Material materials[256]; // MATERIALS_PER_TABLE\n\
+    };\n\
+    \n\
+    uniform int materialIndex;\n\
+    \n\
+    const vec3 ambientColor = vec3(0.1, 0.1, 0.1);\n\
+    const vec3 diffuseColor = vec3(0.5, 0.5, 0.5);\n\
+    const vec3 specColor = vec3(1.0, 1.0, 1.0);\n\
+    const float shininess = 8.0;\n\
+    \n\
+    vec3 computeLight(Light light, bool isPoint, vec3 N, vec3 baseColor) {\n\
+        vec3 L = light.position.xyz - fs_in.position;\n\
+        float distance = length(L);\n\
+        distance = distance * distance;\n\
+        L = normalize(L);\n\
+        float specular = 0.0;\n\
+        float lambertian = max(dot(L, N), 0.0);\n\
+        \n\
+        if (lambertian > 0.0) {\n\
+            vec3 V = normalize(cameraPosition.xyz - fs_in.position);\n\
+            vec3 H = (L + V) / length(L + V);\n\
+            float angle = max(dot(H, N), 0.0);\n\
+            specular = pow(angle, shininess);\n\
+        }\n\
+        \n\
+        float intensity = light.position.w;\n\
+        if (isPoint) {\n\
+            intensity *= 1.0 / distance;\n\
+        }\n\
+        \n\
+        return ambientColor +\n\
+            baseColor * lambertian * light.color.xyz * intensity +\n\
+            specColor * specular * light.color.xyz * intensity;\n\
+    }\n\
+    \n\
+    void main() {\n\
+        Material material = materials[materialIndex];\n\
+        vec4 baseColor = material.baseColor;\n\
+    #ifdef HAS_VERTEX_COLOR\n\
+        baseColor.rgb *= fs_in.color;\n\
+    #endif\n\
+    #ifdef INSTANCED\n\
+        baseColor *= fs_in.instanceColor;\n\
+    #endif\n\
+    #if defined(HAS_BASE_COLOR_TEXTURE) && defined(HAS_TEXCOORD)\n\
+        baseColor *= texture(albedo, fs_in.uv);\n\
+    #endif\n\
+    #ifdef ALPHA_MASK\n\
+        if (baseColor.a < material.factors.z) {\n\
+            discard;\n\
+        }\n\
+    #endif\n\
+    \n\
+    #ifdef UNLIT\n\
+        fragOut = baseColor;\n\
+    #else\n\
+        vec3 N = normalize(fs_in.normal);\n\
+    #ifdef DOUBLE_SIDED\n\
+        N = gl_FrontFacing ? N : -N;\n\
+    #endif\n\
+        vec3 color = vec3(0, 0, 0);\n\
+        \n\
+    #ifdef DIRECTIONAL_LIGHTS_COUNT\n\
+        for (int i = 0; i < DIRECTIONAL_LIGHTS_COUNT; i++) {\n\
+    #else\n\
+        for (int i = 0; i < directionalLightsCount; i++) {\n\
+    #endif\n\
+            color += computeLight(directionalLights[i], false, N, baseColor.rgb);\n\
+        }\n\
+        \n\
+    #ifdef POINT_LIGHTS_COUNT\n\
+        for (int i = 0; i < POINT_LIGHTS_COUNT; i++) {\n\
+    #else\n\
+        for (int i = 0; i < pointLightsCount; i++) {\n\
+    #endif\n\
+            color += computeLight(pointLights[i], true, N, baseColor.rgb);\n\
+        }\n\
+        \n\
+        fragOut = vec4(color, baseColor.a);\n\
+    #endif\n\
+    }\n\
+";
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+const std::string OCCLUSION_VERTEX = "#version 320 es\n\
+    layout(location = 0) in vec3 position;\n\
+    \n\
+    layout(std140) uniform Camera {\n\
+        highp mat4 projectionMatrix;\n\
+        highp mat4 viewMatrix;\n\
+        highp vec4 cameraPosition;\n\
+    };\n\
+    \n\
+    uniform vec3 boxMin;\n\
+    uniform vec3 boxMax;\n\
+    \n\
+    void main() {\n\
+        gl_Position = projectionMatrix * viewMatrix * vec4(mix(boxMin, boxMax, position), 1.0);\n\
+    }\n\
+";
+
+const std::string OCCLUSION_FRAGMENT = "#version 320 es\n\
+    precision mediump float;\n\
+    \n\
+    out vec4 fragOut;\n\
+    \n\
+    void main() {\n\
+        fragOut = vec4(1.0);\n\
+    }\n\
+";
@@ -0,0 +1,108 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace ay
+{
+    ThreadPool::ThreadPool(u32 count)
+        : threads(),
+        jobs(),
+        mutex(),
+        condition(),
+        stopping(false)
+    {
+        if (count == 0) {
+            const u32 hardware = (u32)std::thread::hardware_concurrency();
+            count = hardware > 1 ? hardware - 1 : 1;
+        }
+
+        for (u32 i = 0; i < count; i++) {
+            threads.push_back(std::thread(&ThreadPool::work, this));
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::submit(const std::function<void()>& job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+        }
+        condition.notify_one();
+    }
+
+    void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+        if (count == 0) {
+            return;
+        }
+
+        if (count == 1) {
+            fn(0);
+            return;
+        }
+
+        // shared with the helpers, a helper starting after the loop is done finds no work and only touches this
+        struct Loop {
+            std::atomic<size_t> next;
+            std::atomic<size_t> completed;
+            size_t count;
+            const std::function<void(size_t)>* fn;
+            std::mutex mutex;
+            std::condition_variable done;
+        };
+        std::shared_ptr<Loop> state = std::make_shared<Loop>();
+        state->next = 0;
+        state->completed = 0;
+        state->count = count;
+        state->fn = &fn;
+
+        auto loop = [](Loop& loop) {
+            for (size_t i = loop.next++; i < loop.count; i = loop.next++) {
+                (*loop.fn)(i);
+                if (++loop.completed == loop.count) {
+                    std::lock_guard<std::mutex> lock(loop.mutex);
+                    loop.done.notify_one();
+                }
+            }
+        };
+
+        // only the calls already started are waited for, a busy pool (or a nested loop) never blocks the caller
+        for (size_t i = 0, n = std::min(count - 1, threads.size()); i < n; i++) {
+            submit([state, loop]() {
+                loop(*state);
+            });
+        }
+
+        loop(*state);
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait(lock, [&state]() { return state->completed == state->count; });
+    }
+
+    void ThreadPool::work() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "types.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ay
+{
+    class ThreadPool {
+    public:
+        ///
+        /// @brief Constructor
+        /// @param threads Number of workers (0 for one per hardware thread minus the caller)
+        ///
+        ThreadPool(u32 threads = 0);
+
+        ///
+        /// @brief Destructor (waits for the queued jobs)
+        ///
+        ~ThreadPool();
+
+        ///
+        /// @brief Queue a job
+        /// @param job Job
+        ///
+        void submit(const std::function<void()>& job);
+
+        ///
+        /// @brief Run a function over [0, count), the calling thread takes part and returns when every call is done
+        /// @param count Number of calls
+        /// @param fn Function called with the index
+        ///
+        void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+        ///
+        /// @brief Get the number of workers
+        /// @return Workers
+        ///
+        inline u32 getThreadCount() const {
+            return (u32)threads.size();
+        }
+
+    private:
+        ///
+        /// @brief Worker loop
+        ///
+        void work();
+
+    private:
+        std::vector<std::thread> threads;
+        std::deque<std::function<void()>> jobs;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping;
+    };
+}
@@ -45,6 +45,24 @@ namespace ay
             return translation * rotate * scaling * toOrigin;
         }
 
+        ///
+        /// @brief Compare two transforms
+        /// @param other Other transform
+        /// @return True if every component is equal
+        ///
+        inline bool operator==(const Transform& other) const {
+            return origin == other.origin && position == other.position && scale == other.scale && rotation == other.rotation;
+        }
+
+        ///
+        /// @brief Compare two transforms
+        /// @param other Other transform
+        /// @return True if any component differs
+        ///
+        inline bool operator!=(const Transform& other) const {
+            return !(*this == other);
+        }
+
     public:
         glm::vec3 origin;
         glm::vec3 position;
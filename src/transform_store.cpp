@@ -0,0 +1,282 @@
+#include "transform_store.hpp"
+#include <glm/gtc/type_ptr.hpp>
+#include <cassert>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define AY_TRANSFORM_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace ay
+{
+    TransformStore::TransformStore()
+        : parents(), levels(), depths(),
+        originX(), originY(), originZ(),
+        positionX(), positionY(), positionZ(),
+        scaleX(), scaleY(), scaleZ(),
+        rotationX(), rotationY(), rotationZ(), rotationW(),
+        dirty(), changed(), uniformScale(), worldMatrices(), normalMatrices()
+    {
+    }
+
+    void TransformStore::clear() {
+        parents.clear();
+        levels.clear();
+        depths.clear();
+        originX.clear(); originY.clear(); originZ.clear();
+        positionX.clear(); positionY.clear(); positionZ.clear();
+        scaleX.clear(); scaleY.clear(); scaleZ.clear();
+        rotationX.clear(); rotationY.clear(); rotationZ.clear(); rotationW.clear();
+        dirty.clear();
+        changed.clear();
+        uniformScale.clear();
+        worldMatrices.clear();
+        normalMatrices.clear();
+    }
+
+    u32 TransformStore::add(i32 parent, const Transform& transform) {
+        const u32 index = size();
+        assert(parent < (i32)index);
+        const u32 depth = parent < 0 ? 0 : depths[(size_t)parent] + 1;
+        assert(depths.empty() || depth >= depths.back());
+
+        if (depths.empty() || depth > depths.back()) {
+            levels.push_back(index);
+        }
+
+        parents.push_back(parent);
+        depths.push_back(depth);
+        originX.push_back(0.f); originY.push_back(0.f); originZ.push_back(0.f);
+        positionX.push_back(0.f); positionY.push_back(0.f); positionZ.push_back(0.f);
+        scaleX.push_back(1.f); scaleY.push_back(1.f); scaleZ.push_back(1.f);
+        rotationX.push_back(0.f); rotationY.push_back(0.f); rotationZ.push_back(0.f); rotationW.push_back(1.f);
+        dirty.push_back(1);
+        changed.push_back(0);
+        uniformScale.push_back(1);
+        worldMatrices.push_back(glm::mat4(1.f));
+        normalMatrices.push_back(glm::mat3(1.f));
+        set(index, transform);
+        return index;
+    }
+
+    void TransformStore::set(u32 index, const Transform& transform) {
+        if (get(index) == transform) {
+            return;
+        }
+
+        originX[index] = transform.origin.x;
+        originY[index] = transform.origin.y;
+        originZ[index] = transform.origin.z;
+        positionX[index] = transform.position.x;
+        positionY[index] = transform.position.y;
+        positionZ[index] = transform.position.z;
+        scaleX[index] = transform.scale.x;
+        scaleY[index] = transform.scale.y;
+        scaleZ[index] = transform.scale.z;
+        rotationX[index] = transform.rotation.x;
+        rotationY[index] = transform.rotation.y;
+        rotationZ[index] = transform.rotation.z;
+        rotationW[index] = transform.rotation.w;
+        dirty[index] = 1;
+    }
+
+    Transform TransformStore::get(u32 index) const {
+        Transform transform;
+        transform.origin = glm::vec3(originX[index], originY[index], originZ[index]);
+        transform.position = glm::vec3(positionX[index], positionY[index], positionZ[index]);
+        transform.scale = glm::vec3(scaleX[index], scaleY[index], scaleZ[index]);
+        transform.rotation = glm::quat(rotationW[index], rotationX[index], rotationY[index], rotationZ[index]);
+        return transform;
+    }
+
+    void TransformStore::update() {
+        const u32 count = size();
+
+        // parents come first, so one pass propagates the flags down the hierarchy
+        for (u32 i = 0; i < count; i++) {
+            const i32 parent = parents[i];
+            changed[i] = dirty[i] || (parent >= 0 && changed[(size_t)parent]);
+            dirty[i] = 0;
+        }
+
+        for (size_t level = 0; level < levels.size(); level++) {
+            const u32 end = level + 1 < levels.size() ? levels[level + 1] : count;
+            u32 i = levels[level];
+
+            for (; i + 4 <= end; i += 4) {
+                if (changed[i] | changed[i + 1] | changed[i + 2] | changed[i + 3]) {
+                    compose4(i);
+                }
+            }
+
+            for (; i < end; i++) {
+                if (changed[i]) {
+                    compose(i);
+                }
+            }
+        }
+    }
+
+    void TransformStore::compose(u32 i) {
+        const f32 x = rotationX[i], y = rotationY[i], z = rotationZ[i], w = rotationW[i];
+        const f32 sx = scaleX[i], sy = scaleY[i], sz = scaleZ[i];
+
+        // translate(position) * rotate * scale * translate(-origin)
+        glm::mat4 local(1.f);
+        local[0][0] = (1.f - 2.f * (y * y + z * z)) * sx;
+        local[0][1] = 2.f * (x * y + w * z) * sx;
+        local[0][2] = 2.f * (x * z - w * y) * sx;
+        local[1][0] = 2.f * (x * y - w * z) * sy;
+        local[1][1] = (1.f - 2.f * (x * x + z * z)) * sy;
+        local[1][2] = 2.f * (y * z + w * x) * sy;
+        local[2][0] = 2.f * (x * z + w * y) * sz;
+        local[2][1] = 2.f * (y * z - w * x) * sz;
+        local[2][2] = (1.f - 2.f * (x * x + y * y)) * sz;
+        const glm::vec3 position(positionX[i], positionY[i], positionZ[i]);
+        const glm::vec3 origin(originX[i], originY[i], originZ[i]);
+        local[3] = glm::vec4(position - glm::mat3(local) * origin, 1.f);
+
+        const i32 parent = parents[i];
+        const glm::mat4& world = worldMatrices[i] = parent >= 0 ? worldMatrices[(size_t)parent] * local : local;
+
+        // the shader normalizes the normal, so any positive multiple of the
+        // inverse transpose works: the matrix itself under uniform scale,
+        // the cofactor matrix otherwise
+        uniformScale[i] = sx == sy && sy == sz && (parent < 0 || uniformScale[(size_t)parent]);
+        const glm::mat3 m(world);
+        if (uniformScale[i]) {
+            normalMatrices[i] = m;
+        }
+        else {
+            glm::mat3 cofactor(glm::cross(m[1], m[2]), glm::cross(m[2], m[0]), glm::cross(m[0], m[1]));
+            normalMatrices[i] = glm::dot(m[0], cofactor[0]) < 0.f ? -cofactor : cofactor;
+        }
+    }
+
+#ifdef AY_TRANSFORM_SSE
+    void TransformStore::compose4(u32 i) {
+        static const glm::mat4 identity(1.f);
+
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 two = _mm_set1_ps(2.f);
+        const __m128 x = _mm_loadu_ps(&rotationX[i]);
+        const __m128 y = _mm_loadu_ps(&rotationY[i]);
+        const __m128 z = _mm_loadu_ps(&rotationZ[i]);
+        const __m128 w = _mm_loadu_ps(&rotationW[i]);
+        const __m128 sx = _mm_loadu_ps(&scaleX[i]);
+        const __m128 sy = _mm_loadu_ps(&scaleY[i]);
+        const __m128 sz = _mm_loadu_ps(&scaleZ[i]);
+
+        const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        // local[column][row], one node per lane
+        __m128 local[4][3];
+        local[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+        local[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+        local[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+        local[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+        local[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+        local[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+        local[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+        local[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+        local[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+
+        const __m128 ox = _mm_loadu_ps(&originX[i]);
+        const __m128 oy = _mm_loadu_ps(&originY[i]);
+        const __m128 oz = _mm_loadu_ps(&originZ[i]);
+        const __m128 position[3] = { _mm_loadu_ps(&positionX[i]), _mm_loadu_ps(&positionY[i]), _mm_loadu_ps(&positionZ[i]) };
+        for (int r = 0; r < 3; r++) {
+            __m128 rotated = _mm_add_ps(_mm_add_ps(_mm_mul_ps(local[0][r], ox), _mm_mul_ps(local[1][r], oy)), _mm_mul_ps(local[2][r], oz));
+            local[3][r] = _mm_sub_ps(position[r], rotated);
+        }
+
+        // gather the parent world matrices (affine, the last row is 0 0 0 1)
+        const f32* p[4];
+        for (u32 lane = 0; lane < 4; lane++) {
+            const i32 parent = parents[i + lane];
+            p[lane] = glm::value_ptr(parent >= 0 ? worldMatrices[(size_t)parent] : identity);
+        }
+
+        __m128 parentMatrix[4][3];
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 3; r++) {
+                const int k = c * 4 + r;
+                parentMatrix[c][r] = _mm_set_ps(p[3][k], p[2][k], p[1][k], p[0][k]);
+            }
+        }
+
+        // world = parent * local
+        __m128 world[4][3];
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 3; r++) {
+                __m128 v = _mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(parentMatrix[0][r], local[c][0]),
+                    _mm_mul_ps(parentMatrix[1][r], local[c][1])),
+                    _mm_mul_ps(parentMatrix[2][r], local[c][2]));
+                world[c][r] = c == 3 ? _mm_add_ps(v, parentMatrix[3][r]) : v;
+            }
+        }
+
+        // normal matrix: world under uniform scale, sign-corrected cofactor otherwise
+        u32 uniformMask = 0;
+        for (u32 lane = 0; lane < 4; lane++) {
+            const i32 parent = parents[i + lane];
+            uniformScale[i + lane] = scaleX[i + lane] == scaleY[i + lane] && scaleY[i + lane] == scaleZ[i + lane] &&
+                (parent < 0 || uniformScale[(size_t)parent]);
+            uniformMask |= (u32)uniformScale[i + lane] << lane;
+        }
+
+        __m128 normal[3][3];
+        for (int c = 0; c < 3; c++) {
+            const __m128* a = world[(c + 1) % 3];
+            const __m128* b = world[(c + 2) % 3];
+            normal[c][0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+            normal[c][1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+            normal[c][2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+        }
+
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 det = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(world[0][0], normal[0][0]),
+            _mm_mul_ps(world[0][1], normal[0][1])),
+            _mm_mul_ps(world[0][2], normal[0][2]));
+        const __m128 signMask = _mm_and_ps(_mm_cmplt_ps(det, zero), _mm_set1_ps(-0.f));
+        const __m128 uniform = _mm_cmpneq_ps(_mm_set_ps(
+            (f32)((uniformMask >> 3) & 1), (f32)((uniformMask >> 2) & 1), (f32)((uniformMask >> 1) & 1), (f32)(uniformMask & 1)), zero);
+        for (int c = 0; c < 3; c++) {
+            for (int r = 0; r < 3; r++) {
+                const __m128 cofactor = _mm_xor_ps(normal[c][r], signMask);
+                normal[c][r] = _mm_or_ps(_mm_and_ps(uniform, world[c][r]), _mm_andnot_ps(uniform, cofactor));
+            }
+        }
+
+        // transpose back to one matrix per node
+        for (int c = 0; c < 4; c++) {
+            __m128 rows[4] = { world[c][0], world[c][1], world[c][2], c == 3 ? one : zero };
+            _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+            for (u32 lane = 0; lane < 4; lane++) {
+                _mm_storeu_ps(&worldMatrices[i + lane][c][0], rows[lane]);
+            }
+        }
+
+        for (int c = 0; c < 3; c++) {
+            __m128 rows[4] = { normal[c][0], normal[c][1], normal[c][2], zero };
+            _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+            for (u32 lane = 0; lane < 4; lane++) {
+                f32 column[4];
+                _mm_storeu_ps(column, rows[lane]);
+                normalMatrices[i + lane][c] = glm::vec3(column[0], column[1], column[2]);
+            }
+        }
+    }
+#else
+    void TransformStore::compose4(u32 i) {
+        compose(i);
+        compose(i + 1);
+        compose(i + 2);
+        compose(i + 3);
+    }
+#endif
+}
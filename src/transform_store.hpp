@@ -0,0 +1,114 @@
+#pragma once
+
+#include "types.hpp"
+#include "transform.hpp"
+#include <vector>
+
+namespace ay
+{
+    class TransformStore {
+    public:
+        ///
+        /// @brief Constructor
+        ///
+        TransformStore();
+
+        ///
+        /// @brief Remove every transform
+        ///
+        void clear();
+
+        ///
+        /// @brief Add a transform
+        /// Transforms must be added level by level (breadth-first),
+        /// so that the parent of a node is always updated before it
+        /// @param parent Parent index (-1 for a root)
+        /// @param transform Local transform
+        /// @return Index of the transform
+        ///
+        u32 add(i32 parent, const Transform& transform);
+
+        ///
+        /// @brief Set a local transform (marks it dirty if it changed)
+        /// @param index Index
+        /// @param transform Local transform
+        ///
+        void set(u32 index, const Transform& transform);
+
+        ///
+        /// @brief Get a local transform
+        /// @param index Index
+        /// @return Local transform
+        ///
+        Transform get(u32 index) const;
+
+        ///
+        /// @brief Recompute the world and normal matrices of the dirty
+        /// transforms and of their descendants
+        ///
+        void update();
+
+        ///
+        /// @brief Get world matrix (valid after update)
+        /// @param index Index
+        /// @return Matrix4
+        ///
+        inline const glm::mat4& getWorldMatrix(u32 index) const {
+            return worldMatrices[index];
+        }
+
+        ///
+        /// @brief Get normal matrix (valid after update, not normalized)
+        /// @param index Index
+        /// @return Matrix3
+        ///
+        inline const glm::mat3& getNormalMatrix(u32 index) const {
+            return normalMatrices[index];
+        }
+
+        ///
+        /// @brief Check if the world matrix changed during the last update
+        /// @param index Index
+        /// @return True if changed
+        ///
+        inline bool isChanged(u32 index) const {
+            return changed[index] != 0;
+        }
+
+        ///
+        /// @brief Get the number of transforms
+        /// @return Size
+        ///
+        inline u32 size() const {
+            return (u32)parents.size();
+        }
+
+    private:
+        ///
+        /// @brief Compose the world and normal matrices of one transform
+        /// @param index Index
+        ///
+        void compose(u32 index);
+
+        ///
+        /// @brief Compose the world and normal matrices of four consecutive transforms
+        /// of the same level
+        /// @param index Index of the first transform
+        ///
+        void compose4(u32 index);
+
+    private:
+        std::vector<i32> parents;
+        std::vector<u32> levels; // first index of each level
+        std::vector<u32> depths;
+        std::vector<f32> originX, originY, originZ;
+        std::vector<f32> positionX, positionY, positionZ;
+        std::vector<f32> scaleX, scaleY, scaleZ;
+        std::vector<f32> rotationX, rotationY, rotationZ, rotationW;
+        std::vector<u8> dirty;
+        std::vector<u8> changed;
+        std::vector<u8> uniformScale; // world scale is uniform, the normal matrix is the world matrix
+        std::vector<glm::mat4> worldMatrices;
+        std::vector<glm::mat3> normalMatrices;
+    };
+}
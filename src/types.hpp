@@ -6,4 +6,6 @@ using u32 = unsigned int;
 using u64 = unsigned long;
 using f32 = float;
 using f64 = double;
+using i8 = signed char;
+using i16 = short;
 using i32 = int;
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include "vertex_layout.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace ay
+{
+    struct VertexFormatInfo {
+        u32 size;
+        GLenum type;
+        GLint components;
+        GLboolean normalized;
+    };
+
+    static const VertexFormatInfo VERTEX_FORMATS[] = {
+        { 8, GL_FLOAT, 2, GL_FALSE },           // FLOAT2
+        { 12, GL_FLOAT, 3, GL_FALSE },          // FLOAT3
+        { 8, GL_HALF_FLOAT, 4, GL_FALSE },      // HALF4
+        { 4, GL_SHORT, 2, GL_TRUE },            // OCT_SNORM16
+        { 4, GL_UNSIGNED_SHORT, 2, GL_TRUE },   // UNORM16X2
+        { 4, GL_UNSIGNED_BYTE, 4, GL_TRUE }     // UNORM8X4
+    };
+
+    ///
+    /// @brief Convert a float to a half float (round to nearest)
+    /// @param value Float
+    /// @return Half float bits
+    ///
+    static u16 toHalf(f32 value) {
+        u32 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const u32 sign = (bits >> 16) & 0x8000;
+        const i32 exponent = (i32)((bits >> 23) & 0xff) - 127 + 15;
+        u32 mantissa = bits & 0x7fffff;
+
+        if (exponent <= 0) {
+            // subnormal or zero
+            if (exponent < -10) {
+                return (u16)sign;
+            }
+            mantissa |= 0x800000;
+            const u32 shift = (u32)(14 - exponent);
+            u32 half = mantissa >> shift;
+            half += (mantissa >> (shift - 1)) & 1;
+            return (u16)(sign | half);
+        }
+
+        if (exponent >= 31) {
+            return (u16)(sign | 0x7c00);
+        }
+
+        // a carry of the rounding moves to the exponent, which is still correct
+        u32 half = sign | ((u32)exponent << 10) | (mantissa >> 13);
+        half += (mantissa >> 12) & 1;
+        return (u16)half;
+    }
+
+    ///
+    /// @brief Convert a float in [lo, hi] to a normalized integer
+    ///
+    template<typename T>
+    static T toNormalized(f32 value, f32 lo, f32 scale) {
+        return (T)std::lround(std::min(std::max(value, lo), 1.f) * scale);
+    }
+
+    ///
+    /// @brief Octahedral encoding of a unit vector
+    /// @param n Unit vector
+    /// @param out Encoded vector (snorm16)
+    ///
+    static void octEncode(const glm::vec3& n, i16 out[2]) {
+        const f32 l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        f32 x = l1 > 0.f ? n.x / l1 : 0.f;
+        f32 y = l1 > 0.f ? n.y / l1 : 0.f;
+        if (n.z < 0.f) {
+            const f32 folded = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+            y = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+            x = folded;
+        }
+        out[0] = toNormalized<i16>(x, -1.f, 32767.f);
+        out[1] = toNormalized<i16>(y, -1.f, 32767.f);
+    }
+
+    VertexLayout::VertexLayout(VertexFormat position, VertexFormat normal, VertexFormat texcoord, VertexFormat color)
+        : attributes(),
+        stride(0)
+    {
+        const VertexFormat formats[4] = { position, normal, texcoord, color };
+        for (u32 i = 0; i < 4; i++) {
+            attributes[i].location = i;
+            attributes[i].format = formats[i];
+            attributes[i].offset = stride;
+            stride += VERTEX_FORMATS[(size_t)formats[i]].size;
+        }
+    }
+
+    VertexLayout VertexLayout::standard() {
+        return VertexLayout(VertexFormat::FLOAT3, VertexFormat::FLOAT3, VertexFormat::FLOAT2, VertexFormat::FLOAT3);
+    }
+
+    bool VertexLayout::fromKey(u32 key, VertexLayout& layout) {
+        const u32 formatCount = (u32)(sizeof(VERTEX_FORMATS) / sizeof(VERTEX_FORMATS[0]));
+        if ((key >> 16) != 0 ||
+            (key & 0xf) >= formatCount ||
+            ((key >> 4) & 0xf) >= formatCount ||
+            ((key >> 8) & 0xf) >= formatCount ||
+            ((key >> 12) & 0xf) >= formatCount) {
+            return false;
+        }
+
+        layout = VertexLayout(
+            (VertexFormat)(key & 0xf),
+            (VertexFormat)((key >> 4) & 0xf),
+            (VertexFormat)((key >> 8) & 0xf),
+            (VertexFormat)((key >> 12) & 0xf));
+        return true;
+    }
+
+    VertexLayout VertexLayout::select(const MeshData& data, bool quantize) {
+        if (!quantize || data.vertices.empty()) {
+            return standard();
+        }
+
+        glm::vec3 lo = data.vertices[0].position, hi = lo;
+        f32 maxCoordinate = 0.f;
+        bool texcoordsInRange = true;
+        for (auto& vertex : data.vertices) {
+            for (int i = 0; i < 3; i++) {
+                lo[i] = std::min(lo[i], vertex.position[i]);
+                hi[i] = std::max(hi[i], vertex.position[i]);
+                maxCoordinate = std::max(maxCoordinate, std::abs(vertex.position[i]));
+            }
+            texcoordsInRange = texcoordsInRange &&
+                vertex.uv.x >= 0.f && vertex.uv.x <= 1.f &&
+                vertex.uv.y >= 0.f && vertex.uv.y <= 1.f;
+        }
+
+        // half floats keep 11 bits: the rounding error stays under 1/2048 of the
+        // mesh size as long as the mesh is not far from its origin
+        const f32 size = std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z));
+        const bool halfPositions = size > 0.f && maxCoordinate <= size && maxCoordinate < 65504.f;
+
+        return VertexLayout(
+            halfPositions ? VertexFormat::HALF4 : VertexFormat::FLOAT3,
+            VertexFormat::OCT_SNORM16,
+            texcoordsInRange ? VertexFormat::UNORM16X2 : VertexFormat::FLOAT2,
+            VertexFormat::UNORM8X4);
+    }
+
+    void VertexLayout::encode(const Vertex* vertices, size_t count, u8* out) const {
+        for (size_t i = 0; i < count; i++) {
+            const Vertex& vertex = vertices[i];
+            const f32* values[4] = { &vertex.position.x, &vertex.normal.x, &vertex.uv.x, &vertex.color.x };
+            u8* dst = out + i * stride;
+
+            for (size_t a = 0; a < attributes.size(); a++) {
+                const f32* value = values[a];
+                u8* ptr = dst + attributes[a].offset;
+                switch (attributes[a].format) {
+                case VertexFormat::FLOAT2:
+                    std::memcpy(ptr, value, sizeof(f32) * 2);
+                    break;
+
+                case VertexFormat::FLOAT3:
+                    std::memcpy(ptr, value, sizeof(f32) * 3);
+                    break;
+
+                case VertexFormat::HALF4: {
+                    const u16 half[4] = { toHalf(value[0]), toHalf(value[1]), toHalf(value[2]), toHalf(1.f) };
+                    std::memcpy(ptr, half, sizeof(half));
+                    break;
+                }
+
+                case VertexFormat::OCT_SNORM16: {
+                    i16 oct[2];
+                    octEncode(vertex.normal, oct);
+                    std::memcpy(ptr, oct, sizeof(oct));
+                    break;
+                }
+
+                case VertexFormat::UNORM16X2: {
+                    const u16 unorm[2] = { toNormalized<u16>(value[0], 0.f, 65535.f), toNormalized<u16>(value[1], 0.f, 65535.f) };
+                    std::memcpy(ptr, unorm, sizeof(unorm));
+                    break;
+                }
+
+                case VertexFormat::UNORM8X4: {
+                    const u8 unorm[4] = {
+                        toNormalized<u8>(value[0], 0.f, 255.f),
+                        toNormalized<u8>(value[1], 0.f, 255.f),
+                        toNormalized<u8>(value[2], 0.f, 255.f),
+                        255
+                    };
+                    std::memcpy(ptr, unorm, sizeof(unorm));
+                    break;
+                }
+                }
+            }
+        }
+    }
+
+    void VertexLayout::setup(const Context* ctx) const {
+        for (auto& attribute : attributes) {
+            const VertexFormatInfo& info = VERTEX_FORMATS[(size_t)attribute.format];
+            ctx->bufferAttribute(attribute.location, info.type, info.components, info.normalized, (GLsizei)stride, (GLvoid*)(size_t)attribute.offset);
+        }
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "types.hpp"
+#include "context.hpp"
+#include <array>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace ay
+{
+    struct Vertex {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec2 uv;
+        glm::vec3 color;
+    };
+
+    struct MeshData {
+        std::vector<Vertex> vertices;
+        std::vector<u32> indices;
+    };
+
+    enum class VertexFormat : u8 {
+        FLOAT2 = 0,  // 8 bytes
+        FLOAT3 = 1,  // 12 bytes
+        HALF4 = 2,   // 8 bytes, w = 1
+        OCT_SNORM16 = 3, // 4 bytes, octahedral unit vector
+        UNORM16X2 = 4, // 4 bytes, [0, 1]
+        UNORM8X4 = 5 // 4 bytes, [0, 1]
+    };
+
+    struct VertexAttribute {
+        Attribute location;
+        VertexFormat format;
+        u32 offset;
+    };
+
+    class VertexLayout {
+    public:
+        ///
+        /// @brief Constructor (interleaved attributes in location order)
+        /// @param position Position format
+        /// @param normal Normal format
+        /// @param texcoord Texture coordinates format
+        /// @param color Color format
+        ///
+        VertexLayout(VertexFormat position, VertexFormat normal, VertexFormat texcoord, VertexFormat color);
+
+        ///
+        /// @brief Full precision layout (44 bytes per vertex)
+        /// @return Layout
+        ///
+        static VertexLayout standard();
+
+        ///
+        /// @brief Choose the smallest layout that keeps the mesh accurate
+        /// @param data Mesh
+        /// @param quantize Allow quantized formats
+        /// @return Layout
+        ///
+        static VertexLayout select(const MeshData& data, bool quantize);
+
+        ///
+        /// @brief Rebuild a layout from its key
+        /// @param key Key
+        /// @param layout Output, layout
+        /// @return False if the key is not a valid layout
+        ///
+        static bool fromKey(u32 key, VertexLayout& layout);
+
+        ///
+        /// @brief Get a key identifying the layout
+        /// @return Key
+        ///
+        inline u32 key() const {
+            return (u32)attributes[0].format |
+                ((u32)attributes[1].format << 4) |
+                ((u32)attributes[2].format << 8) |
+                ((u32)attributes[3].format << 12);
+        }
+
+        ///
+        /// @brief Get the size of a vertex
+        /// @return Stride in bytes
+        ///
+        inline u32 getStride() const {
+            return stride;
+        }
+
+        ///
+        /// @brief Check if normals are octahedral encoded (the shader has to decode them)
+        /// @return True if encoded
+        ///
+        inline bool hasOctNormals() const {
+            return attributes[1].format == VertexFormat::OCT_SNORM16;
+        }
+
+        ///
+        /// @brief Convert vertices to the layout
+        /// @param vertices Vertices
+        /// @param count Vertices count
+        /// @param out Destination (count * stride bytes)
+        ///
+        void encode(const Vertex* vertices, size_t count, u8* out) const;
+
+        ///
+        /// @brief Describe the layout to the bound vao (the vertex buffer must be bound)
+        /// @param ctx Context
+        ///
+        void setup(const Context* ctx) const;
+
+    private:
+        std::array<VertexAttribute, 4> attributes;
+        u32 stride;
+    };
+}
@@ -0,0 +1,108 @@
+#include "transform_store.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+using namespace ay;
+
+///
+/// @brief Build a breadth-first hierarchy of 4-ary nodes with varied transforms
+/// @param count Number of nodes
+/// @param parents Output, parent of each node (-1 for the root)
+/// @param locals Output, local transform of each node
+///
+static void buildHierarchy(u32 count, std::vector<i32>& parents, std::vector<Transform>& locals) {
+    parents.resize(count);
+    locals.resize(count);
+    for (u32 i = 0; i < count; i++) {
+        parents[i] = i == 0 ? -1 : (i32)((i - 1) / 4);
+        locals[i].position = glm::vec3((f32)(i % 7), (f32)(i % 5) * .5f, (f32)(i % 3) * .25f);
+        locals[i].scale = i % 2 == 0 ? glm::vec3(1.f) : glm::vec3(1.f, 2.f, 1.f);
+        const f32 angle = (f32)(i % 360) * .01745f * .5f;
+        locals[i].rotation = glm::quat(std::cos(angle), 0.f, std::sin(angle), 0.f);
+    }
+}
+
+///
+/// @brief Time a function
+/// @param iterations Number of runs
+/// @param fn Function
+/// @return Average time in ms
+///
+template<typename F>
+static f64 measure(u32 iterations, F fn) {
+    const auto start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < iterations; i++) {
+        fn(i);
+    }
+    const std::chrono::duration<f64, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (f64)iterations;
+}
+
+int main(int argc, char** argv) {
+    std::vector<u32> counts = { 10000, 100000, 1000000 };
+    if (argc > 1) {
+        counts.assign(1, (u32)std::strtoul(argv[1], nullptr, 10));
+    }
+
+    // one value read from the results, the optimizer cannot drop the work
+    f32 checksum = 0.f;
+    for (u32 count : counts) {
+        std::vector<i32> parents;
+        std::vector<Transform> locals;
+        buildHierarchy(count, parents, locals);
+        const u32 iterations = std::max(1u, 2000000u / count);
+
+        // previous path: every node recomposes its local matrix and multiplies it by its parent world matrix
+        std::vector<glm::mat4> worlds(count);
+        const f64 naive = measure(iterations, [&](u32 iteration) {
+            locals[0].position.x = (f32)iteration;
+            for (u32 i = 0; i < count; i++) {
+                const glm::mat4 local = locals[i].getTransform();
+                worlds[i] = parents[i] < 0 ? local : worlds[(size_t)parents[i]] * local;
+            }
+            checksum += worlds[count - 1][3][0];
+        });
+
+        TransformStore store;
+        for (u32 i = 0; i < count; i++) {
+            store.add(parents[i], locals[i]);
+        }
+        store.update();
+
+        // moving the root dirties the whole hierarchy
+        const f64 all = measure(iterations, [&](u32 iteration) {
+            Transform root = locals[0];
+            root.position.x = (f32)iteration + 1.f;
+            store.set(0, root);
+            store.update();
+            checksum += store.getWorldMatrix(count - 1)[3][0];
+        });
+
+        // 1% of the nodes move, all leaves
+        const u32 first = count - count / 4;
+        const f64 some = measure(iterations, [&](u32 iteration) {
+            for (u32 i = first; i < count; i += 25) {
+                Transform leaf = locals[i];
+                leaf.position.y = (f32)iteration;
+                store.set(i, leaf);
+            }
+            store.update();
+            checksum += store.getWorldMatrix(count - 1)[3][0];
+        });
+
+        const f64 none = measure(iterations, [&](u32) {
+            store.update();
+            checksum += store.getWorldMatrix(count - 1)[3][0];
+        });
+
+        spdlog::info("{} nodes: getTransform {:.3f} ms, store all dirty {:.3f} ms ({:.1f}x), 1% dirty {:.3f} ms, static {:.3f} ms",
+            count, naive, all, naive / all, some, none);
+    }
+
+    spdlog::debug("checksum {}", checksum);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,718 @@
+#include "glb_reader.hpp"
+#include "ktx2.hpp"
+#include "cooked_model.hpp"
+#include "etc_encoder.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "transform_store.hpp"
+#include "culling.hpp"
+#include "thread_pool.hpp"
+#include <spdlog/spdlog.h>
+#include <stb_image_write.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace ay;
+
+static u32 failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            spdlog::error("{}:{}: check failed: {}", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static std::string directory = ".";
+
+///
+/// @brief Path of a scratch file
+/// @param name File name
+/// @return Path in the scratch directory
+///
+static std::string scratch(const std::string& name) {
+    return directory + "/aycheck_" + name;
+}
+
+///
+/// @brief Read a whole file
+/// @param filename Filename
+/// @return Bytes (empty if missing)
+///
+static std::vector<u8> readFile(const std::string& filename) {
+    std::ifstream file(filename, std::ifstream::binary);
+    return std::vector<u8>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+///
+/// @brief Write a whole file
+/// @param filename Filename
+/// @param data Bytes
+///
+static void writeFile(const std::string& filename, const std::vector<u8>& data) {
+    std::ofstream file(filename, std::ofstream::binary);
+    file.write(reinterpret_cast<const char*>(data.data()), (std::streamsize)data.size());
+}
+
+///
+/// @brief Append a little-endian u32
+///
+static void appendU32(std::vector<u8>& data, u32 value) {
+    for (u32 i = 0; i < 4; i++) {
+        data.push_back((u8)(value >> (i * 8)));
+    }
+}
+
+///
+/// @brief Grid of quads in the z = 0 plane
+/// @param quads Quads per side
+/// @return Vertices and indices
+///
+static MeshData grid(u32 quads) {
+    MeshData data;
+    for (u32 y = 0; y <= quads; y++) {
+        for (u32 x = 0; x <= quads; x++) {
+            Vertex vertex;
+            vertex.position = glm::vec3((f32)x, (f32)y, 0.f);
+            vertex.normal = glm::vec3(0.f, 0.f, 1.f);
+            vertex.uv = glm::vec2((f32)x / (f32)quads, (f32)y / (f32)quads);
+            vertex.color = glm::vec3(1.f);
+            data.vertices.push_back(vertex);
+        }
+    }
+    for (u32 y = 0; y < quads; y++) {
+        for (u32 x = 0; x < quads; x++) {
+            const u32 i = y * (quads + 1) + x;
+            const u32 quad[6] = { i, i + 1, i + quads + 2, i, i + quads + 2, i + quads + 1 };
+            data.indices.insert(data.indices.end(), quad, quad + 6);
+        }
+    }
+    return data;
+}
+
+///
+/// @brief glTF document of one indexed mesh (positions then u32 indices in the buffer)
+/// @param data Mesh
+/// @param bin Output, BIN chunk
+/// @return JSON
+///
+static nlohmann::json gltfMesh(const MeshData& data, std::vector<u8>& bin) {
+    bin.clear();
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (auto& vertex : data.vertices) {
+        const f32* p = &vertex.position.x;
+        bin.insert(bin.end(), (const u8*)p, (const u8*)(p + 3));
+        lo = glm::min(lo, vertex.position);
+        hi = glm::max(hi, vertex.position);
+    }
+    const size_t positionsSize = bin.size();
+    bin.insert(bin.end(), (const u8*)data.indices.data(), (const u8*)(data.indices.data() + data.indices.size()));
+
+    nlohmann::json json;
+    json["asset"] = { { "version", "2.0" } };
+    json["scene"] = 0;
+    json["scenes"] = nlohmann::json::array({ { { "nodes", { 0 } } } });
+    json["nodes"] = nlohmann::json::array({ { { "mesh", 0 }, { "translation", { 1.0, 2.0, 3.0 } } } });
+    json["meshes"] = nlohmann::json::array({ { { "primitives", nlohmann::json::array({ {
+        { "attributes", { { "POSITION", 0 } } }, { "indices", 1 } } }) } } });
+    json["buffers"] = nlohmann::json::array({ { { "byteLength", bin.size() } } });
+    json["bufferViews"] = nlohmann::json::array({
+        { { "buffer", 0 }, { "byteOffset", 0 }, { "byteLength", positionsSize } },
+        { { "buffer", 0 }, { "byteOffset", positionsSize }, { "byteLength", bin.size() - positionsSize } } });
+    json["accessors"] = nlohmann::json::array({
+        { { "bufferView", 0 }, { "componentType", 5126 }, { "count", data.vertices.size() }, { "type", "VEC3" },
+            { "min", { lo.x, lo.y, lo.z } }, { "max", { hi.x, hi.y, hi.z } } },
+        { { "bufferView", 1 }, { "componentType", 5125 }, { "count", data.indices.size() }, { "type", "SCALAR" } } });
+    return json;
+}
+
+///
+/// @brief Write a binary glTF
+/// @param filename Filename
+/// @param json Document
+/// @param bin BIN chunk
+///
+static void writeGlb(const std::string& filename, const nlohmann::json& json, const std::vector<u8>& bin) {
+    std::string text = json.dump();
+    text.resize((text.size() + 3) & ~(size_t)3, ' ');
+    std::vector<u8> chunk(bin);
+    chunk.resize((chunk.size() + 3) & ~(size_t)3, 0);
+
+    std::vector<u8> file;
+    appendU32(file, 0x46546C67);
+    appendU32(file, 2);
+    appendU32(file, (u32)(12 + 8 + text.size() + 8 + chunk.size()));
+    appendU32(file, (u32)text.size());
+    appendU32(file, 0x4E4F534A);
+    file.insert(file.end(), text.begin(), text.end());
+    appendU32(file, (u32)chunk.size());
+    appendU32(file, 0x004E4942);
+    file.insert(file.end(), chunk.begin(), chunk.end());
+    writeFile(filename, file);
+}
+
+///
+/// @brief Open a modified mesh document and read its position accessor
+/// @param json Document
+/// @param bin BIN chunk
+/// @return True if the accessor is accepted
+///
+static bool readPositions(const nlohmann::json& json, const std::vector<u8>& bin) {
+    const std::string filename = scratch("accessor.glb");
+    writeGlb(filename, json, bin);
+    GlbReader reader;
+    AccessorView view;
+    const bool valid = reader.open(filename) && reader.getAccessor(0, view);
+    std::remove(filename.c_str());
+    return valid;
+}
+
+///
+/// @brief Cook a modified mesh document
+/// @param json Document
+/// @param bin BIN chunk
+/// @return True if a mesh was cooked
+///
+static bool cookGlb(const nlohmann::json& json, const std::vector<u8>& bin) {
+    const std::string source = scratch("cook.glb"), destination = scratch("cook.aymesh");
+    writeGlb(source, json, bin);
+    ModelImportOptions options;
+    options.lodRatios.clear();
+    const bool cooked = CookedModel::write(source, destination, options);
+    std::remove(source.c_str());
+    std::remove(destination.c_str());
+    return cooked;
+}
+
+///
+/// @brief Read a valid GLB, refuse out of range and mistyped accessors
+///
+static void checkGlbReader() {
+    std::vector<u8> bin;
+    const MeshData mesh = grid(2);
+    const nlohmann::json json = gltfMesh(mesh, bin);
+
+    const std::string filename = scratch("mesh.glb");
+    writeGlb(filename, json, bin);
+    {
+        GlbReader reader;
+        CHECK(reader.open(filename));
+        CHECK(reader.getArray("nodes").size() == 1);
+        CHECK(reader.getArray("missing").empty());
+
+        AccessorView positions;
+        CHECK(reader.getAccessor(0, positions));
+        CHECK(positions.count == 9 && positions.components == 3 && positions.stride == 12);
+        f32 last[3];
+        std::memcpy(last, positions.data + 8 * positions.stride, sizeof(last));
+        CHECK(last[0] == 2.f && last[1] == 2.f && last[2] == 0.f);
+
+        AccessorView indices;
+        CHECK(reader.getAccessor(1, indices));
+        CHECK(indices.count == 24 && indices.componentType == 5125);
+
+        const u8* data;
+        size_t size;
+        CHECK(reader.getBufferView(1, data, size) && size == 24 * sizeof(u32));
+        CHECK(!reader.getAccessor(2, indices));
+    }
+    std::remove(filename.c_str());
+    CHECK(readPositions(json, bin));
+
+    // sizes that overflow the bound computations
+    nlohmann::json hostile = json;
+    hostile["accessors"][0]["count"] = 0x4000000000000001ull;
+    CHECK(!readPositions(hostile, bin));
+    hostile = json;
+    hostile["accessors"][0]["byteOffset"] = 0xfffffffffffffff0ull;
+    CHECK(!readPositions(hostile, bin));
+    hostile = json;
+    hostile["bufferViews"][0]["byteOffset"] = 0xfffffffffffffff0ull;
+    CHECK(!readPositions(hostile, bin));
+    hostile = json;
+    hostile["bufferViews"][0]["byteLength"] = 0xfffffffffffffff0ull;
+    CHECK(!readPositions(hostile, bin));
+    hostile = json;
+    hostile["bufferViews"][0]["byteStride"] = 4;
+    CHECK(!readPositions(hostile, bin));
+    hostile = json;
+    hostile["accessors"][0]["count"] = 10;
+    CHECK(!readPositions(hostile, bin));
+
+    // the import refuses the broken primitives without throwing
+    CHECK(cookGlb(json, bin));
+    hostile = json;
+    hostile["accessors"][0]["count"] = "9";
+    CHECK(!cookGlb(hostile, bin));
+    hostile = json;
+    hostile["nodes"][0]["translation"] = "up";
+    CHECK(!cookGlb(hostile, bin));
+    hostile = json;
+    hostile["accessors"][0]["type"] = "VEC2";
+    CHECK(!cookGlb(hostile, bin));
+    hostile = json;
+    hostile["accessors"][1]["componentType"] = 5126;
+    CHECK(!cookGlb(hostile, bin));
+    std::vector<u8> outOfRange = bin;
+    const u32 index = 9;
+    std::memcpy(outOfRange.data() + 9 * 12, &index, sizeof(index));
+    CHECK(!cookGlb(json, outOfRange));
+
+    // without min and max the bounds come from the positions (grid(2) spans 0..2 in x and y)
+    hostile = json;
+    hostile["accessors"][0].erase("min");
+    hostile["accessors"][0].erase("max");
+    {
+        const std::string source = scratch("bounds.glb"), destination = scratch("bounds.aymesh");
+        writeGlb(source, hostile, bin);
+        CHECK(CookedModel::write(source, destination, ModelImportOptions()));
+        const std::vector<u8> cooked = readFile(destination);
+        u32 meshesOffset = 0;
+        f32 bounds[6] = { 0.f };
+        if (cooked.size() >= 36) {
+            std::memcpy(&meshesOffset, cooked.data() + 32, sizeof(meshesOffset));
+        }
+        // after the 16 fields of 4 bytes that precede them in a cooked mesh
+        CHECK((size_t)meshesOffset + 64 + sizeof(bounds) <= cooked.size());
+        if ((size_t)meshesOffset + 64 + sizeof(bounds) <= cooked.size()) {
+            std::memcpy(bounds, cooked.data() + meshesOffset + 64, sizeof(bounds));
+        }
+        CHECK(bounds[0] == 0.f && bounds[1] == 0.f && bounds[2] == 0.f && bounds[3] == 2.f && bounds[4] == 2.f && bounds[5] == 0.f);
+        std::remove(source.c_str());
+        std::remove(destination.c_str());
+    }
+
+    // a node listed again (a cycle) or too deep is left out, the rest of the hierarchy is kept
+    hostile = json;
+    hostile["nodes"][0]["children"] = { 0 };
+    CHECK(cookGlb(hostile, bin));
+    hostile = json;
+    hostile["nodes"][0]["children"] = { 1 };
+    hostile["nodes"].push_back({ { "children", { 0 } } });
+    CHECK(cookGlb(hostile, bin));
+    hostile = json;
+    for (i32 i = 1; i <= 100000; i++) {
+        hostile["nodes"][(size_t)(i - 1)]["children"] = { i };
+        hostile["nodes"].push_back(nlohmann::json::object());
+    }
+    CHECK(cookGlb(hostile, bin));
+}
+
+///
+/// @brief Decode an ETC1 compatible color block
+/// @param block Block (8 bytes)
+/// @param rgb Output, pixels (RGB8, row-major)
+/// @return False if the block uses an ETC2 only mode
+///
+static bool decodeEtc1(const u8* block, u8* rgb) {
+    static const i32 modifiers[8][2] = { { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 } };
+    const bool differential = (block[3] & 2) != 0;
+    const bool flip = (block[3] & 1) != 0;
+    const u32 tables[2] = { (u32)block[3] >> 5, ((u32)block[3] >> 2) & 7 };
+
+    i32 base[2][3];
+    for (u32 c = 0; c < 3; c++) {
+        if (differential) {
+            const i32 first = block[c] >> 3;
+            const i32 delta = (i32)((block[c] & 7) ^ 4) - 4;
+            const i32 second = first + delta;
+            if (second < 0 || second > 31) {
+                return false;
+            }
+            base[0][c] = (first << 3) | (first >> 2);
+            base[1][c] = (second << 3) | (second >> 2);
+        }
+        else {
+            base[0][c] = (block[c] >> 4) * 17;
+            base[1][c] = (block[c] & 15) * 17;
+        }
+    }
+
+    const u32 indices = ((u32)block[4] << 24) | ((u32)block[5] << 16) | ((u32)block[6] << 8) | block[7];
+    for (u32 x = 0; x < 4; x++) {
+        for (u32 y = 0; y < 4; y++) {
+            const u32 i = x * 4 + y;
+            const u32 sub = flip ? (y >= 2 ? 1 : 0) : (x >= 2 ? 1 : 0);
+            const u32 code = (((indices >> (i + 16)) & 1) << 1) | ((indices >> i) & 1);
+            const i32 modifier = modifiers[tables[sub]][code & 1] * (code & 2 ? -1 : 1);
+            for (u32 c = 0; c < 3; c++) {
+                rgb[(y * 4 + x) * 3 + c] = (u8)std::min(std::max(base[sub][c] + modifier, 0), 255);
+            }
+        }
+    }
+    return true;
+}
+
+///
+/// @brief Encode solid and gradient blocks, decode them back and bound the error
+///
+static void checkEtcEncoder() {
+    CHECK(EtcEncoder::compressedSize(4, 4, false) == 8);
+    CHECK(EtcEncoder::compressedSize(4, 4, true) == 16);
+    CHECK(EtcEncoder::compressedSize(5, 9, false) == 2 * 3 * 8);
+    CHECK(EtcEncoder::compressedSize(1, 1, true) == 16);
+
+    // a constant block and a smooth gradient
+    std::vector<u8> rgba(8 * 4 * 4);
+    for (u32 y = 0; y < 4; y++) {
+        for (u32 x = 0; x < 8; x++) {
+            u8* pixel = &rgba[(y * 8 + x) * 4];
+            pixel[0] = x < 4 ? 200 : (u8)(40 + (x - 4) * 16 + y * 4);
+            pixel[1] = x < 4 ? 100 : (u8)(90 + y * 10);
+            pixel[2] = x < 4 ? 50 : (u8)(160 - (x - 4) * 8);
+            pixel[3] = x < 4 ? 255 : (u8)(y * 80);
+        }
+    }
+
+    ThreadPool threadPool(2);
+    for (u32 alpha = 0; alpha < 2; alpha++) {
+        std::vector<u8> out(EtcEncoder::compressedSize(8, 4, alpha != 0));
+        EtcEncoder::compress(rgba.data(), 8, 4, alpha != 0, out.data(), alpha != 0 ? &threadPool : nullptr);
+
+        const size_t blockSize = alpha ? 16 : 8;
+        for (u32 b = 0; b < 2; b++) {
+            const u8* block = out.data() + b * blockSize;
+            u8 rgb[48];
+            CHECK(decodeEtc1(block + (alpha ? 8 : 0), rgb));
+            i32 maxError = 0;
+            for (u32 y = 0; y < 4; y++) {
+                for (u32 x = 0; x < 4; x++) {
+                    for (u32 c = 0; c < 3; c++) {
+                        const i32 error = std::abs((i32)rgb[(y * 4 + x) * 3 + c] - (i32)rgba[(y * 8 + b * 4 + x) * 4 + c]);
+                        maxError = std::max(maxError, error);
+                    }
+                }
+            }
+            CHECK(maxError <= (b == 0 ? 4 : 16));
+        }
+
+        // EAC: base, multiplier and table, then 16 indices of 3 bits
+        if (alpha) {
+            static const i32 modifiers[16][8] = {
+                { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 }, { -2, -5, -8, -13, 1, 4, 7, 12 },
+                { -2, -4, -6, -13, 1, 3, 5, 12 }, { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+                { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 }, { -2, -6, -8, -10, 1, 5, 7, 9 },
+                { -2, -5, -8, -10, 1, 4, 7, 9 }, { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+                { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 }, { -4, -6, -8, -9, 3, 5, 7, 8 },
+                { -3, -5, -7, -9, 2, 4, 6, 8 } };
+            for (u32 b = 0; b < 2; b++) {
+                const u8* block = out.data() + b * blockSize;
+                unsigned long long bits = 0;
+                for (u32 i = 2; i < 8; i++) {
+                    bits = (bits << 8) | block[i];
+                }
+                i32 maxError = 0;
+                for (u32 x = 0; x < 4; x++) {
+                    for (u32 y = 0; y < 4; y++) {
+                        const u32 index = (u32)(bits >> (45 - 3 * (x * 4 + y))) & 7;
+                        const i32 value = std::min(std::max((i32)block[0] + modifiers[block[1] & 15][index] * (block[1] >> 4), 0), 255);
+                        maxError = std::max(maxError, std::abs(value - (i32)rgba[(y * 8 + b * 4 + x) * 4 + 3]));
+                    }
+                }
+                CHECK(maxError <= (b == 0 ? 0 : 8));
+            }
+        }
+    }
+}
+
+///
+/// @brief Cook a PNG bottom-up and top-down, read and rewrite the KTX2, refuse damaged files
+///
+static void checkKtx2() {
+    const u8 garbage[80] = { 0 };
+    CHECK(!Ktx2Texture::isKtx2(garbage, sizeof(garbage)));
+
+    // a 16x8 image cooked with its mip chain
+    std::vector<u8> rgba(16 * 8 * 4);
+    for (size_t i = 0; i < rgba.size(); i++) {
+        rgba[i] = i % 4 == 3 ? 255 : (u8)(i * 7);
+    }
+    const std::string png = scratch("image.png"), ktx2 = scratch("image.ktx2");
+    CHECK(stbi_write_png(png.c_str(), 16, 8, 4, rgba.data(), 16 * 4) != 0);
+    CHECK(Ktx2Texture::cook(png, ktx2, true, nullptr));
+
+    // stored bottom row first, as the flipped rows compress
+    std::vector<u8> flipped(rgba.size()), expected(EtcEncoder::compressedSize(16, 8, false));
+    for (size_t y = 0; y < 8; y++) {
+        std::copy(rgba.begin() + (std::ptrdiff_t)((7 - y) * 16 * 4), rgba.begin() + (std::ptrdiff_t)((8 - y) * 16 * 4), flipped.begin() + (std::ptrdiff_t)(y * 16 * 4));
+    }
+    EtcEncoder::compress(flipped.data(), 16, 8, false, expected.data(), nullptr);
+    std::vector<u8> file = readFile(ktx2);
+    Ktx2Image image;
+    CHECK(Ktx2Texture::read(file.data(), file.size(), image) && image.bottomUp);
+    CHECK(!image.levels.empty() && image.levels[0].size == expected.size() &&
+        std::memcmp(file.data() + image.levels[0].offset, expected.data(), expected.size()) == 0);
+
+    CHECK(Ktx2Texture::cook(png, ktx2, false, nullptr));
+    file = readFile(ktx2);
+    CHECK(Ktx2Texture::isKtx2(file.data(), file.size()));
+    CHECK(Ktx2Texture::read(file.data(), file.size(), image));
+    CHECK(image.format == GL_COMPRESSED_RGB8_ETC2 && image.width == 16 && image.height == 8 && !image.bottomUp);
+    CHECK(image.levels.size() == 5);
+    if (image.levels.size() == 5) {
+        const size_t sizes[5] = { 64, 16, 8, 8, 8 };
+        for (size_t i = 0; i < 5; i++) {
+            CHECK(image.levels[i].size == sizes[i] && image.levels[i].offset + sizes[i] <= file.size());
+        }
+
+        // written back level by level, the file reads the same
+        std::vector<u8> levels;
+        Ktx2Image copy = image;
+        for (auto& level : copy.levels) {
+            const size_t offset = levels.size();
+            levels.insert(levels.end(), file.begin() + (std::ptrdiff_t)level.offset, file.begin() + (std::ptrdiff_t)(level.offset + level.size));
+            level.offset = offset;
+        }
+        CHECK(Ktx2Texture::write(ktx2, copy, levels.data()));
+        std::vector<u8> rewritten = readFile(ktx2);
+        Ktx2Image reread;
+        CHECK(Ktx2Texture::read(rewritten.data(), rewritten.size(), reread) && reread.levels.size() == 5 && !reread.bottomUp);
+        for (size_t i = 0; i < reread.levels.size() && i < 5; i++) {
+            CHECK(std::memcmp(rewritten.data() + reread.levels[i].offset, file.data() + image.levels[i].offset, sizes[i]) == 0);
+        }
+    }
+
+    // a truncated file, a level past the end and a supercompressed file are refused
+    Ktx2Image refused;
+    CHECK(!Ktx2Texture::read(file.data(), file.size() - 1, refused));
+    std::vector<u8> broken = file;
+    broken[80 + 3 * 24 + 8] = 0xff;
+    CHECK(!Ktx2Texture::read(broken.data(), broken.size(), refused));
+    broken = file;
+    broken[44] = 1;
+    CHECK(!Ktx2Texture::read(broken.data(), broken.size(), refused));
+    broken = file;
+    broken[60] = 0xff;
+    CHECK(!Ktx2Texture::read(broken.data(), broken.size(), refused));
+
+    std::remove(png.c_str());
+    std::remove(ktx2.c_str());
+}
+
+///
+/// @brief Cook a textured GLB, load it back and cook it again, refuse damaged .aymesh files
+///
+static void checkCookedModel() {
+    // an embedded base color image and an external emissive one
+    const std::string png = scratch("texture.png");
+    const u8 pixels[16] = { 255, 0, 0, 255, 0, 255, 0, 255, 0, 0, 255, 255, 255, 255, 255, 255 };
+    CHECK(stbi_write_png(png.c_str(), 2, 2, 4, pixels, 2 * 4) != 0);
+    const std::vector<u8> image = readFile(png);
+
+    std::vector<u8> bin;
+    nlohmann::json json = gltfMesh(grid(16), bin);
+    const size_t imageOffset = bin.size();
+    bin.insert(bin.end(), image.begin(), image.end());
+    json["buffers"][0]["byteLength"] = bin.size();
+    json["bufferViews"].push_back({ { "buffer", 0 }, { "byteOffset", imageOffset }, { "byteLength", image.size() } });
+    json["images"] = nlohmann::json::array({ { { "bufferView", 2 }, { "mimeType", "image/png" } }, { { "uri", "aycheck_texture.png" } } });
+    json["textures"] = nlohmann::json::array({ { { "source", 0 } }, { { "source", 1 } } });
+    json["materials"] = nlohmann::json::array({ { { "pbrMetallicRoughness", { { "baseColorTexture", { { "index", 0 } } } } },
+        { "emissiveTexture", { { "index", 1 } } } } });
+    json["meshes"][0]["primitives"][0]["material"] = 0;
+
+    const std::string source = scratch("model.glb"), destination = scratch("model.aymesh");
+    writeGlb(source, json, bin);
+    CHECK(CookedModel::write(source, destination, ModelImportOptions()));
+    const std::vector<u8> cooked = readFile(destination);
+    CHECK(cooked.size() > 60 && std::memcmp(cooked.data(), "AYMS", 4) == 0);
+
+    // the embedded image is stored as it is encoded, the external one by its uri
+    const char uri[] = "aycheck_texture.png";
+    CHECK(std::search(cooked.begin(), cooked.end(), image.begin(), image.end()) != cooked.end());
+    CHECK(std::search(cooked.begin(), cooked.end(), uri, uri + sizeof(uri) - 1) != cooked.end());
+
+    // cook -> load -> cook gives the same file
+    const std::string corrupted = scratch("corrupted.aymesh"), recooked = scratch("recooked.aymesh");
+    CHECK(CookedModel::write(destination, recooked, ModelImportOptions()));
+    CHECK(readFile(recooked) == cooked);
+
+    // the loader validates the file before building anything
+    std::vector<u8> broken(cooked.begin(), cooked.end() - 4);
+    writeFile(corrupted, broken);
+    CHECK(!CookedModel::write(corrupted, recooked, ModelImportOptions()));
+    broken = cooked;
+    broken[4] = (u8)(COOKED_MODEL_VERSION + 1);
+    writeFile(corrupted, broken);
+    CHECK(!CookedModel::write(corrupted, recooked, ModelImportOptions()));
+    broken = cooked;
+    std::memset(broken.data() + 32, 0xff, 4);
+    writeFile(corrupted, broken);
+    CHECK(!CookedModel::write(corrupted, recooked, ModelImportOptions()));
+    broken = cooked;
+    std::memset(broken.data() + 16, 0xff, 4); // mesh count
+    writeFile(corrupted, broken);
+    CHECK(!CookedModel::write(corrupted, recooked, ModelImportOptions()));
+    broken = cooked;
+    std::memset(broken.data() + 44, 0xff, 4); // image count
+    writeFile(corrupted, broken);
+    CHECK(!CookedModel::write(corrupted, recooked, ModelImportOptions()));
+
+    std::remove(source.c_str());
+    std::remove(destination.c_str());
+    std::remove(corrupted.c_str());
+    std::remove(recooked.c_str());
+    std::remove(png.c_str());
+}
+
+///
+/// @brief Simplify a flat grid, its surface must be kept
+///
+static void checkMeshSimplifier() {
+    const MeshData data = grid(16);
+    f32 error = -1.f;
+    const std::vector<u32> simplified = MeshSimplifier::simplify(data.indices, data.vertices, data.indices.size() / 4, &error);
+    CHECK(!simplified.empty() && simplified.size() % 3 == 0);
+    CHECK(simplified.size() <= data.indices.size() / 4);
+    CHECK(error >= 0.f && error < 1e-3f);
+
+    // a flat grid keeps covering its area
+    f32 area = 0.f;
+    bool inRange = true;
+    for (size_t i = 0; i + 2 < simplified.size(); i += 3) {
+        inRange = inRange && simplified[i] < data.vertices.size() && simplified[i + 1] < data.vertices.size() && simplified[i + 2] < data.vertices.size();
+        if (inRange) {
+            const glm::vec3 a = data.vertices[simplified[i]].position;
+            const glm::vec3 b = data.vertices[simplified[i + 1]].position;
+            const glm::vec3 c = data.vertices[simplified[i + 2]].position;
+            area += glm::length(glm::cross(b - a, c - a)) * .5f;
+        }
+    }
+    CHECK(inRange);
+    CHECK(std::abs(area - 256.f) < 1e-2f);
+}
+
+///
+/// @brief Optimize a grid for the vertex cache and the vertex fetch
+///
+static void checkMeshOptimizer() {
+    // a triangle loads its three vertices once
+    const std::vector<u32> triangle = { 0, 1, 2 };
+    const VertexCacheStatistics one = MeshOptimizer::analyzeVertexCache(triangle, 3);
+    CHECK(one.triangles == 1 && one.vertices == 3 && one.misses == 3);
+
+    MeshData data = grid(32);
+    const VertexCacheStatistics before = MeshOptimizer::analyzeVertexCache(data.indices, (u32)data.vertices.size());
+    std::vector<u32> sorted = data.indices;
+    std::sort(sorted.begin(), sorted.end());
+    MeshOptimizer::optimize(data);
+    const VertexCacheStatistics after = MeshOptimizer::analyzeVertexCache(data.indices, (u32)data.vertices.size());
+    CHECK(after.triangles == before.triangles && after.vertices == before.vertices);
+    CHECK(after.acmr() < before.acmr());
+    CHECK(after.acmr() < .8f);
+
+    // the fetch order follows the first use, unused vertices go away
+    MeshData fetch;
+    fetch.vertices.resize(4);
+    for (u32 i = 0; i < 4; i++) {
+        fetch.vertices[i].position = glm::vec3((f32)i, 0.f, 0.f);
+    }
+    fetch.indices = { 3, 1, 2 };
+    MeshOptimizer::optimizeVertexFetch(fetch);
+    CHECK(fetch.vertices.size() == 3);
+    CHECK(fetch.indices == std::vector<u32>({ 0, 1, 2 }));
+    CHECK(fetch.vertices[0].position.x == 3.f && fetch.vertices[1].position.x == 1.f && fetch.vertices[2].position.x == 2.f);
+}
+
+///
+/// @brief Propagate transforms down a small hierarchy and track the changes
+///
+static void checkTransformStore() {
+    TransformStore store;
+    Transform root, child, leaf;
+    root.position = glm::vec3(1.f, 0.f, 0.f);
+    child.position = glm::vec3(0.f, 2.f, 0.f);
+    child.scale = glm::vec3(2.f);
+    leaf.position = glm::vec3(0.f, 0.f, 3.f);
+    CHECK(store.add(-1, root) == 0);
+    CHECK(store.add(0, child) == 1);
+    const u32 sibling = store.add(0, Transform()); // breadth-first, before the deeper leaf
+    CHECK(store.add(1, leaf) == 3);
+    store.update();
+
+    // the leaf offset is scaled by its parent
+    const glm::vec3 position(store.getWorldMatrix(3)[3]);
+    CHECK(position == glm::vec3(1.f, 2.f, 6.f));
+    CHECK(store.isChanged(0) && store.isChanged(3) && store.isChanged(sibling));
+
+    store.update();
+    CHECK(!store.isChanged(0) && !store.isChanged(3));
+
+    // a moved node dirties its descendants only
+    child.position = glm::vec3(0.f, 5.f, 0.f);
+    store.set(1, child);
+    store.update();
+    CHECK(!store.isChanged(0) && store.isChanged(1) && store.isChanged(3) && !store.isChanged(sibling));
+    CHECK(glm::vec3(store.getWorldMatrix(3)[3]) == glm::vec3(1.f, 5.f, 6.f));
+    CHECK(store.get(1).position == child.position);
+
+    // setting the same transform is not a change
+    store.set(1, child);
+    store.update();
+    CHECK(!store.isChanged(1));
+}
+
+///
+/// @brief Cull through the hierarchy, before and after a refit
+///
+static void checkBoundingVolumeHierarchy() {
+    std::vector<BoundingBox> boxes;
+    for (u32 i = 0; i < 100; i++) {
+        const glm::vec3 center((f32)(i % 10) * 4.f - 18.f, (f32)(i / 10) * 4.f - 18.f, -20.f);
+        boxes.push_back(BoundingBox(center - glm::vec3(.5f), center + glm::vec3(.5f)));
+    }
+
+    BoundingVolumeHierarchy hierarchy;
+    hierarchy.build(boxes);
+    const Frustum frustum(glm::perspective(1.f, 1.f, .1f, 100.f));
+    std::vector<u8> visible;
+    hierarchy.cull(frustum, visible);
+    CHECK(visible.size() == boxes.size());
+    for (size_t i = 0; i < boxes.size(); i++) {
+        CHECK((visible[i] != 0) == (frustum.test(boxes[i]) != Containment::OUTSIDE));
+    }
+
+    // a refit follows the moved boxes
+    std::vector<u32> moved;
+    for (u32 i = 0; i < 100; i += 7) {
+        boxes[i] = BoundingBox(glm::vec3(-.5f, -.5f, 50.f), glm::vec3(.5f, .5f, 51.f));
+        moved.push_back(i);
+    }
+    hierarchy.refit(moved);
+    hierarchy.cull(frustum, visible);
+    for (size_t i = 0; i < boxes.size(); i++) {
+        CHECK((visible[i] != 0) == (frustum.test(boxes[i]) != Containment::OUTSIDE));
+    }
+    CHECK(hierarchy.getBounds().max.z == 51.f);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        directory = argv[1];
+    }
+
+    checkGlbReader();
+    checkEtcEncoder();
+    checkKtx2();
+    checkCookedModel();
+    checkMeshSimplifier();
+    checkMeshOptimizer();
+    checkTransformStore();
+    checkBoundingVolumeHierarchy();
+
+    if (failures > 0) {
+        spdlog::error("{} checks failed", failures);
+        return EXIT_FAILURE;
+    }
+    spdlog::info("Every check passed");
+    return EXIT_SUCCESS;
+}
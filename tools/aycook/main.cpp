@@ -0,0 +1,63 @@
+#include "cooked_model.hpp"
+#include "ktx2.hpp"
+#include "thread_pool.hpp"
+#include <spdlog/spdlog.h>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace ay;
+
+void usage() {
+    spdlog::info("usage: aycook [--no-optimize] [--no-quantize] [--no-lods] [--occluder-triangles N] <input.gltf|glb> <output.aymesh>");
+    spdlog::info("       aycook [--bottom-up] <input.png|jpg|...> <output.ktx2>");
+}
+
+int main(int argc, char** argv) {
+    ModelImportOptions options;
+    // the cook runs once, the extra time spent optimizing is free at load time
+    options.optimize = true;
+
+    // the models sample their textures top row first, Context::texture2DNew bottom row first
+    bool bottomUp = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--no-optimize") == 0) {
+            options.optimize = false;
+        }
+        else if (std::strcmp(argv[i], "--no-quantize") == 0) {
+            options.quantize = false;
+        }
+        else if (std::strcmp(argv[i], "--no-lods") == 0) {
+            options.lodRatios.clear();
+        }
+        else if (std::strcmp(argv[i], "--occluder-triangles") == 0 && i + 1 < argc) {
+            options.occluderTriangles = (u32)std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--bottom-up") == 0) {
+            bottomUp = true;
+        }
+        else if (argv[i][0] == '-') {
+            usage();
+            return EXIT_FAILURE;
+        }
+        else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (files.size() != 2) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    const std::string& output = files[1];
+    if (output.size() > 5 && output.compare(output.size() - 5, 5, ".ktx2") == 0) {
+        // ETC2 with its mip chain, found next to the source image by the model loader
+        ThreadPool threadPool;
+        return Ktx2Texture::cook(files[0], output, bottomUp, &threadPool) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    return CookedModel::write(files[0], output, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+}